@@ -0,0 +1,370 @@
+/*
+ * syscalls and CPU per message of the blocking request engines: libcurl,
+ * the native engine on epoll and the native engine on io_uring.
+ *
+ * A forked child serves canned MQ answers on a loopback port so that only
+ * the client is measured; threads of one MQClient consume (16 messages a
+ * request) and publish against it for a while per engine.
+ *
+ * usage: mq_io_bench [threads] [seconds]
+ *
+ * Syscalls are counted with the raw_syscalls:sys_enter tracepoint, which
+ * needs tracefs and perf_event_paranoid <= 1 (or CAP_PERFMON); without
+ * them the column reads n/a and `strace -f -c` on the bench gives them.
+ */
+#include "mq_client.h"
+#include "mq_native_transport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+using namespace mq::http::sdk;
+
+static const int32_t kBatchSize = 16;
+
+static std::string ConsumeBody()
+{
+    std::string body = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Messages xmlns=\"http://mq.aliyuncs.com/doc/v1/\">";
+    for (int32_t i = 0; i < kBatchSize; i++)
+    {
+        char id[32];
+        snprintf(id, sizeof(id), "%08d", i);
+        body.append("<Message><MessageId>").append(id)
+            .append("</MessageId><ReceiptHandle>rh-").append(id)
+            .append("</ReceiptHandle><MessageBodyMD5>0</MessageBodyMD5><MessageBody>")
+            .append(256, 'b')
+            .append("</MessageBody><PublishTime>1</PublishTime><FirstConsumeTime>1</FirstConsumeTime>"
+                "<NextConsumeTime>1</NextConsumeTime><ConsumedTimes>1</ConsumedTimes>"
+                "<MessageTag>t</MessageTag></Message>");
+    }
+    return body.append("</Messages>");
+}
+
+static std::string Answer(const char* status, const std::string& body)
+{
+    char head[128];
+    snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Length: %u\r\nx-mq-request-id: b\r\n\r\n",
+        status, (unsigned)body.size());
+    return std::string(head) + body;
+}
+
+struct ServerConnection
+{
+    int fd;
+    std::string in;
+    std::string out;
+};
+
+// keep-alive HTTP/1.1 on epoll, one request at a time per connection
+static void Serve(int listenFd)
+{
+    const std::string consumeAnswer = Answer("200 OK", ConsumeBody());
+    const std::string publishAnswer = Answer("201 Created",
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Message xmlns=\"http://mq.aliyuncs.com/doc/v1/\">"
+        "<MessageId>m</MessageId><MessageBodyMD5>0</MessageBodyMD5></Message>");
+    const std::string ackAnswer = Answer("204 No Content", "");
+
+    int epfd = epoll_create1(0);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listenFd, &ev);
+    struct epoll_event events[64];
+    char buffer[65536];
+    while (true)
+    {
+        int n = epoll_wait(epfd, events, 64, -1);
+        for (int i = 0; i < n; i++)
+        {
+            ServerConnection* conn = static_cast<ServerConnection*>(events[i].data.ptr);
+            if (conn == NULL)
+            {
+                int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK);
+                if (fd < 0)
+                {
+                    continue;
+                }
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                conn = new ServerConnection();
+                conn->fd = fd;
+                ev.events = EPOLLIN;
+                ev.data.ptr = conn;
+                epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+                continue;
+            }
+            ssize_t got;
+            while ((got = recv(conn->fd, buffer, sizeof(buffer), 0)) > 0)
+            {
+                conn->in.append(buffer, got);
+            }
+            if (got == 0 || (got < 0 && errno != EAGAIN))
+            {
+                close(conn->fd);
+                delete conn;
+                continue;
+            }
+            size_t headEnd;
+            while ((headEnd = conn->in.find("\r\n\r\n")) != std::string::npos)
+            {
+                size_t bodySize = 0;
+                size_t length = conn->in.find("Content-Length:");
+                if (length == std::string::npos)
+                {
+                    length = conn->in.find("content-length:");
+                }
+                if (length != std::string::npos && length < headEnd)
+                {
+                    bodySize = strtoul(conn->in.c_str() + length + 15, NULL, 10);
+                }
+                if (conn->in.size() < headEnd + 4 + bodySize)
+                {
+                    break;
+                }
+                const std::string& answer = conn->in.compare(0, 4, "GET ") == 0 ? consumeAnswer
+                    : conn->in.compare(0, 5, "POST ") == 0 ? publishAnswer : ackAnswer;
+                conn->in.erase(0, headEnd + 4 + bodySize);
+                conn->out.append(answer);
+            }
+            // answers are small, the socket buffer takes them at once
+            size_t sent = 0;
+            while (sent < conn->out.size())
+            {
+                ssize_t w = send(conn->fd, conn->out.data() + sent, conn->out.size() - sent, MSG_NOSIGNAL);
+                if (w <= 0)
+                {
+                    break;
+                }
+                sent += w;
+            }
+            conn->out.erase(0, sent);
+        }
+    }
+}
+
+// the process wide syscall counter, -1 when the tracepoint is not accessible
+static int OpenSyscallCounter()
+{
+    static const char* kPaths[] = {
+        "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+        "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"
+    };
+    long long id = -1;
+    for (size_t i = 0; i < sizeof(kPaths) / sizeof(kPaths[0]) && id < 0; i++)
+    {
+        FILE* file = fopen(kPaths[i], "r");
+        if (file != NULL)
+        {
+            if (fscanf(file, "%lld", &id) != 1)
+            {
+                id = -1;
+            }
+            fclose(file);
+        }
+    }
+    if (id < 0)
+    {
+        return -1;
+    }
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.config = (unsigned long long)id;
+    // threads started later count into this one once they exit
+    attr.inherit = 1;
+    attr.disabled = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+struct Workload
+{
+    MQClient* client;
+    bool consume;
+    std::atomic<bool> stop;
+    pthread_mutex_t mutex;
+    int64_t requests;
+    int64_t messages;
+    int64_t errors;
+};
+
+static void* Work(void* arg)
+{
+    Workload* work = static_cast<Workload*>(arg);
+    MQConsumerPtr consumer = work->client->getConsumerRef("T", "G");
+    MQProducerPtr producer = work->client->getProducerRef("T");
+    std::vector<Message> messages;
+    int64_t requests = 0;
+    int64_t received = 0;
+    int64_t errors = 0;
+    while (!work->stop.load())
+    {
+        try
+        {
+            if (work->consume)
+            {
+                messages.clear();
+                consumer->consumeMessage(kBatchSize, 1, messages);
+                received += messages.size();
+            }
+            else
+            {
+                PublishMessageResponse resp;
+                producer->publishMessage("hello", resp);
+                received++;
+            }
+            requests++;
+        }
+        catch (MQExceptionBase& e)
+        {
+            errors++;
+        }
+    }
+    pthread_mutex_lock(&work->mutex);
+    work->requests += requests;
+    work->messages += received;
+    work->errors += errors;
+    pthread_mutex_unlock(&work->mutex);
+    return NULL;
+}
+
+static double Seconds(const struct timeval& tv)
+{
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void Run(const char* name, const std::string& endpoint, MQConnectionConfig config,
+                const bool consume, const int32_t threads, const int32_t seconds)
+{
+    config.connPoolSize = threads;
+    MQClient client(endpoint, "id", "key", config);
+    if (config.httpEngine == HTTP_ENGINE_NATIVE && config.useIoUring)
+    {
+        MQNativeTransport probe(config);
+        if (!probe.UsesIoUring())
+        {
+            printf("%-8s %-8s io_uring not available here, skipped\n", name, consume ? "consume" : "publish");
+            return;
+        }
+    }
+
+    Workload work;
+    work.client = &client;
+    work.consume = consume;
+    work.stop.store(false);
+    pthread_mutex_init(&work.mutex, NULL);
+    work.requests = work.messages = work.errors = 0;
+
+    int counter = OpenSyscallCounter();
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    if (counter >= 0)
+    {
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    std::vector<pthread_t> workers(threads);
+    for (int32_t i = 0; i < threads; i++)
+    {
+        pthread_create(&workers[i], NULL, &Work, &work);
+    }
+    sleep(seconds);
+    work.stop.store(true);
+    for (int32_t i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    long long syscalls = -1;
+    if (counter >= 0)
+    {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &syscalls, sizeof(syscalls)) != (ssize_t)sizeof(syscalls))
+        {
+            syscalls = -1;
+        }
+        close(counter);
+    }
+    getrusage(RUSAGE_SELF, &after);
+    pthread_mutex_destroy(&work.mutex);
+
+    double messages = work.messages > 0 ? (double)work.messages : 1;
+    double userUs = (Seconds(after.ru_utime) - Seconds(before.ru_utime)) * 1e6 / messages;
+    double sysUs = (Seconds(after.ru_stime) - Seconds(before.ru_stime)) * 1e6 / messages;
+    double switches = (double)(after.ru_nvcsw - before.ru_nvcsw) / messages;
+    char syscallText[32];
+    if (syscalls >= 0)
+        snprintf(syscallText, sizeof(syscallText), "%.2f", syscalls / messages);
+    else
+        snprintf(syscallText, sizeof(syscallText), "n/a");
+    printf("%-8s %-8s %10.0f %10.2f %10.2f %12.2f %10s %8lld\n", name, consume ? "consume" : "publish",
+        work.messages / (double)seconds, userUs, sysUs, switches, syscallText, (long long)work.errors);
+}
+
+int main(int argc, char** argv)
+{
+    int32_t threads = argc > 1 ? atoi(argv[1]) : 64;
+    int32_t seconds = argc > 2 ? atoi(argv[2]) : 5;
+
+    int listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrSize = sizeof(addr);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || listen(listenFd, 1024) != 0 || getsockname(listenFd, (struct sockaddr*)&addr, &addrSize) != 0)
+    {
+        perror("listen");
+        return 1;
+    }
+    pid_t server = fork();
+    if (server == 0)
+    {
+        Serve(listenFd);
+        _exit(0);
+    }
+    close(listenFd);
+
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", (int)ntohs(addr.sin_port));
+    printf("%d threads, %d s per run, client side only, per message:\n", threads, seconds);
+    printf("%-8s %-8s %10s %10s %10s %12s %10s %8s\n",
+        "engine", "request", "msgs/s", "user us", "sys us", "vol. ctxsw", "syscalls", "errors");
+
+    MQConnectionConfig curl;
+    curl.timeout = 10;
+    MQConnectionConfig native = curl;
+    native.httpEngine = HTTP_ENGINE_NATIVE;
+    MQConnectionConfig uring = native;
+    uring.useIoUring = true;
+    for (int consume = 1; consume >= 0; consume--)
+    {
+        Run("curl", endpoint, curl, consume != 0, threads, seconds);
+        Run("epoll", endpoint, native, consume != 0, threads, seconds);
+        Run("io_uring", endpoint, uring, consume != 0, threads, seconds);
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    return 0;
+}
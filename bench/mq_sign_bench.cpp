@@ -0,0 +1,150 @@
+/*
+ * signs per second on one core: the one-shot HMAC the SDK used to call per
+ * request against MQNetworkTool::Sign with its cached HMAC-SHA1 key state;
+ * the middle row changes only the Base64 so that the key state shows alone.
+ *
+ * usage: mq_sign_bench [seconds per run]
+ *
+ * All produce the same Authorization value, which is checked first.
+ */
+#include "mq_network_tool.h"
+#include "mq_common_tool.h"
+
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace mq::http::sdk;
+
+// Sign is for the SDK itself
+struct SignTool : public MQNetworkTool
+{
+    using MQNetworkTool::Sign;
+};
+
+// MQNetworkTool::Sign before the key state was cached
+static string OneShotSign(const char* data, const string& accessId, const string& accessKey)
+{
+    char sha1sum[EVP_MAX_MD_SIZE];
+    unsigned int sha1len;
+    HMAC(EVP_sha1(), accessKey.c_str(), strlen(accessKey.c_str()), (const unsigned char*) data, strlen(data),
+        (unsigned char*) sha1sum, &sha1len);
+    istringstream eis(string(sha1sum, sha1len));
+    ostringstream eos;
+    Base64Tool::Base64Encoding(eis, eos);
+    return "MQ " + accessId + ":" + eos.str();
+}
+
+// the one-shot HMAC with the raw buffer Base64 Sign uses, only the key state differs
+static string OneShotHmacSign(const char* data, const string& accessId, const string& accessKey)
+{
+    char sha1sum[EVP_MAX_MD_SIZE];
+    unsigned int sha1len;
+    HMAC(EVP_sha1(), accessKey.c_str(), strlen(accessKey.c_str()), (const unsigned char*) data, strlen(data),
+        (unsigned char*) sha1sum, &sha1len);
+    char base64[32];
+    size_t base64len = Base64Tool::Base64Encoding(sha1sum, sha1len, base64);
+    return "MQ " + accessId + ":" + string(base64, base64len);
+}
+
+static double Now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename SignFunction>
+static double SignsPerSecond(SignFunction sign, const double seconds)
+{
+    size_t sink = 0;
+    int64_t signs = 0;
+    double begin = Now();
+    double elapsed = 0;
+    while (elapsed < seconds)
+    {
+        // the clock is read every few hundred signs only
+        for (int32_t i = 0; i < 256; i++)
+        {
+            sink += sign().size();
+        }
+        signs += 256;
+        elapsed = Now() - begin;
+    }
+    if (sink == 0)
+    {
+        printf("unexpected empty signature\n");
+    }
+    return signs / elapsed;
+}
+
+struct OneShot
+{
+    const string* data;
+    const string* accessId;
+    const string* accessKey;
+    string operator()() const
+    {
+        return OneShotSign(data->c_str(), *accessId, *accessKey);
+    }
+};
+
+struct OneShotHmac
+{
+    const string* data;
+    const string* accessId;
+    const string* accessKey;
+    string operator()() const
+    {
+        return OneShotHmacSign(data->c_str(), *accessId, *accessKey);
+    }
+};
+
+struct Cached
+{
+    const string* data;
+    const string* accessId;
+    const string* accessKey;
+    string operator()() const
+    {
+        return SignTool::Sign(*data, *accessId, *accessKey);
+    }
+};
+
+int main(int argc, char** argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+
+    const string accessId = "LTAI4FbenchAccessId01";
+    const string accessKey = "benchAccessKeySecret0123456789";
+    // what a publish to a topic signs
+    const string data = "POST\n\ntext/xml;charset=utf-8\nSun, 06 Nov 1994 08:49:37 GMT\n"
+        "x-mq-version:2015-06-06\n/topics/BenchTopic/messages";
+
+    string expected = OneShotSign(data.c_str(), accessId, accessKey);
+    string actual = SignTool::Sign(data, accessId, accessKey);
+    if (expected != actual || expected != OneShotHmacSign(data.c_str(), accessId, accessKey))
+    {
+        printf("Authorization differs:\n  %s\n  %s\n", expected.c_str(), actual.c_str());
+        return 1;
+    }
+
+    OneShot oneShot = { &data, &accessId, &accessKey };
+    OneShotHmac oneShotHmac = { &data, &accessId, &accessKey };
+    Cached cached = { &data, &accessId, &accessKey };
+    double before = SignsPerSecond(oneShot, seconds);
+    double hmacOnly = SignsPerSecond(oneShotHmac, seconds);
+    double after = SignsPerSecond(cached, seconds);
+    printf("%-40s %12.0f signs/s\n", "one-shot HMAC, stream Base64 (before)", before);
+    printf("%-40s %12.0f signs/s\n", "one-shot HMAC, buffer Base64", hmacOnly);
+    printf("%-40s %12.0f signs/s\n", "cached key state (Sign)", after);
+    printf("%-40s %12.2fx\n", "speedup of the key state alone", after / hmacOnly);
+    printf("%-40s %12.2fx\n", "speedup over before", after / before);
+    return 0;
+}
@@ -0,0 +1,320 @@
+#include "mq_async_client.h"
+#include "mq_utils.h"
+#include "constants.h"
+
+using namespace std;
+using namespace mq::http::sdk;
+
+namespace
+{
+
+/*
+ * the transfers own copies of everything the request points to,
+ * the caller's strings may be gone before the request completes
+ */
+class PublishMessageTransfer : public AsyncTransfer
+{
+public:
+    PublishMessageTransfer(const std::string& endpoint,
+                           const std::string& instanceId,
+                           const std::string& topicName,
+                           const std::string& messageBody,
+                           const std::string& messageTag,
+                           PublishMessageCallbackPtr callback)
+        : AsyncTransfer(endpoint)
+        , mInstanceId(instanceId)
+        , mTopicName(topicName)
+        , mMessageBody(messageBody)
+        , mMessageTag(messageTag)
+        , mRequest(mInstanceId, mTopicName, mMessageBody, mMessageTag)
+        , mCallback(callback)
+    {
+    }
+
+    Request& getRequest() { return mRequest; }
+    Response& getResponse() { return mResponse; }
+    void onSuccess() { mCallback->onSuccess(mResponse); }
+    void onFailed(const MQExceptionBase& e) { mCallback->onFailed(e); }
+
+    std::string mInstanceId;
+    std::string mTopicName;
+    std::string mMessageBody;
+    std::string mMessageTag;
+    PublishMessageRequest mRequest;
+    PublishMessageResponse mResponse;
+    PublishMessageCallbackPtr mCallback;
+};
+
+class ConsumeMessageTransfer : public AsyncTransfer
+{
+public:
+    ConsumeMessageTransfer(const std::string& endpoint,
+                           const std::string& instanceId,
+                           const std::string& topicName,
+                           const std::string& consumer,
+                           const std::string& messageTag,
+                           const int32_t numOfMessages,
+                           const int32_t waitSeconds,
+                           ConsumeMessageCallbackPtr callback)
+        : AsyncTransfer(endpoint)
+        , mInstanceId(instanceId)
+        , mTopicName(topicName)
+        , mConsumer(consumer)
+        , mMessageTag(messageTag)
+        , mRequest(mInstanceId, mTopicName, mConsumer, numOfMessages, mMessageTag, waitSeconds)
+        , mResponse(mMessages)
+        , mCallback(callback)
+    {
+    }
+
+    Request& getRequest() { return mRequest; }
+    Response& getResponse() { return mResponse; }
+    void onSuccess() { mCallback->onSuccess(mMessages); }
+    void onFailed(const MQExceptionBase& e) { mCallback->onFailed(e); }
+
+    std::string mInstanceId;
+    std::string mTopicName;
+    std::string mConsumer;
+    std::string mMessageTag;
+    std::vector<Message> mMessages;
+    ConsumeMessageRequest mRequest;
+    ConsumeMessageResponse mResponse;
+    ConsumeMessageCallbackPtr mCallback;
+};
+
+class AckMessageTransfer : public AsyncTransfer
+{
+public:
+    AckMessageTransfer(const std::string& endpoint,
+                       const std::string& instanceId,
+                       const std::string& topicName,
+                       const std::string& consumer,
+                       const std::vector<std::string>& receiptHandles,
+                       AckMessageCallbackPtr callback)
+        : AsyncTransfer(endpoint)
+        , mInstanceId(instanceId)
+        , mTopicName(topicName)
+        , mConsumer(consumer)
+        , mReceiptHandles(receiptHandles)
+        , mRequest(mInstanceId, mTopicName, mConsumer, mReceiptHandles)
+        , mCallback(callback)
+    {
+    }
+
+    Request& getRequest() { return mRequest; }
+    Response& getResponse() { return mResponse; }
+    void onSuccess() { mCallback->onSuccess(mResponse); }
+    void onFailed(const MQExceptionBase& e) { mCallback->onFailed(e); }
+
+    std::string mInstanceId;
+    std::string mTopicName;
+    std::string mConsumer;
+    std::vector<std::string> mReceiptHandles;
+    AckMessageRequest mRequest;
+    AckMessageResponse mResponse;
+    AckMessageCallbackPtr mCallback;
+};
+
+}
+
+static MQConnectionConfig MakeConfig(const int32_t connPoolSize,
+                                     const int32_t timeout,
+                                     const int32_t connectTimeout,
+                                     const int32_t asyncThreadCount)
+{
+    MQConnectionConfig config;
+    config.connPoolSize = connPoolSize;
+    config.timeout = timeout;
+    config.connectTimeout = connectTimeout;
+    config.asyncThreadCount = asyncThreadCount;
+    return config;
+}
+
+MQAsyncClient::MQAsyncClient(const std::string& endpoint,
+          const std::string& accessId,
+          const std::string& accessKey,
+          const int32_t connPoolSize,
+          const int32_t timeout,
+          const int32_t connectTimeout,
+          const int32_t asyncThreadCount)
+    : MQClient(endpoint, accessId, accessKey,
+        MakeConfig(connPoolSize, timeout, connectTimeout, asyncThreadCount))
+{
+}
+
+MQAsyncClient::MQAsyncClient(const std::string& endpoint,
+          const std::string& accessId,
+          const std::string& accessKey,
+          const std::string& stsToken,
+          const int32_t connPoolSize,
+          const int32_t timeout,
+          const int32_t connectTimeout,
+          const int32_t asyncThreadCount)
+    : MQClient(endpoint, accessId, accessKey, stsToken,
+        MakeConfig(connPoolSize, timeout, connectTimeout, asyncThreadCount))
+{
+}
+
+MQAsyncClient::MQAsyncClient(const std::string& endpoint,
+          const std::string& accessId,
+          const std::string& accessKey,
+          const MQConnectionConfig& config)
+    : MQClient(endpoint, accessId, accessKey, config)
+{
+}
+
+MQAsyncClient::MQAsyncClient(const std::string& endpoint,
+          const std::string& accessId,
+          const std::string& accessKey,
+          const std::string& stsToken,
+          const MQConnectionConfig& config)
+    : MQClient(endpoint, accessId, accessKey, stsToken, config)
+{
+}
+
+MQAsyncProducerPtr MQAsyncClient::getAsyncProducerRef(const std::string& topicName)
+{
+    return MQAsyncProducerPtr(new MQAsyncProducer(EMPTY, topicName, mEndPoint,
+        mCredentials, mTransport));
+}
+
+MQAsyncProducerPtr MQAsyncClient::getAsyncProducerRef(const std::string& instanceId, const std::string& topicName)
+{
+    return MQAsyncProducerPtr(new MQAsyncProducer(instanceId, topicName, mEndPoint,
+        mCredentials, mTransport));
+}
+
+MQAsyncConsumerPtr MQAsyncClient::getAsyncConsumerRef(const std::string& topicName, const std::string& consumer)
+{
+    return MQAsyncConsumerPtr(new MQAsyncConsumer(EMPTY, topicName, consumer, EMPTY, mEndPoint,
+        mCredentials, mTransport));
+}
+
+MQAsyncConsumerPtr MQAsyncClient::getAsyncConsumerRef(const std::string& topicName, const std::string& consumer, const std::string& messageTag)
+{
+    std::string encodeTag;
+    MQUtils::urlEncode(messageTag, encodeTag);
+
+    return MQAsyncConsumerPtr(new MQAsyncConsumer(EMPTY, topicName, consumer, encodeTag, mEndPoint,
+        mCredentials, mTransport));
+}
+
+MQAsyncConsumerPtr MQAsyncClient::getAsyncConsumerRef(const std::string& instanceId, const std::string& topicName, const std::string& consumer, const std::string& messageTag)
+{
+    std::string encodeTag;
+    MQUtils::urlEncode(messageTag, encodeTag);
+
+    return MQAsyncConsumerPtr(new MQAsyncConsumer(instanceId, topicName, consumer, encodeTag, mEndPoint,
+        mCredentials, mTransport));
+}
+
+MQAsyncProducer::MQAsyncProducer(const std::string& instanceId,
+             const std::string& topicName,
+             const std::string& endpoint,
+             MQCredentialsHolderPtr credentials,
+             MQTransportPtr transport)
+    : MQProducer(instanceId, topicName, endpoint, credentials, transport)
+{
+}
+
+void MQAsyncProducer::publishMessageAsync(const std::string& messageBody,
+                                          PublishMessageCallbackPtr callback)
+{
+    submit(messageBody, EMPTY, NULL, callback);
+}
+
+void MQAsyncProducer::publishMessageAsync(const std::string& messageBody,
+                                          const std::string& messageTag,
+                                          PublishMessageCallbackPtr callback)
+{
+    submit(messageBody, messageTag, NULL, callback);
+}
+
+void MQAsyncProducer::publishMessageAsync(TopicMessage& topicMessage,
+                                          PublishMessageCallbackPtr callback)
+{
+    submit(topicMessage.mMessageBody, topicMessage.mMessageTag, &topicMessage.mProperties, callback);
+}
+
+void MQAsyncProducer::submit(const std::string& messageBody,
+                             const std::string& messageTag,
+                             const std::map<std::string, std::string>* properties,
+                             PublishMessageCallbackPtr callback)
+{
+    if (!callback)
+    {
+        MQ_THROW(MQExceptionBase, "PublishMessageCallback should not be NULL");
+    }
+    PublishMessageTransfer* transfer = new PublishMessageTransfer(mEndPoint,
+        mInstanceId, mTopicName, messageBody, messageTag, callback);
+    AsyncTransferPtr transferPtr(transfer);
+    if (properties != NULL)
+    {
+        MQUtils::mapToString(*properties, transfer->mRequest.mProperties);
+    }
+    transfer->mRequest.setTemplate(mPublishTemplate);
+    MQClient::signRequest(transfer->mRequest, mEndPoint, *getCredentials());
+    mTransport->SendAsync(mEndPoint, transferPtr);
+}
+
+MQAsyncConsumer::MQAsyncConsumer(const std::string& instanceId,
+      const std::string& topicName,
+      const std::string& consumer,
+      const std::string& messageTag,
+      const std::string& endpoint,
+      MQCredentialsHolderPtr credentials,
+      MQTransportPtr transport)
+    : MQConsumer(instanceId, topicName, consumer, messageTag, endpoint,
+        credentials, transport)
+{
+}
+
+void MQAsyncConsumer::consumeMessageAsync(const int32_t numOfMessages,
+                                          const int32_t waitSeconds,
+                                          ConsumeMessageCallbackPtr callback)
+{
+    submit(numOfMessages, waitSeconds, false, callback);
+}
+
+void MQAsyncConsumer::consumeMessageOrderlyAsync(const int32_t numOfMessages,
+                                                 const int32_t waitSeconds,
+                                                 ConsumeMessageCallbackPtr callback)
+{
+    submit(numOfMessages, waitSeconds, true, callback);
+}
+
+void MQAsyncConsumer::submit(const int32_t numOfMessages,
+                             const int32_t waitSeconds,
+                             const bool orderly,
+                             ConsumeMessageCallbackPtr callback)
+{
+    if (!callback)
+    {
+        MQ_THROW(MQExceptionBase, "ConsumeMessageCallback should not be NULL");
+    }
+    ConsumeMessageTransfer* transfer = new ConsumeMessageTransfer(mEndPoint,
+        mInstanceId, mTopicName, mConsumer, mMessageTag, numOfMessages, waitSeconds, callback);
+    AsyncTransferPtr transferPtr(transfer);
+    if (orderly)
+    {
+        transfer->mRequest.setOrderConsume();
+    }
+    transfer->mRequest.setTemplate(mConsumeTemplate);
+    MQClient::signRequest(transfer->mRequest, mEndPoint, *getCredentials());
+    mTransport->SendAsync(mEndPoint, transferPtr);
+}
+
+void MQAsyncConsumer::ackMessageAsync(const std::vector<std::string>& receiptHandles,
+                                      AckMessageCallbackPtr callback)
+{
+    if (!callback)
+    {
+        MQ_THROW(MQExceptionBase, "AckMessageCallback should not be NULL");
+    }
+    AckMessageTransfer* transfer = new AckMessageTransfer(mEndPoint,
+        mInstanceId, mTopicName, mConsumer, receiptHandles, callback);
+    AsyncTransferPtr transferPtr(transfer);
+    transfer->mRequest.setTemplate(mAckTemplate);
+    MQClient::signRequest(transfer->mRequest, mEndPoint, *getCredentials());
+    mTransport->SendAsync(mEndPoint, transferPtr);
+}
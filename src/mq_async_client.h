@@ -0,0 +1,264 @@
+// Copyright (C) 2019, Alibaba Cloud Computing
+
+#ifndef MQ_ASYNC_CLIENT_H
+#define MQ_ASYNC_CLIENT_H
+
+#include "mq_client.h"
+#include "mq_network_tool.h"
+
+namespace mq
+{
+namespace http
+{
+namespace sdk
+{
+
+class MQAsyncProducer;
+class MQAsyncConsumer;
+
+#ifdef __APPLE__
+typedef std::shared_ptr<MQAsyncProducer> MQAsyncProducerPtr;
+typedef std::shared_ptr<MQAsyncConsumer> MQAsyncConsumerPtr;
+#else
+typedef std::tr1::shared_ptr<MQAsyncProducer> MQAsyncProducerPtr;
+typedef std::tr1::shared_ptr<MQAsyncConsumer> MQAsyncConsumerPtr;
+#endif
+
+/*
+ * completion callback of an async request
+ *
+ * CAUTION:
+ *     callbacks run on the event loop thread of MQAsyncClient, or on the
+ *     calling thread with a transport that has none (MQLoopbackTransport),
+ *     do not block or throw in them.
+ */
+template <typename T>
+class AsyncCallback
+{
+public:
+    virtual ~AsyncCallback() {}
+
+    virtual void onSuccess(T& result) = 0;
+
+    /* MQServerException for server errors, MQExceptionBase for client errors */
+    virtual void onFailed(const MQExceptionBase& e) = 0;
+};
+
+typedef AsyncCallback<PublishMessageResponse> PublishMessageCallback;
+typedef AsyncCallback<std::vector<Message> > ConsumeMessageCallback;
+typedef AsyncCallback<AckMessageResponse> AckMessageCallback;
+
+#ifdef __APPLE__
+typedef std::shared_ptr<PublishMessageCallback> PublishMessageCallbackPtr;
+typedef std::shared_ptr<ConsumeMessageCallback> ConsumeMessageCallbackPtr;
+typedef std::shared_ptr<AckMessageCallback> AckMessageCallbackPtr;
+#else
+typedef std::tr1::shared_ptr<PublishMessageCallback> PublishMessageCallbackPtr;
+typedef std::tr1::shared_ptr<ConsumeMessageCallback> ConsumeMessageCallbackPtr;
+typedef std::tr1::shared_ptr<AckMessageCallback> AckMessageCallbackPtr;
+#endif
+
+/*
+ * MQClient whose producers and consumers can also send requests without
+ * blocking the calling thread.
+ *
+ * Requests are signed on the calling thread and then handed to the transport
+ * of the client, see MQTransport::SendAsync. By default they are driven by
+ * "asyncThreadCount" event loop threads, each running a curl multi handle.
+ * Callbacks are invoked on those loop threads.
+ */
+class MQAsyncClient : public MQClient
+{
+public:
+    /* init the MQAsyncClient
+     *
+     * @param endpoint:
+     *      http://{AccountId}.mq.cn-hangzhou.aliyuncs.com
+     * @param accessId:  accessId from aliyun.com
+     * @param accessKey: accessKey from aliyun.com
+     * @param connPoolSize:
+     *      connections kept alive by each event loop
+     * @param asyncThreadCount: the number of event loop threads
+     */
+    MQAsyncClient(const std::string& endpoint,
+              const std::string& accessId,
+              const std::string& accessKey,
+              const int32_t connPoolSize = 200,
+              const int32_t timeout = 35,
+              const int32_t connectTimeout = 35,
+              const int32_t asyncThreadCount = 1);
+
+    /* init the MQAsyncClient with sts token
+     *
+     * @param endpoint:
+     *      http://{AccountId}.mq.cn-hangzhou.aliyuncs.com
+     * @param accessId:  the sts accessId
+     * @param accessKey: the sts accessKey
+     * @param stsToken:  the sts token
+     * @param connPoolSize:
+     *      connections kept alive by each event loop
+     * @param asyncThreadCount: the number of event loop threads
+     */
+    MQAsyncClient(const std::string& endpoint,
+              const std::string& accessId,
+              const std::string& accessKey,
+              const std::string& stsToken,
+              const int32_t connPoolSize = 200,
+              const int32_t timeout = 35,
+              const int32_t connectTimeout = 35,
+              const int32_t asyncThreadCount = 1);
+
+    /* init the MQAsyncClient with connection settings
+     *
+     * @param endpoint:
+     *      http://{AccountId}.mq.cn-hangzhou.aliyuncs.com
+     * @param accessId:  accessId from aliyun.com
+     * @param accessKey: accessKey from aliyun.com
+     * @param config: event loop threads, HTTP/2 etc, see MQConnectionConfig
+     */
+    MQAsyncClient(const std::string& endpoint,
+              const std::string& accessId,
+              const std::string& accessKey,
+              const MQConnectionConfig& config);
+
+    /* init the MQAsyncClient with sts token and connection settings
+     *
+     * @param endpoint:
+     *      http://{AccountId}.mq.cn-hangzhou.aliyuncs.com
+     * @param accessId:  the sts accessId
+     * @param accessKey: the sts accessKey
+     * @param stsToken:  the sts token
+     * @param config: event loop threads, HTTP/2 etc, see MQConnectionConfig
+     */
+    MQAsyncClient(const std::string& endpoint,
+              const std::string& accessId,
+              const std::string& accessKey,
+              const std::string& stsToken,
+              const MQConnectionConfig& config);
+
+    virtual ~MQAsyncClient() {}
+
+    MQAsyncProducerPtr getAsyncProducerRef(const std::string& topicName);
+
+    MQAsyncProducerPtr getAsyncProducerRef(const std::string& instanceId, const std::string& topicName);
+
+    MQAsyncConsumerPtr getAsyncConsumerRef(const std::string& topicName, const std::string& consumer);
+
+    MQAsyncConsumerPtr getAsyncConsumerRef(const std::string& topicName, const std::string& consumer, const std::string& messageTag);
+
+    MQAsyncConsumerPtr getAsyncConsumerRef(const std::string& instanceId, const std::string& topicName, const std::string& consumer, const std::string& messageTag);
+};
+
+/*
+ * CAUTION:
+ *     the async functions only throw MQExceptionBase when the request
+ *     could not be submitted, request failures go to callback->onFailed.
+ */
+class MQAsyncProducer : public MQProducer
+{
+public:
+    virtual ~MQAsyncProducer() {}
+
+    /* publish one message asynchronously
+     *
+     * @param messageBody: the message body
+     * @param callback: gets the Response containing MessageId and BodyMD5
+     */
+    void publishMessageAsync(const std::string& messageBody,
+                             PublishMessageCallbackPtr callback);
+
+    /* publish one message with messageTag asynchronously
+     *
+     * @param messageBody: the message body
+     * @param messageTag: the message Tag
+     * @param callback: gets the Response containing MessageId and BodyMD5
+     */
+    void publishMessageAsync(const std::string& messageBody,
+                             const std::string& messageTag,
+                             PublishMessageCallbackPtr callback);
+
+    /* publish message asynchronously
+     *
+     * @param topicMessage: the message
+     * @param callback: gets the Response containing MessageId and BodyMD5
+     */
+    void publishMessageAsync(TopicMessage& topicMessage,
+                             PublishMessageCallbackPtr callback);
+
+    friend class MQAsyncClient;
+
+protected:
+    MQAsyncProducer(const std::string& instanceId,
+          const std::string& topicName,
+          const std::string& endpoint,
+          MQCredentialsHolderPtr credentials,
+          MQTransportPtr transport);
+
+    void submit(const std::string& messageBody,
+                const std::string& messageTag,
+                const std::map<std::string, std::string>* properties,
+                PublishMessageCallbackPtr callback);
+};
+
+/*
+ * CAUTION:
+ *     the async functions only throw MQExceptionBase when the request
+ *     could not be submitted, request failures go to callback->onFailed.
+ */
+class MQAsyncConsumer : public MQConsumer
+{
+public:
+    virtual ~MQAsyncConsumer() {}
+
+    /* consume messages asynchronously
+     *
+     * @param numOfMessages: the batch size, 1~16
+     * @param waitSeconds:
+     *     if no message to consume, the request will be parked for
+     *         "waitSeconds" util timeout or any message coming.
+     * @param callback: gets the received messages
+     */
+    void consumeMessageAsync(const int32_t numOfMessages,
+                             const int32_t waitSeconds,
+                             ConsumeMessageCallbackPtr callback);
+
+    /* consume messages orderly and asynchronously, see MQConsumer::consumeMessageOrderly
+     *
+     * @param numOfMessages: the batch size, 1~16
+     * @param waitSeconds: 1~30
+     * @param callback: gets the received messages
+     */
+    void consumeMessageOrderlyAsync(const int32_t numOfMessages,
+                                    const int32_t waitSeconds,
+                                    ConsumeMessageCallbackPtr callback);
+
+    /* ack messages asynchronously
+     *
+     * @param receiptHandles: the ReceiptHandles
+     * @param callback: gets the AckMessageResponse
+     */
+    void ackMessageAsync(const std::vector<std::string>& receiptHandles,
+                         AckMessageCallbackPtr callback);
+
+    friend class MQAsyncClient;
+
+protected:
+    MQAsyncConsumer(const std::string& instanceId,
+          const std::string& topicName,
+          const std::string& consumer,
+          const std::string& messageTag,
+          const std::string& endpoint,
+          MQCredentialsHolderPtr credentials,
+          MQTransportPtr transport);
+
+    void submit(const int32_t numOfMessages,
+                const int32_t waitSeconds,
+                const bool orderly,
+                ConsumeMessageCallbackPtr callback);
+};
+
+}
+}
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include "mq_client.h"
 #include "mq_utils.h"
 #include "mq_network_tool.h"
+#include "mq_native_transport.h"
 #include "mq_common_tool.h"
 #include "constants.h"
 
@@ -31,17 +32,42 @@ public:
 };
 static MQGlobalFlagInit sMQInit;
 
+/*
+ * the first call moves a producer/consumer off the holder it shares with its
+ * client onto one of its own, later calls update that one. Readers see
+ * either holder, both stay alive until the producer/consumer is destroyed.
+ */
+static void SetOwnCredentials(std::atomic<MQCredentialsHolder*>& active,
+                              MQCredentialsHolder* shared,
+                              const MQCredentialsPtr& credentials)
+{
+    MQCredentialsHolder* current = active.load();
+    if (current == shared)
+    {
+        MQCredentialsHolder* own = new MQCredentialsHolder(credentials);
+        if (active.compare_exchange_strong(current, own))
+        {
+            return;
+        }
+        // another updateAccessId detached it meanwhile
+        delete own;
+    }
+    current->set(credentials);
+}
+
 MQClient::MQClient(const string& endpoint,
                      const string& accessId,
                      const string& accessKey,
                      const int32_t connPoolSize,
                      const int32_t timeout,
                      const int32_t connectTimeout)
-    : mAccessId(accessId)
-    , mAccessKey(accessKey)
-    , mStsToken("")
+    : mCredentials(new MQCredentialsHolder(MQCredentialsPtr(new MQCredentials(accessId, accessKey))))
 {
+    mConfig.connPoolSize = connPoolSize;
+    mConfig.connectTimeout = connectTimeout;
+    mConfig.timeout = timeout;
     mMQConnTool.reset(new MQConnectionTool(connPoolSize, connectTimeout, timeout));
+    mTransport.reset(new MQCurlTransport(mMQConnTool));
 
     mEndPoint = StringTool::RightTrimString(endpoint);
     mEndPoint = StringTool::RightTrimString(mEndPoint, '/');
@@ -54,31 +80,106 @@ MQClient::MQClient(const std::string& endpoint,
           const int32_t connPoolSize,
           const int32_t timeout,
           const int32_t connectTimeout)
-    : mAccessId(accessId)
-    , mAccessKey(accessKey)
-    , mStsToken(stsToken)
+    : mCredentials(new MQCredentialsHolder(MQCredentialsPtr(new MQCredentials(accessId, accessKey, stsToken))))
 {
+    mConfig.connPoolSize = connPoolSize;
+    mConfig.connectTimeout = connectTimeout;
+    mConfig.timeout = timeout;
     mMQConnTool.reset(new MQConnectionTool(connPoolSize, connectTimeout, timeout));
+    mTransport.reset(new MQCurlTransport(mMQConnTool));
+
+    mEndPoint = StringTool::RightTrimString(endpoint);
+    mEndPoint = StringTool::RightTrimString(mEndPoint, '/');
+}
+
+MQClient::MQClient(const std::string& endpoint,
+          const std::string& accessId,
+          const std::string& accessKey,
+          const MQConnectionConfig& config)
+    : mCredentials(new MQCredentialsHolder(MQCredentialsPtr(new MQCredentials(accessId, accessKey))))
+{
+    mEndPoint = StringTool::RightTrimString(endpoint);
+    mEndPoint = StringTool::RightTrimString(mEndPoint, '/');
+    initTransport(config);
+}
 
+MQClient::MQClient(const std::string& endpoint,
+          const std::string& accessId,
+          const std::string& accessKey,
+          const std::string& stsToken,
+          const MQConnectionConfig& config)
+    : mCredentials(new MQCredentialsHolder(MQCredentialsPtr(new MQCredentials(accessId, accessKey, stsToken))))
+{
     mEndPoint = StringTool::RightTrimString(endpoint);
     mEndPoint = StringTool::RightTrimString(mEndPoint, '/');
+    initTransport(config);
+}
+
+void MQClient::initTransport(const MQConnectionConfig& config)
+{
+    mConfig = config;
+    if (config.httpEngine == HTTP_ENGINE_NATIVE && !config.enableHttp2)
+    {
+        // no curl pool at all, the native transport runs async requests on its own curl loops
+        if (config.sharePoolAcrossClients || config.clientPoolLimit > 0)
+        {
+            MQ_THROW(MQExceptionBase, "sharePoolAcrossClients and clientPoolLimit are not supported by HTTP_ENGINE_NATIVE");
+        }
+        mTransport.reset(new MQNativeTransport(config));
+        return;
+    }
+
+    mMQConnTool.reset(new MQConnectionTool(config, mEndPoint));
+    mTransport.reset(new MQCurlTransport(mMQConnTool));
+    if (config.warmUpConnections > 0 && !config.enableHttp2)
+    {
+        mMQConnTool->StartWarmUp(mEndPoint, config.warmUpConnections);
+    }
+}
+
+void MQClient::setCredentialsProvider(MQCredentialsProviderPtr provider,
+                                      const MQCredentialsRefreshConfig& config)
+{
+    // the previous refresher stops before the first fetch of the new provider
+    mCredentialsRefresher.reset();
+    mCredentialsRefresher.reset(new MQCredentialsRefresher(provider, mCredentials, config));
+}
+
+bool MQClient::warmUp(const int32_t timeoutMs)
+{
+    const MQConnectionConfig& config = mConfig;
+    if (config.enableHttp2)
+    {
+        return true;
+    }
+    int32_t connections = config.warmUpConnections;
+    if (connections <= 0)
+    {
+        connections = config.connPoolSize < 16 ? config.connPoolSize : 16;
+    }
+    return mTransport->WarmUp(mEndPoint, connections, timeoutMs);
+}
+
+MQConnectionPoolStats MQClient::getPoolStats()
+{
+    if (!mMQConnTool)
+    {
+        return MQConnectionPoolStats();
+    }
+    return mMQConnTool->GetPoolStats();
 }
 
 void MQClient::updateAccessId(const std::string& accessId,
                                const std::string& accessKey)
 {
-    mAccessId = accessId;
-    mAccessKey = accessKey;
-    mStsToken = "";
+    mCredentials->set(MQCredentialsPtr(new MQCredentials(accessId, accessKey)));
 }
 
 void MQClient::updateAccessId(const std::string& accessId,
                                const std::string& accessKey,
                                const std::string& stsToken)
 {
-    mAccessId = accessId;
-    mAccessKey = accessKey;
-    mStsToken = stsToken;
+    mCredentials->set(MQCredentialsPtr(new MQCredentials(accessId, accessKey, stsToken)));
 }
 
 void MQClient::sendRequest(Request& request,
@@ -96,6 +197,37 @@ void MQClient::sendRequest(Request& request,
                                 mqConnTool);
 }
 
+void MQClient::sendRequest(Request& request,
+                            Response& response,
+                            const std::string& endpoint,
+                            const std::string& accessId,
+                            const std::string& accessKey,
+                            const std::string& stsToken,
+                            MQTransportPtr transport)
+{
+    MQClient::signRequest(request, endpoint, accessId, accessKey, stsToken);
+    transport->Send(endpoint, request, response);
+}
+
+void MQClient::sendRequest(Request& request,
+                            Response& response,
+                            const std::string& endpoint,
+                            const MQCredentials& credentials,
+                            MQTransport& transport)
+{
+    MQClient::signRequest(request, endpoint, credentials.getAccessId(),
+        credentials.getAccessKey(), credentials.getStsToken());
+    transport.Send(endpoint, request, response);
+}
+
+void MQClient::signRequest(Request& req,
+                            const std::string& endpoint,
+                            const MQCredentials& credentials)
+{
+    MQClient::signRequest(req, endpoint, credentials.getAccessId(),
+        credentials.getAccessKey(), credentials.getStsToken());
+}
+
 void MQClient::signRequest(Request& req,
                             const std::string& endpoint,
                             const std::string& accessId,
@@ -107,19 +239,23 @@ void MQClient::signRequest(Request& req,
         req.setHeader(SECURITY_TOKEN, stsToken);
     }
     const std::string& canonicalizedResource = req.generateCanonicalizedResource();
-    const std::string& requestBody = req.generateRequestBody();
-    size_t contentLength = strlen(requestBody.c_str());
+    req.generateBodySegments();
+    size_t contentLength = req.getBodySize();
 
     size_t pos = endpoint.find_first_of("//");
     req.setHeader(HOST, endpoint.substr(pos + 2));
     req.setHeader(CONTENT_TYPE, DEFAULT_CONTENT_TYPE);
-    req.setHeader(DATE, TimeTool::GetDateTime());
+    char date[TimeTool::kDateTimeLength];
+    TimeTool::GetDateTime(date);
+    req.setHeader(DATE, date, sizeof(date));
     req.setHeader(MQ_VERSION, CURRENT_VERSION);
     if (contentLength > 0)
         req.setHeader(CONTENT_LENGTH, StringTool::ToString(contentLength));
+    const MQRequestTemplatePtr& requestTemplate = req.getTemplate();
     req.setHeader(AUTHORIZATION,
         MQNetworkTool::Signature(req.getMethod(), canonicalizedResource,
-            accessId, accessKey, req.getHeaders()));
+            accessId, accessKey, req.getHeaders(),
+            requestTemplate ? &requestTemplate->GetSignatureCache() : NULL));
 
 }
 
@@ -128,8 +264,8 @@ MQConsumerPtr MQClient::getConsumerRef(const std::string& instanceId, const std:
     std::string encodeTag;
     MQUtils::urlEncode(messageTag, encodeTag);
 
-    return MQConsumerPtr(new MQConsumer(instanceId, topicName, consumer, encodeTag, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool));
+    return MQConsumerPtr(new MQConsumer(instanceId, topicName, consumer, encodeTag, mEndPoint,
+        mCredentials, mTransport));
 }
 
 MQConsumerPtr MQClient::getConsumerRef(const std::string& topicName, const std::string& consumer, const std::string& messageTag)
@@ -137,39 +273,39 @@ MQConsumerPtr MQClient::getConsumerRef(const std::string& topicName, const std::
     std::string encodeTag;
     MQUtils::urlEncode(messageTag, encodeTag);
 
-    return MQConsumerPtr(new MQConsumer(EMPTY, topicName, consumer, encodeTag, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool));
+    return MQConsumerPtr(new MQConsumer(EMPTY, topicName, consumer, encodeTag, mEndPoint,
+        mCredentials, mTransport));
 }
 
 MQConsumerPtr MQClient::getConsumerRef(const std::string& topicName, const std::string& consumer)
 {
-    return MQConsumerPtr(new MQConsumer(EMPTY, topicName, consumer, EMPTY, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool));
+    return MQConsumerPtr(new MQConsumer(EMPTY, topicName, consumer, EMPTY, mEndPoint,
+        mCredentials, mTransport));
 }
 
 MQProducerPtr MQClient::getProducerRef(const std::string& instanceId, const std::string& topicName)
 {
-    return MQProducerPtr(new MQProducer(instanceId, topicName, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool));
+    return MQProducerPtr(new MQProducer(instanceId, topicName, mEndPoint,
+        mCredentials, mTransport));
 }
 
 MQProducerPtr MQClient::getProducerRef(const std::string& topicName)
 {
-    return MQProducerPtr(new MQProducer(EMPTY, topicName, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool));
+    return MQProducerPtr(new MQProducer(EMPTY, topicName, mEndPoint,
+        mCredentials, mTransport));
 }
 
 MQTransProducerPtr MQClient::getTransProducerRef(const std::string& topicName, const std::string& groupId)
 {
-    return MQTransProducerPtr(new MQTransProducer(EMPTY, topicName, groupId, mEndPoint, mAccessId, 
-                mAccessKey, mStsToken, mMQConnTool));
+    return MQTransProducerPtr(new MQTransProducer(EMPTY, topicName, groupId, mEndPoint,
+        mCredentials, mTransport));
 }
 
 
 MQTransProducerPtr MQClient::getTransProducerRef(const std::string& instanceId, const std::string& topicName, const std::string& groupId)
 {
-    return MQTransProducerPtr(new MQTransProducer(instanceId, topicName, groupId, mEndPoint, mAccessId, 
-                mAccessKey, mStsToken, mMQConnTool));
+    return MQTransProducerPtr(new MQTransProducer(instanceId, topicName, groupId, mEndPoint,
+        mCredentials, mTransport));
 }
 
 MQConsumer::MQConsumer(const std::string& instanceId,
@@ -177,40 +313,62 @@ MQConsumer::MQConsumer(const std::string& instanceId,
       const std::string& consumer,
       const std::string& messageTag,
       const std::string& endpoint,
-      const std::string& accessId,
-      const std::string& accessKey,
-      const std::string& stsToken,
-      MQConnectionToolPtr mqConnTool)
+      MQCredentialsHolderPtr credentials,
+      MQTransportPtr transport)
     : mInstanceId(instanceId)
     , mTopicName(topicName)
     , mConsumer(consumer)
     , mMessageTag(messageTag)
     , mEndPoint(endpoint)
-    , mAccessId(accessId)
-    , mAccessKey(accessKey)
-    , mStsToken(stsToken)
-    , mMQConnTool(mqConnTool)
+    , mCredentials(credentials)
+    , mActiveCredentials(credentials.get())
+    , mTransport(transport)
+    , mConsumeTemplate(new MQRequestTemplate(endpoint, false))
+    , mAckTemplate(new MQRequestTemplate(endpoint, true))
 {
 }
 
+MQConsumer::~MQConsumer()
+{
+    if (mActiveCredentials.load() != mCredentials.get())
+    {
+        delete mActiveCredentials.load();
+    }
+}
+
+void MQConsumer::updateAccessId(const std::string& accessId,
+                           const std::string& accessKey)
+{
+    SetOwnCredentials(mActiveCredentials, mCredentials.get(),
+        MQCredentialsPtr(new MQCredentials(accessId, accessKey)));
+}
+
+void MQConsumer::updateAccessId(const std::string& accessId,
+                           const std::string& accessKey,
+                           const std::string& stsToken)
+{
+    SetOwnCredentials(mActiveCredentials, mCredentials.get(),
+        MQCredentialsPtr(new MQCredentials(accessId, accessKey, stsToken)));
+}
+
 void MQConsumer::consumeMessage(const int32_t numOfMessages,
                                 std::vector<Message>& messages)
 {
     ConsumeMessageRequest req(mInstanceId, mTopicName, mConsumer, numOfMessages, mMessageTag, -1);
+    req.setTemplate(mConsumeTemplate);
     ConsumeMessageResponse resp(messages);
-    MQClient::sendRequest(req, resp, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
 }
 
 void MQConsumer::consumeMessageOrderly(const int32_t numOfMessages,
                                 std::vector<Message>& messages)
 {
     ConsumeMessageRequest req(mInstanceId, mTopicName, mConsumer, numOfMessages, mMessageTag, -1);
+    req.setTemplate(mConsumeTemplate);
     req.setOrderConsume();
 
     ConsumeMessageResponse resp(messages);
-    MQClient::sendRequest(req, resp, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
 }
 
 void MQConsumer::consumeMessage(const int32_t numOfMessages,
@@ -218,9 +376,9 @@ void MQConsumer::consumeMessage(const int32_t numOfMessages,
                                 std::vector<Message>& messages)
 {
     ConsumeMessageRequest req(mInstanceId, mTopicName, mConsumer, numOfMessages, mMessageTag, waitSeconds);
+    req.setTemplate(mConsumeTemplate);
     ConsumeMessageResponse resp(messages);
-    MQClient::sendRequest(req, resp, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
 }
 
 void MQConsumer::consumeMessageOrderly(const int32_t numOfMessages,
@@ -228,61 +386,125 @@ void MQConsumer::consumeMessageOrderly(const int32_t numOfMessages,
                                 std::vector<Message>& messages)
 {
     ConsumeMessageRequest req(mInstanceId, mTopicName, mConsumer, numOfMessages, mMessageTag, waitSeconds);
+    req.setTemplate(mConsumeTemplate);
     req.setOrderConsume();
 
     ConsumeMessageResponse resp(messages);
-    MQClient::sendRequest(req, resp, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
+}
+
+void MQConsumer::consumeMessage(const int32_t numOfMessages,
+                                const int32_t waitSeconds,
+                                ConsumeBatchPtr& batch)
+{
+    ConsumeMessageRequest req(mInstanceId, mTopicName, mConsumer, numOfMessages, mMessageTag, waitSeconds);
+    req.setTemplate(mConsumeTemplate);
+    // a new batch each time, handlers may still hold the previous one. It
+    // reaches the caller only once complete, a failed transfer drops it
+    ConsumeBatchPtr received(new ConsumeBatch());
+    ConsumeBatchResponse resp(*received);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
+    batch = received;
+}
+
+void MQConsumer::consumeMessageOrderly(const int32_t numOfMessages,
+                                const int32_t waitSeconds,
+                                ConsumeBatchPtr& batch)
+{
+    ConsumeMessageRequest req(mInstanceId, mTopicName, mConsumer, numOfMessages, mMessageTag, waitSeconds);
+    req.setTemplate(mConsumeTemplate);
+    req.setOrderConsume();
+
+    ConsumeBatchPtr received(new ConsumeBatch());
+    ConsumeBatchResponse resp(*received);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
+    batch = received;
+}
+
+void MQConsumer::consumeMessage(const int32_t numOfMessages,
+                                const int32_t waitSeconds,
+                                MessageBatch& batch)
+{
+    ConsumeMessageRequest req(mInstanceId, mTopicName, mConsumer, numOfMessages, mMessageTag, waitSeconds);
+    req.setTemplate(mConsumeTemplate);
+    batch.clear();
+    MessageBatchResponse resp(batch);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
+}
+
+void MQConsumer::consumeMessageOrderly(const int32_t numOfMessages,
+                                const int32_t waitSeconds,
+                                MessageBatch& batch)
+{
+    ConsumeMessageRequest req(mInstanceId, mTopicName, mConsumer, numOfMessages, mMessageTag, waitSeconds);
+    req.setTemplate(mConsumeTemplate);
+    req.setOrderConsume();
+
+    batch.clear();
+    MessageBatchResponse resp(batch);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
 }
 
 void MQConsumer::ackMessage(const std::vector<std::string>& receiptHandles,
                               AckMessageResponse& resp)
 {
     AckMessageRequest req(mInstanceId, mTopicName, mConsumer, receiptHandles);
-    MQClient::sendRequest(req, resp, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool);
+    req.setTemplate(mAckTemplate);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
+}
+
+void MQConsumer::ackMessage(const MessageBatch& batch,
+                              AckMessageResponse& resp)
+{
+    AckMessageRequest req(mInstanceId, mTopicName, mConsumer, batch);
+    req.setTemplate(mAckTemplate);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
 }
 
 MQProducer::MQProducer(const std::string& instanceId,
              const std::string& topicName,
              const std::string& endpoint,
-             const std::string& accessId,
-             const std::string& accessKey,
-             const std::string& stsToken,
-             MQConnectionToolPtr mqConnTool)
+             MQCredentialsHolderPtr credentials,
+             MQTransportPtr transport)
     : mInstanceId(instanceId)
     , mTopicName(topicName)
     , mEndPoint(endpoint)
-    , mAccessId(accessId)
-    , mAccessKey(accessKey)
-    , mStsToken(stsToken)
-    , mMQConnTool(mqConnTool)
+    , mCredentials(credentials)
+    , mActiveCredentials(credentials.get())
+    , mTransport(transport)
+    , mPublishTemplate(new MQRequestTemplate(endpoint, true))
 {
 }
 
+MQProducer::~MQProducer()
+{
+    if (mActiveCredentials.load() != mCredentials.get())
+    {
+        delete mActiveCredentials.load();
+    }
+}
+
 void MQProducer::updateAccessId(const std::string& accessId,
                            const std::string& accessKey)
 {
-    mAccessId = accessId;
-    mAccessKey = accessKey;
-    mStsToken = "";
+    SetOwnCredentials(mActiveCredentials, mCredentials.get(),
+        MQCredentialsPtr(new MQCredentials(accessId, accessKey)));
 }
 
 void MQProducer::updateAccessId(const std::string& accessId,
                            const std::string& accessKey,
                            const std::string& stsToken)
 {
-    mAccessId = accessId;
-    mAccessKey = accessKey;
-    mStsToken = stsToken;
+    SetOwnCredentials(mActiveCredentials, mCredentials.get(),
+        MQCredentialsPtr(new MQCredentials(accessId, accessKey, stsToken)));
 }
 
 void MQProducer::publishMessage(const std::string& messageBody,
                            PublishMessageResponse& resp)
 {
     PublishMessageRequest req(mInstanceId, mTopicName, messageBody, EMPTY);
-    MQClient::sendRequest(req, resp, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool);
+    req.setTemplate(mPublishTemplate);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
 }
 
 void MQProducer::publishMessage(const std::string& messageBody,
@@ -290,28 +512,28 @@ void MQProducer::publishMessage(const std::string& messageBody,
                            PublishMessageResponse& resp)
 {
     PublishMessageRequest req(mInstanceId, mTopicName, messageBody, messageTag);
-    MQClient::sendRequest(req, resp, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool);
+    req.setTemplate(mPublishTemplate);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
 }
 
 void MQProducer::publishMessage(TopicMessage& topicMessage, PublishMessageResponse& resp)
 {
     PublishMessageRequest req(mInstanceId, mTopicName, topicMessage.mMessageBody, topicMessage.mMessageTag);
+    req.setTemplate(mPublishTemplate);
     MQUtils::mapToString(topicMessage.mProperties, req.mProperties);
-    MQClient::sendRequest(req, resp, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
 }
 
 MQTransProducer::MQTransProducer(const std::string& instanceId,
              const std::string& topicName,
              const std::string& groupId,
              const std::string& endpoint,
-             const std::string& accessId,
-             const std::string& accessKey,
-             const std::string& stsToken,
-             MQConnectionToolPtr mqConnTool)
-    : MQProducer(instanceId, topicName, endpoint, accessId, accessKey, stsToken, mqConnTool) 
+             MQCredentialsHolderPtr credentials,
+             MQTransportPtr transport)
+    : MQProducer(instanceId, topicName, endpoint, credentials, transport)
     , mGroupId(groupId)
+    , mConsumeTemplate(new MQRequestTemplate(endpoint, false))
+    , mAckTemplate(new MQRequestTemplate(endpoint, true))
 {
 }
 
@@ -320,11 +542,11 @@ void MQTransProducer::consumeHalfMessage(const int32_t numOfMessages,
         std::vector<Message>& messages)
 {
     ConsumeMessageRequest req(mInstanceId, mTopicName, mGroupId, numOfMessages, EMPTY, waitSeconds);
+    req.setTemplate(mConsumeTemplate);
     req.setTransConsume();
 
     ConsumeMessageResponse resp(messages);
-    MQClient::sendRequest(req, resp, mEndPoint, mAccessId,
-            mAccessKey, mStsToken, mMQConnTool);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
 }
 
 void MQTransProducer::commit(const std::string& receiptHandle,
@@ -334,9 +556,9 @@ void MQTransProducer::commit(const std::string& receiptHandle,
     receiptHandles.push_back(receiptHandle);
 
     AckMessageRequest req(mInstanceId, mTopicName, mGroupId, receiptHandles);
+    req.setTemplate(mAckTemplate);
     req.setTransCommit();
-    MQClient::sendRequest(req, resp, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
 }
 
 void MQTransProducer::rollback(const std::string& receiptHandle,
@@ -346,8 +568,8 @@ void MQTransProducer::rollback(const std::string& receiptHandle,
     receiptHandles.push_back(receiptHandle);
 
     AckMessageRequest req(mInstanceId, mTopicName, mGroupId, receiptHandles);
+    req.setTemplate(mAckTemplate);
     req.setTransRollback();
-    MQClient::sendRequest(req, resp, mEndPoint, mAccessId,
-        mAccessKey, mStsToken, mMQConnTool);
+    MQClient::sendRequest(req, resp, mEndPoint, *getCredentials(), *mTransport);
 
 }
@@ -5,6 +5,8 @@
 
 #include "mq_protocol.h"
 #include "mq_network_tool.h"
+#include "mq_transport.h"
+#include "mq_credentials.h"
 #include <map>
 #include <stdint.h>
 #include <vector>
@@ -88,10 +90,43 @@ public:
               const int32_t timeout = 35,
               const int32_t connectTimeout = 35);
 
+    /* init the MQClient with connection settings
+     *
+     * @param endpoint:
+     *      http://{AccountId}.mq.cn-hangzhou.aliyuncs.com
+     * @param accessId:  accessId from aliyun.com
+     * @param accessKey: accessKey from aliyun.com
+     * @param config: pool size, timeouts, HTTP/2 etc, see MQConnectionConfig
+     */
+    MQClient(const std::string& endpoint,
+              const std::string& accessId,
+              const std::string& accessKey,
+              const MQConnectionConfig& config);
+
+    /* init the MQClient with sts token and connection settings
+     *
+     * @param endpoint:
+     *      http://{AccountId}.mq.cn-hangzhou.aliyuncs.com
+     * @param accessId:  the sts accessId
+     * @param accessKey: the sts accessKey
+     * @param stsToken:  the sts token
+     * @param config: pool size, timeouts, HTTP/2 etc, see MQConnectionConfig
+     */
+    MQClient(const std::string& endpoint,
+              const std::string& accessId,
+              const std::string& accessKey,
+              const std::string& stsToken,
+              const MQConnectionConfig& config);
+
     /* update the AccessId/AccessKey
     *
     * @param accessId: accessId from aliyun.com
     * @param accessKey: accessKey from aliyun.com
+    *
+    * the client and the producers/consumers got from it share their
+    * credentials, the update is seen by all of them except those given
+    * credentials of their own with their updateAccessId, and is safe while
+    * other threads send requests
     */
     void updateAccessId(const std::string& accessId,
                         const std::string& accessKey);
@@ -108,6 +143,62 @@ public:
 
     virtual ~MQClient() {}
 
+    /* open keep-alive connections to the endpoint and wait until they are ready
+     *
+     * @param timeoutMs: how long to wait for the warm up
+     * @return: true if all connections were opened within timeoutMs
+     *
+     * opens MQConnectionConfig::warmUpConnections connections, or
+     * min(connPoolSize, 16) if that is not set. If the client was built with
+     * warmUpConnections this only waits for the background warm up.
+     * With HTTP_ENGINE_NATIVE the connections are opened here, one after
+     * the other on the calling thread.
+     * Has no effect with enableHttp2, where the multi handle owns the connections.
+     */
+    bool warmUp(const int32_t timeoutMs);
+
+    /* counters of the connection pool and the decisions of
+     * MQConnectionConfig::autoSizePool, not used with enableHttp2;
+     * all zero with HTTP_ENGINE_NATIVE, which has no curl pool
+     */
+    MQConnectionPoolStats getPoolStats();
+
+    /* replace how requests are sent, libcurl by default
+     *
+     * only producers/consumers got after the call use the new transport,
+     * e.g. MQLoopbackTransport to measure the client without the network.
+     * On an MQAsyncClient the async requests go through it too.
+     */
+    void setTransport(MQTransportPtr transport)
+    {
+        mTransport = transport;
+    }
+
+    MQTransportPtr getTransport() const
+    {
+        return mTransport;
+    }
+
+    /* take the credentials from provider from now on, for rotating STS tokens
+     *
+     * fetches once on the calling thread and throws MQExceptionBase if that
+     * fails, then refreshes on a background thread ahead of expiry, see
+     * MQCredentialsRefreshConfig. The client and the producers/consumers got
+     * from it sign with the refreshed credentials, but for those given
+     * their own with their updateAccessId; sending never waits for a
+     * refresh. Replaces a provider set before, which is stopped even when
+     * the first fetch fails. MQClient::updateAccessId still works but is
+     * overwritten by the next refresh.
+     */
+    void setCredentialsProvider(MQCredentialsProviderPtr provider,
+                                const MQCredentialsRefreshConfig& config = MQCredentialsRefreshConfig());
+
+    /* the refresher of setCredentialsProvider, NULL if none was set */
+    MQCredentialsRefresherPtr getCredentialsRefresher() const
+    {
+        return mCredentialsRefresher;
+    }
+
     /* init MQConsumer instance for consume message
      *
      * @param topicName: the topic name
@@ -177,17 +268,23 @@ public:
     {
         return mEndPoint;
     }
-    const std::string& GetAccessId() const
+    std::string GetAccessId() const
     {
-        return mAccessId;
+        return mCredentials->get()->getAccessId();
     }
-    const std::string& GetAccessKey() const
+    std::string GetAccessKey() const
     {
-        return mAccessKey;
+        return mCredentials->get()->getAccessKey();
     }
-    const std::string& GetStsToken() const
+    std::string GetStsToken() const
     {
-        return mStsToken;
+        return mCredentials->get()->getStsToken();
+    }
+
+    /* the credentials requests are signed with now */
+    MQCredentialsPtr getCredentials() const
+    {
+        return mCredentials->get();
     }
 
 public:
@@ -199,18 +296,43 @@ public:
                             const std::string& stsToken,
                             MQConnectionToolPtr mqConnTool);
 
+    static void sendRequest(Request& req,
+                            Response& response,
+                            const std::string& endpoint,
+                            const std::string& accessId,
+                            const std::string& accessKey,
+                            const std::string& stsToken,
+                            MQTransportPtr transport);
+
     static void signRequest(Request& req,
                             const std::string& endpoint,
                             const std::string& accessId,
                             const std::string& accessKey,
                             const std::string& stsToken);
 
+    /* sign with a snapshot of MQCredentialsHolder and send through transport */
+    static void sendRequest(Request& req,
+                            Response& response,
+                            const std::string& endpoint,
+                            const MQCredentials& credentials,
+                            MQTransport& transport);
+
+    static void signRequest(Request& req,
+                            const std::string& endpoint,
+                            const MQCredentials& credentials);
+
+protected:
+    // the curl pool and transport, or the native transport
+    void initTransport(const MQConnectionConfig& config);
+
 protected:
     std::string mEndPoint;
-    std::string mAccessId;
-    std::string mAccessKey;
-    std::string mStsToken;
+    MQConnectionConfig mConfig;
+    MQCredentialsHolderPtr mCredentials;
+    MQCredentialsRefresherPtr mCredentialsRefresher;
+    // NULL with HTTP_ENGINE_NATIVE
     MQConnectionToolPtr mMQConnTool;
+    MQTransportPtr mTransport;
 };
 
 /*
@@ -223,12 +345,16 @@ protected:
 class MQConsumer
 {
 public:
-    virtual ~MQConsumer() {}
+    virtual ~MQConsumer();
 
     /* update the AccessId/AccessKey
     *
     * @param accessId: accessId from aliyun.com
     * @param accessKey: accessKey from aliyun.com
+    *
+    * for this consumer only, safe while other threads send requests. It then
+    * keeps credentials of its own and no longer follows
+    * MQClient::updateAccessId or the client's credentials provider
     */
     void updateAccessId(const std::string& accessId,
                         const std::string& accessKey);
@@ -243,6 +369,12 @@ public:
                         const std::string& accessKey,
                         const std::string& stsToken);
 
+    /* the credentials requests of this consumer are signed with now */
+    MQCredentialsPtr getCredentials() const
+    {
+        return mActiveCredentials.load()->get();
+    }
+
     const std::string& getInstanceId()
     {
         return mInstanceId;
@@ -316,6 +448,43 @@ public:
                              const int32_t waitSeconds,
                              std::vector<Message>& messages);
 
+    /* consume messages into a ConsumeBatch: the messages are read in place
+     *    from the response body, which the batch keeps, reading them does
+     *    not allocate. Same as the consumeMessage above otherwise.
+     *
+     * @param numOfMessages: the batch size
+     * @param waitSeconds: see consumeMessage
+     * @param batch: set to a new batch of the received messages, left as
+     *    it was when the consume throws
+     */
+    void consumeMessage(const int32_t numOfMessages,
+                             const int32_t waitSeconds,
+                             ConsumeBatchPtr& batch);
+
+    /* consumeMessageOrderly into a ConsumeBatch, see consumeMessage
+     */
+    void consumeMessageOrderly(const int32_t numOfMessages,
+                             const int32_t waitSeconds,
+                             ConsumeBatchPtr& batch);
+
+    /* consume messages into a MessageBatch, laid out by column for loops
+     *    over one field of every message. The batch is cleared first and
+     *    can be reused for the next consume. Same as consumeMessage otherwise.
+     *
+     * @param numOfMessages: the batch size
+     * @param waitSeconds: see consumeMessage
+     * @param batch: the received messages
+     */
+    void consumeMessage(const int32_t numOfMessages,
+                             const int32_t waitSeconds,
+                             MessageBatch& batch);
+
+    /* consumeMessageOrderly into a MessageBatch, see consumeMessage
+     */
+    void consumeMessageOrderly(const int32_t numOfMessages,
+                             const int32_t waitSeconds,
+                             MessageBatch& batch);
+
     /* ack messages: disable them to be reconsumed
      *    after consume the message, a ReceiptHandle is returned in Message
      *    this ReceiptHandle is valid in 5 minute.
@@ -326,6 +495,12 @@ public:
     void ackMessage(const std::vector<std::string>& receiptHandles,
                             AckMessageResponse& resp);
 
+    /* ack all messages of a batch, the request is written straight from
+     *    its receipt handle column
+     */
+    void ackMessage(const MessageBatch& batch,
+                            AckMessageResponse& resp);
+
     friend class MQClient;
 
 protected:
@@ -334,10 +509,8 @@ protected:
           const std::string& consumer,
           const std::string& messageTag,
           const std::string& endpoint,
-          const std::string& accessId,
-          const std::string& accessKey,
-          const std::string& stsToken,
-          MQConnectionToolPtr mqConnTool);
+          MQCredentialsHolderPtr credentials,
+          MQTransportPtr transport);
 
 protected:
     std::string mInstanceId;
@@ -345,10 +518,13 @@ protected:
     std::string mConsumer;
     std::string mMessageTag;
     std::string mEndPoint;
-    std::string mAccessId;
-    std::string mAccessKey;
-    std::string mStsToken;
-    MQConnectionToolPtr mMQConnTool;
+    // the client's, shared with the producers/consumers got from it
+    MQCredentialsHolderPtr mCredentials;
+    // mCredentials, or a holder of its own after its updateAccessId
+    std::atomic<MQCredentialsHolder*> mActiveCredentials;
+    MQTransportPtr mTransport;
+    MQRequestTemplatePtr mConsumeTemplate;
+    MQRequestTemplatePtr mAckTemplate;
 };
 
 /*
@@ -361,12 +537,16 @@ protected:
 class MQProducer
 {
 public:
-    virtual ~MQProducer() {}
+    virtual ~MQProducer();
 
     /* update the AccessId/AccessKey
     *
     * @param accessId: accessId from aliyun.com
     * @param accessKey: accessKey from aliyun.com
+    *
+    * for this producer only, safe while other threads send requests. It then
+    * keeps credentials of its own and no longer follows
+    * MQClient::updateAccessId or the client's credentials provider
     */
     void updateAccessId(const std::string& accessId,
                         const std::string& accessKey);
@@ -381,6 +561,12 @@ public:
                         const std::string& accessKey,
                         const std::string& stsToken);
 
+    /* the credentials requests of this producer are signed with now */
+    MQCredentialsPtr getCredentials() const
+    {
+        return mActiveCredentials.load()->get();
+    }
+
     const std::string& getTopicName()
     {
         return mTopicName;
@@ -423,19 +609,19 @@ protected:
     MQProducer(const std::string& instanceId,
             const std::string& topicName,
           const std::string& endpoint,
-          const std::string& accessId,
-          const std::string& accessKey,
-          const std::string& stsToken,
-          MQConnectionToolPtr mqConnTool);
+          MQCredentialsHolderPtr credentials,
+          MQTransportPtr transport);
 
 protected:
     std::string mInstanceId;
     std::string mTopicName;
     std::string mEndPoint;
-    std::string mAccessId;
-    std::string mAccessKey;
-    std::string mStsToken;
-    MQConnectionToolPtr mMQConnTool;
+    // the client's, shared with the producers/consumers got from it
+    MQCredentialsHolderPtr mCredentials;
+    // mCredentials, or a holder of its own after its updateAccessId
+    std::atomic<MQCredentialsHolder*> mActiveCredentials;
+    MQTransportPtr mTransport;
+    MQRequestTemplatePtr mPublishTemplate;
 };
 
 /*
@@ -491,12 +677,12 @@ class MQTransProducer : public MQProducer
                 const std::string& topicName,
                 const std::string& groupId,
                 const std::string& endpoint,
-                const std::string& accessId,
-                const std::string& accessKey,
-                const std::string& stsToken,
-                MQConnectionToolPtr mqConnTool);
+                MQCredentialsHolderPtr credentials,
+                MQTransportPtr transport);
     protected:
         std::string mGroupId;
+        MQRequestTemplatePtr mConsumeTemplate;
+        MQRequestTemplatePtr mAckTemplate;
 };
 
 }
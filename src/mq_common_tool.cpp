@@ -3,8 +3,18 @@
 
 #include <string>
 #include <map>
+#include <iterator>
+#include <atomic>
+#include <string.h>
 #ifdef _WIN32
 #include <time.h>
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MQ_BASE64_X86 1
 #endif
 
 using namespace std;
@@ -66,8 +76,362 @@ bool StringTool::StartWith(const std::string& input, const std::string& pattern)
 }
 
 
+static const char kBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+struct Base64DecodeTable
+{
+    Base64DecodeTable()
+    {
+        for (int i = 0; i < 256; ++i)
+            values[i] = -1;
+        for (int i = 0; i < 64; ++i)
+            values[(unsigned char)kBase64Alphabet[i]] = (signed char)i;
+    }
+    signed char values[256];
+};
+static const Base64DecodeTable kBase64Decode;
+
+static size_t EncodeScalar(const unsigned char* in, size_t length, char* out)
+{
+    char* begin = out;
+    for (; length >= 3; length -= 3, in += 3)
+    {
+        uint32_t v = (uint32_t(in[0]) << 16) | (uint32_t(in[1]) << 8) | in[2];
+        *out++ = kBase64Alphabet[v >> 18];
+        *out++ = kBase64Alphabet[(v >> 12) & 0x3F];
+        *out++ = kBase64Alphabet[(v >> 6) & 0x3F];
+        *out++ = kBase64Alphabet[v & 0x3F];
+    }
+    if (length > 0)
+    {
+        uint32_t v = uint32_t(in[0]) << 16;
+        if (length == 2)
+            v |= uint32_t(in[1]) << 8;
+        *out++ = kBase64Alphabet[v >> 18];
+        *out++ = kBase64Alphabet[(v >> 12) & 0x3F];
+        *out++ = length == 2 ? kBase64Alphabet[(v >> 6) & 0x3F] : '=';
+        *out++ = '=';
+    }
+    return out - begin;
+}
+
+// same checks and messages as the istream Base64Decoding
+static size_t DecodeScalar(const char* in, size_t length, char* out)
+{
+    char* begin = out;
+    size_t pos = 0;
+    while (pos < length)
+    {
+        int byte[4] = {0, 0, 0, 0};
+        int index = 0;
+        for (; index < 4; ++index)
+        {
+            if (pos >= length)
+            {
+                MQ_THROW(MQExceptionBase, "Bad Base64 Message Body");
+            }
+            char c = in[pos++];
+            if (c == '=')
+            {
+                break;
+            }
+            byte[index] = kBase64Decode.values[(unsigned char)c];
+            if (byte[index] < 0)
+            {
+                MQ_THROW(MQExceptionBase, "Bad Base64 Message Body, String should only contain::ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=");
+            }
+        }
+
+        uint32_t v = (uint32_t(byte[0]) << 18) | (uint32_t(byte[1]) << 12) | (uint32_t(byte[2]) << 6) | byte[3];
+        if (index == 4)
+        {
+            *out++ = (char)(v >> 16);
+            *out++ = (char)(v >> 8);
+            *out++ = (char)v;
+        }
+        else if (index < 2)
+        {
+            MQ_THROW(MQExceptionBase, "Bad Base64 Message Body, String should be the third or fourth place in the last four characters");
+        }
+        else if (index == 2)
+        {
+            if (pos >= length || in[pos] != '=')
+            {
+                MQ_THROW(MQExceptionBase, "Bad Base64 Message Body, String should not append any character after = except =");
+            }
+            if (++pos < length)
+            {
+                MQ_THROW(MQExceptionBase, "Bad Base64 Message Body, String should not append any character after ==");
+            }
+            *out++ = (char)(v >> 16);
+        }
+        else
+        {
+            if (pos < length)
+            {
+                MQ_THROW(MQExceptionBase, "Bad Base64 Message Body, String should not append any character after the first =");
+            }
+            *out++ = (char)(v >> 16);
+            *out++ = (char)(v >> 8);
+        }
+    }
+    return out - begin;
+}
+
+#ifdef MQ_BASE64_X86
+
+/*
+ * the vector kernels follow Mula and Lemire, "Faster Base64 Encoding and
+ * Decoding Using AVX2 Instructions". They only take whole blocks that can
+ * not hold padding, the scalar code does the tail and reports bad input.
+ */
+
+__attribute__((target("ssse3")))
+static inline __m128i EncodeIndices(__m128i in)
+{
+    // 12 bytes into four 6 bit indices per 32 bit lane
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i EncodeAscii(const __m128i indices)
+{
+    __m128i reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    reduced = _mm_or_si128(reduced, _mm_and_si128(less, _mm_set1_epi8(13)));
+    const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(_mm_shuffle_epi8(shift, reduced), indices);
+}
+
+// values of 16 characters, false if one is not in the alphabet
+__attribute__((target("ssse3")))
+static inline bool DecodeValues(const __m128i in, __m128i& values)
+{
+    const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)),
+        _mm_cmplt_epi8(in, _mm_set1_epi8('Z' + 1)));
+    const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)),
+        _mm_cmplt_epi8(in, _mm_set1_epi8('z' + 1)));
+    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)),
+        _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+    const __m128i plus = _mm_cmpeq_epi8(in, _mm_set1_epi8('+'));
+    const __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, plus), slash));
+    if (_mm_movemask_epi8(valid) != 0xFFFF)
+    {
+        return false;
+    }
+    __m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-65));
+    shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(-71)));
+    shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(4)));
+    shift = _mm_or_si128(shift, _mm_and_si128(plus, _mm_set1_epi8(19)));
+    shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(16)));
+    values = _mm_add_epi8(in, shift);
+    return true;
+}
+
+// 16 values into 12 bytes at the bottom
+__attribute__((target("ssse3")))
+static inline __m128i DecodePack(const __m128i values)
+{
+    const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+static size_t EncodeSsse3(const unsigned char* in, size_t length, char* out)
+{
+    char* begin = out;
+    // 16 bytes are loaded for 12
+    for (; length >= 16; length -= 12, in += 12, out += 16)
+    {
+        const __m128i indices = EncodeIndices(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), EncodeAscii(indices));
+    }
+    return (out - begin) + EncodeScalar(in, length, out);
+}
+
+__attribute__((target("ssse3")))
+static size_t DecodeSsse3(const char* in, size_t length, char* out)
+{
+    char* begin = out;
+    // 16 bytes are stored for 12, the last group stays for the scalar code
+    for (; length >= 24; length -= 16, in += 16, out += 12)
+    {
+        __m128i values;
+        if (!DecodeValues(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), values))
+        {
+            break;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), DecodePack(values));
+    }
+    return (out - begin) + DecodeScalar(in, length, out);
+}
+
+__attribute__((target("avx2")))
+static size_t EncodeAvx2(const unsigned char* in, size_t length, char* out)
+{
+    char* begin = out;
+    // two lanes of 12 bytes, the second loaded 12 bytes further
+    for (; length >= 28; length -= 24, in += 24, out += 32)
+    {
+        const __m128i low = EncodeIndices(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+        const __m128i high = EncodeIndices(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 12)));
+        const __m256i indices = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+
+        __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        reduced = _mm256_or_si256(reduced, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        const __m256i ascii = _mm256_add_epi8(_mm256_shuffle_epi8(shift, reduced), indices);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), ascii);
+    }
+    return (out - begin) + EncodeSsse3(in, length, out);
+}
+
+__attribute__((target("avx2")))
+static size_t DecodeAvx2(const char* in, size_t length, char* out)
+{
+    char* begin = out;
+    // 32 bytes are stored for 24, the last group stays for the scalar code
+    for (; length >= 48; length -= 32, in += 32, out += 24)
+    {
+        const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+        const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('A' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), chars));
+        const __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('a' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), chars));
+        const __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+        const __m256i plus = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('+'));
+        const __m256i slash = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('/'));
+        const __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+            _mm256_or_si256(_mm256_or_si256(digit, plus), slash));
+        if (_mm256_movemask_epi8(valid) != -1)
+        {
+            break;
+        }
+        __m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-65));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(-71)));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(4)));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(plus, _mm256_set1_epi8(19)));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(slash, _mm256_set1_epi8(16)));
+        const __m256i values = _mm256_add_epi8(chars, shift);
+        const __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        const __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        const __m256i packed = _mm256_shuffle_epi8(words, _mm256_setr_epi8(
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        const __m256i bytes = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), bytes);
+    }
+    return (out - begin) + DecodeSsse3(in, length, out);
+}
+
+#endif
+
+typedef size_t (*Base64EncodeKernel)(const unsigned char*, size_t, char*);
+typedef size_t (*Base64DecodeKernel)(const char*, size_t, char*);
+
+struct Base64Kernels
+{
+    Base64Kernels()
+        : encode(EncodeScalar)
+        , decode(DecodeScalar)
+    {
+        names.push_back("scalar");
+#ifdef MQ_BASE64_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("ssse3"))
+        {
+            names.push_back("ssse3");
+            Select("ssse3");
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            names.push_back("avx2");
+            Select("avx2");
+        }
+#endif
+    }
+
+    bool Select(const std::string& name)
+    {
+        if (name == "scalar")
+        {
+            encode = EncodeScalar;
+            decode = DecodeScalar;
+            return true;
+        }
+#ifdef MQ_BASE64_X86
+        if (name == "ssse3" && __builtin_cpu_supports("ssse3"))
+        {
+            encode = EncodeSsse3;
+            decode = DecodeSsse3;
+            return true;
+        }
+        if (name == "avx2" && __builtin_cpu_supports("avx2"))
+        {
+            encode = EncodeAvx2;
+            decode = DecodeAvx2;
+            return true;
+        }
+#endif
+        return false;
+    }
+
+    Base64EncodeKernel encode;
+    Base64DecodeKernel decode;
+    // the kernels this cpu runs, the fastest is selected
+    std::vector<std::string> names;
+};
+
+static Base64Kernels& GetBase64Kernels()
+{
+    static Base64Kernels kernels;
+    return kernels;
+}
+
+size_t Base64Tool::Base64Encoding(const char* input, size_t length, char* output)
+{
+    return GetBase64Kernels().encode(reinterpret_cast<const unsigned char*>(input), length, output);
+}
+
+size_t Base64Tool::Base64Decoding(const char* input, size_t length, char* output)
+{
+    return GetBase64Kernels().decode(input, length, output);
+}
+
+std::vector<std::string> Base64Tool::ListBase64Kernels()
+{
+    return GetBase64Kernels().names;
+}
+
+bool Base64Tool::SelectBase64Kernel(const std::string& name)
+{
+    return GetBase64Kernels().Select(name);
+}
+
 void Base64Tool::Base64Encoding(std::istream& is, std::ostream& os, char makeupChar, const char *alphabet)
 {
+    if (makeupChar == '=' && strcmp(alphabet, kBase64Alphabet) == 0)
+    {
+        string input((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+        string output(EncodedLength(input.size()), '\0');
+        size_t size = Base64Encoding(input.data(), input.size(), &output[0]);
+        os.write(output.data(), size);
+        return;
+    }
+
     int out[4];
     int remain = 0;
     while (!is.eof())
@@ -126,6 +490,15 @@ void Base64Tool::Base64Encoding(std::istream& is, std::ostream& os, char makeupC
 //Base64Decoding
 void Base64Tool::Base64Decoding(std::istream& is, std::ostream& os, char plus, char slash)
 {
+    if (plus == '+' && slash == '/')
+    {
+        string input((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+        string output(MaxDecodedLength(input.size()), '\0');
+        size_t size = Base64Decoding(input.data(), input.size(), &output[0]);
+        os.write(output.data(), size);
+        return;
+    }
+
     int out[3];
     int byte[4];
     int bTmp;
@@ -231,29 +604,128 @@ void Base64Tool::Base64Decoding(std::istream& is, std::ostream& os, char plus, c
     }
 }
 
-string TimeTool::GetDateTime()
+static time_t CoarseNow()
 {
-    time_t now = time(NULL);
-    char timeBuffer[80];
-#ifdef _WIN32
-	struct tm* utc_tm_ptr = gmtime(&now);
-	if (utc_tm_ptr == NULL)
-	{
-		MQ_THROW(MQExceptionBase, "Cannot get current tiem!");
+#if defined(__linux__) && defined(CLOCK_REALTIME_COARSE)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0)
+    {
+        return ts.tv_sec;
+    }
+#endif
+    return time(NULL);
+}
+
+static void AppendNumber(char*& out, int value, int digits)
+{
+    for (int i = digits - 1; i >= 0; --i)
+    {
+        out[i] = (char)('0' + value % 10);
+        value /= 10;
+    }
+    out += digits;
 }
+
+// strftime "%a, %d %b %Y %H:%M:%S GMT" without the locale
+static void FormatDateTime(const time_t now, char* buffer)
+{
+    static const char kDays[] = "SunMonTueWedThuFriSat";
+    static const char kMonths[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+#ifdef _WIN32
+    struct tm utc_tm;
+    if (gmtime_s(&utc_tm, &now) != 0)
+    {
+        MQ_THROW(MQExceptionBase, "Cannot get current tiem!");
+    }
 #else
-	struct tm utc_tm;
-    struct tm* r= gmtime_r(&now, &utc_tm);
-	if (r == NULL)
-	{
-		MQ_THROW(MQExceptionBase, "Cannot get current tiem!");
-	}
+    struct tm utc_tm;
+    if (gmtime_r(&now, &utc_tm) == NULL)
+    {
+        MQ_THROW(MQExceptionBase, "Cannot get current tiem!");
+    }
 #endif
-    
+    char* out = buffer;
+    memcpy(out, kDays + utc_tm.tm_wday * 3, 3);
+    memcpy(out + 3, ", ", 2);
+    out += 5;
+    AppendNumber(out, utc_tm.tm_mday, 2);
+    *out++ = ' ';
+    memcpy(out, kMonths + utc_tm.tm_mon * 3, 3);
+    out += 3;
+    *out++ = ' ';
+    AppendNumber(out, utc_tm.tm_year + 1900, 4);
+    *out++ = ' ';
+    AppendNumber(out, utc_tm.tm_hour, 2);
+    *out++ = ':';
+    AppendNumber(out, utc_tm.tm_min, 2);
+    *out++ = ':';
+    AppendNumber(out, utc_tm.tm_sec, 2);
+    memcpy(out, " GMT", 4);
+}
+
+/*
+ * the formatted date of the current second. The writer formats into the
+ * buffer readers are not using and then publishes (second << 1 | buffer);
+ * a reader copies and checks that the stamp did not move meanwhile.
+ */
+struct DateTimeCache
+{
+    DateTimeCache()
+        : stamp(0)
+    {
+        updating.clear();
+    }
+
+    std::atomic<uint64_t> stamp;
+    std::atomic_flag updating;
+    char text[2][TimeTool::kDateTimeLength];
+};
+static DateTimeCache sDateTimeCache;
+
+void TimeTool::GetDateTime(char* buffer)
+{
+    const time_t now = CoarseNow();
+    DateTimeCache& cache = sDateTimeCache;
+    uint64_t stamp = cache.stamp.load(std::memory_order_acquire);
+    if ((stamp >> 1) == (uint64_t)now)
+    {
+        memcpy(buffer, cache.text[stamp & 1], kDateTimeLength);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (cache.stamp.load(std::memory_order_relaxed) == stamp)
+        {
+            return;
+        }
+    }
+
+    FormatDateTime(now, buffer);
+    // one thread refreshes the cache, the others keep what they formatted
+    if (!cache.updating.test_and_set(std::memory_order_acquire))
+    {
+        stamp = cache.stamp.load(std::memory_order_relaxed);
+        if ((stamp >> 1) < (uint64_t)now)
+        {
+            uint64_t next = (stamp & 1) ^ 1;
+            memcpy(cache.text[next], buffer, kDateTimeLength);
+            cache.stamp.store(((uint64_t)now << 1) | next, std::memory_order_release);
+        }
+        cache.updating.clear(std::memory_order_release);
+    }
+}
+
+string TimeTool::GetDateTime()
+{
+    char timeBuffer[kDateTimeLength];
+    GetDateTime(timeBuffer);
+    return string(timeBuffer, kDateTimeLength);
+}
+
+int64_t TimeTool::GetMonotonicMs()
+{
 #ifdef _WIN32
-	strftime(timeBuffer, sizeof(timeBuffer), "%a, %d %b %Y %H:%M:%S GMT", utc_tm_ptr);
+    return (int64_t)GetTickCount64();
 #else
-    strftime(timeBuffer, sizeof(timeBuffer), "%a, %d %b %Y %H:%M:%S GMT", &utc_tm);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 #endif
-    return timeBuffer;
 }
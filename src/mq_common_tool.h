@@ -8,6 +8,7 @@
 #include <sstream>
 #include <map>
 #include <vector>
+#include <stdint.h>
 
 namespace mq
 {
@@ -38,12 +39,51 @@ class Base64Tool
 public:
     static void Base64Encoding(std::istream&, std::ostream&, char makeupChar = '=', const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
     static void Base64Decoding(std::istream&, std::ostream&, char plus = '+', char slash = '/');
+
+    /* standard alphabet with '=' padding on raw buffers, AVX2/SSSE3 when the cpu has them
+     *
+     * @param output: at least EncodedLength(length) bytes
+     * @return: the bytes written to output
+     */
+    static size_t Base64Encoding(const char* input, size_t length, char* output);
+    /* @param output: at least MaxDecodedLength(length) bytes
+     * @return: the bytes written to output
+     *
+     * throws MQExceptionBase on bad input, as the istream version
+     */
+    static size_t Base64Decoding(const char* input, size_t length, char* output);
+
+    static size_t EncodedLength(size_t length)
+    {
+        return (length + 2) / 3 * 4;
+    }
+    static size_t MaxDecodedLength(size_t length)
+    {
+        return length / 4 * 3;
+    }
+
+    /* the kernels of the buffer versions this cpu runs, "scalar" first */
+    static std::vector<std::string> ListBase64Kernels();
+    /* run the buffer versions on one of ListBase64Kernels, e.g. to check the
+     * vector kernels against the scalar one; not while other threads use them
+     *
+     * @return: false if the cpu does not run the kernel
+     */
+    static bool SelectBase64Kernel(const std::string& name);
 };
 
 class TimeTool
 {
 public:
+    /* "Sun, 06 Nov 1994 08:49:37 GMT" */
+    static const size_t kDateTimeLength = 29;
+
     static std::string GetDateTime();
+    /* writes the kDateTimeLength chars of GetDateTime into buffer, no NUL.
+     * Formatted at most once a second and read without a lock */
+    static void GetDateTime(char* buffer);
+    /* milliseconds from a monotonic clock, for timeouts and idle times */
+    static int64_t GetMonotonicMs();
 };
 
 }
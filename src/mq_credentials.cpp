@@ -0,0 +1,334 @@
+#include "mq_credentials.h"
+
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+using namespace std;
+using namespace mq::http::sdk;
+
+MQCredentialsHolder::MQCredentialsHolder(const MQCredentialsPtr& credentials)
+    : mCurrent(new MQCredentialsPtr(credentials))
+    , mEpoch(0)
+{
+    mReaders[0].store(0);
+    mReaders[1].store(0);
+}
+
+MQCredentialsHolder::~MQCredentialsHolder()
+{
+    delete mCurrent.load();
+}
+
+MQCredentialsPtr MQCredentialsHolder::get() const
+{
+    while (true)
+    {
+        uint32_t epoch = mEpoch.load();
+        std::atomic<int32_t>& readers = mReaders[epoch & 1];
+        readers.fetch_add(1);
+        // a set() that flipped the epoch before seeing us does not wait for us
+        if (mEpoch.load() != epoch)
+        {
+            readers.fetch_sub(1);
+            continue;
+        }
+        MQCredentialsPtr credentials = *mCurrent.load();
+        readers.fetch_sub(1);
+        return credentials;
+    }
+}
+
+void MQCredentialsHolder::set(const MQCredentialsPtr& credentials)
+{
+    PTScopedLock lock(mWriteMutex);
+    MQCredentialsPtr* previous = mCurrent.exchange(new MQCredentialsPtr(credentials));
+    uint32_t epoch = mEpoch.fetch_add(1);
+    // readers entered before the flip may still be copying out of previous
+    while (mReaders[epoch & 1].load() != 0)
+    {
+        std::this_thread::yield();
+    }
+    delete previous;
+}
+
+static int64_t NowEpochMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+MQEnvironmentCredentialsProvider::MQEnvironmentCredentialsProvider(const std::string& accessIdVariable,
+                                                                   const std::string& accessKeyVariable,
+                                                                   const std::string& stsTokenVariable)
+    : mAccessIdVariable(accessIdVariable)
+    , mAccessKeyVariable(accessKeyVariable)
+    , mStsTokenVariable(stsTokenVariable)
+{
+}
+
+MQCredentialsPtr MQEnvironmentCredentialsProvider::fetch(int64_t& expireTimeMs)
+{
+    const char* accessId = getenv(mAccessIdVariable.c_str());
+    const char* accessKey = getenv(mAccessKeyVariable.c_str());
+    const char* stsToken = getenv(mStsTokenVariable.c_str());
+    if (accessId == NULL || accessKey == NULL || *accessId == '\0' || *accessKey == '\0')
+    {
+        MQ_THROW(MQExceptionBase, "No credentials in the environment, " + mAccessIdVariable
+            + " and " + mAccessKeyVariable + " should be set");
+    }
+    expireTimeMs = 0;
+    return MQCredentialsPtr(new MQCredentials(accessId, accessKey, stsToken != NULL ? stsToken : ""));
+}
+
+// the string value of "name" in a flat JSON object
+static bool FindJsonString(const std::string& document, const std::string& name, std::string& value)
+{
+    const std::string quoted = "\"" + name + "\"";
+    size_t pos = document.find(quoted);
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    pos = document.find_first_not_of(" \t\r\n", pos + quoted.size());
+    if (pos == std::string::npos || document[pos] != ':')
+    {
+        return false;
+    }
+    pos = document.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string::npos || document[pos] != '"')
+    {
+        return false;
+    }
+    value.clear();
+    for (++pos; pos < document.size(); ++pos)
+    {
+        char c = document[pos];
+        if (c == '"')
+        {
+            return true;
+        }
+        if (c == '\\' && pos + 1 < document.size())
+        {
+            c = document[++pos];
+            if (c == 'n')
+                c = '\n';
+            else if (c == 't')
+                c = '\t';
+        }
+        value.push_back(c);
+    }
+    return false;
+}
+
+// "2019-01-01T00:00:00Z" into epoch milliseconds
+static int64_t ParseExpiration(const std::string& expiration)
+{
+    struct tm utc_tm;
+    memset(&utc_tm, 0, sizeof(utc_tm));
+    if (sscanf(expiration.c_str(), "%d-%d-%dT%d:%d:%d", &utc_tm.tm_year, &utc_tm.tm_mon,
+        &utc_tm.tm_mday, &utc_tm.tm_hour, &utc_tm.tm_min, &utc_tm.tm_sec) != 6)
+    {
+        MQ_THROW(MQExceptionBase, "Bad credentials Expiration: " + expiration);
+    }
+    utc_tm.tm_year -= 1900;
+    utc_tm.tm_mon -= 1;
+#ifdef _WIN32
+    time_t seconds = _mkgmtime(&utc_tm);
+#else
+    time_t seconds = timegm(&utc_tm);
+#endif
+    return (int64_t)seconds * 1000;
+}
+
+MQFileCredentialsProvider::MQFileCredentialsProvider(const std::string& path)
+    : mPath(path)
+{
+}
+
+MQCredentialsPtr MQFileCredentialsProvider::parse(const std::string& document, int64_t& expireTimeMs)
+{
+    std::string accessId, accessKey, stsToken, expiration;
+    if (!FindJsonString(document, "AccessKeyId", accessId) || accessId.empty()
+        || !FindJsonString(document, "AccessKeySecret", accessKey) || accessKey.empty())
+    {
+        MQ_THROW(MQExceptionBase, "No AccessKeyId and AccessKeySecret in the credentials document");
+    }
+    FindJsonString(document, "SecurityToken", stsToken);
+    expireTimeMs = FindJsonString(document, "Expiration", expiration) ? ParseExpiration(expiration) : 0;
+    return MQCredentialsPtr(new MQCredentials(accessId, accessKey, stsToken));
+}
+
+MQCredentialsPtr MQFileCredentialsProvider::fetch(int64_t& expireTimeMs)
+{
+    std::ifstream file(mPath.c_str(), std::ios::in | std::ios::binary);
+    if (!file)
+    {
+        MQ_THROW(MQExceptionBase, "Cannot open the credentials file " + mPath);
+    }
+    std::ostringstream os;
+    os << file.rdbuf();
+    return parse(os.str(), expireTimeMs);
+}
+
+MQCommandCredentialsProvider::MQCommandCredentialsProvider(const std::string& command)
+    : mCommand(command)
+{
+}
+
+MQCredentialsPtr MQCommandCredentialsProvider::fetch(int64_t& expireTimeMs)
+{
+#ifdef _WIN32
+    FILE* pipe = _popen(mCommand.c_str(), "r");
+#else
+    FILE* pipe = popen(mCommand.c_str(), "r");
+#endif
+    if (pipe == NULL)
+    {
+        MQ_THROW(MQExceptionBase, "Cannot run the credentials command " + mCommand);
+    }
+    std::string output;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+    {
+        output.append(buffer, n);
+    }
+#ifdef _WIN32
+    int status = _pclose(pipe);
+#else
+    int status = pclose(pipe);
+#endif
+    if (status != 0)
+    {
+        MQ_THROW(MQExceptionBase, "The credentials command " + mCommand + " failed, status:"
+            + StringTool::ToString(status));
+    }
+    return MQFileCredentialsProvider::parse(output, expireTimeMs);
+}
+
+class MQCredentialsRefresher::RefreshThread : public PTThread
+{
+public:
+    RefreshThread(MQCredentialsRefresher& refresher, const int64_t nextRefreshMs)
+        : mRefresher(refresher)
+        , mNextRefreshMs(nextRefreshMs)
+        , mStopping(false)
+    {
+    }
+
+    void stop()
+    {
+        {
+            PTScopedLock lock(mWaitObject);
+            mStopping = true;
+            mWaitObject.signal();
+        }
+        join();
+    }
+
+protected:
+    void run()
+    {
+        while (true)
+        {
+            {
+                PTScopedLock lock(mWaitObject);
+                while (!mStopping)
+                {
+                    int64_t waitMs = mNextRefreshMs - NowEpochMs();
+                    if (waitMs <= 0)
+                    {
+                        break;
+                    }
+                    mWaitObject.wait(waitMs * 1000);
+                }
+                if (mStopping)
+                {
+                    return;
+                }
+            }
+            mNextRefreshMs = mRefresher.refresh();
+        }
+    }
+
+private:
+    MQCredentialsRefresher& mRefresher;
+    int64_t mNextRefreshMs;
+    WaitObject mWaitObject;
+    bool mStopping;
+};
+
+MQCredentialsRefresher::MQCredentialsRefresher(MQCredentialsProviderPtr provider,
+                                               MQCredentialsHolderPtr holder,
+                                               const MQCredentialsRefreshConfig& config)
+    : mProvider(provider)
+    , mHolder(holder)
+    , mConfig(config)
+    , mExpireTimeMs(0)
+    , mFailureCount(0)
+    , mThread(NULL)
+{
+    int64_t expireTimeMs = 0;
+    MQCredentialsPtr credentials = mProvider->fetch(expireTimeMs);
+    mHolder->set(credentials);
+    mExpireTimeMs.store(expireTimeMs);
+
+    mThread = new RefreshThread(*this, nextRefresh(expireTimeMs));
+    mThread->start();
+}
+
+MQCredentialsRefresher::~MQCredentialsRefresher()
+{
+    if (mThread != NULL)
+    {
+        mThread->stop();
+        delete mThread;
+    }
+}
+
+int64_t MQCredentialsRefresher::nextRefresh(const int64_t expireTimeMs) const
+{
+    int64_t now = NowEpochMs();
+    if (expireTimeMs <= 0)
+    {
+        return now + mConfig.refreshIntervalMs;
+    }
+    int64_t next = expireTimeMs - mConfig.refreshAheadMs;
+    // credentials that expire sooner than refreshAheadMs are refreshed at half their life
+    if (next <= now)
+    {
+        next = now + (expireTimeMs > now ? (expireTimeMs - now) / 2 : 0);
+    }
+    int64_t earliest = now + 1000;
+    return next < earliest ? earliest : next;
+}
+
+int64_t MQCredentialsRefresher::refresh()
+{
+    try
+    {
+        int64_t expireTimeMs = 0;
+        MQCredentialsPtr credentials = mProvider->fetch(expireTimeMs);
+        mHolder->set(credentials);
+        mExpireTimeMs.store(expireTimeMs);
+        mFailureCount.store(0);
+        return nextRefresh(expireTimeMs);
+    }
+    catch (...)
+    {
+        // keep signing with what was published, it may still be valid
+        mFailureCount.fetch_add(1);
+    }
+    int64_t next = NowEpochMs() + mConfig.retryIntervalMs;
+    int64_t expireTimeMs = mExpireTimeMs.load();
+    if (expireTimeMs > 0 && next > expireTimeMs && expireTimeMs > NowEpochMs() + 1000)
+    {
+        next = expireTimeMs - 1000;
+    }
+    return next;
+}
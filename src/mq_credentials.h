@@ -0,0 +1,257 @@
+// Copyright (C) 2019, Alibaba Cloud Computing
+
+#ifndef MQ_SDK_CREDENTIALS_H
+#define MQ_SDK_CREDENTIALS_H
+
+#include "mq_utils.h"
+
+#include <string>
+#include <atomic>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <memory>
+#else
+#ifdef __APPLE__
+#include <memory>
+#else
+#include <tr1/memory>
+#endif
+#endif
+
+namespace mq
+{
+namespace http
+{
+namespace sdk
+{
+
+/*
+ * the AccessId/AccessKey/StsToken a request is signed with, never changed
+ * after construction so that a snapshot can be read without a lock
+ */
+class MQCredentials
+{
+public:
+    MQCredentials(const std::string& accessId,
+                  const std::string& accessKey,
+                  const std::string& stsToken = "")
+        : mAccessId(accessId)
+        , mAccessKey(accessKey)
+        , mStsToken(stsToken)
+    {
+    }
+
+    const std::string& getAccessId() const
+    {
+        return mAccessId;
+    }
+    const std::string& getAccessKey() const
+    {
+        return mAccessKey;
+    }
+    const std::string& getStsToken() const
+    {
+        return mStsToken;
+    }
+
+private:
+    const std::string mAccessId;
+    const std::string mAccessKey;
+    const std::string mStsToken;
+};
+#ifdef __APPLE__
+typedef std::shared_ptr<const MQCredentials> MQCredentialsPtr;
+#else
+typedef std::tr1::shared_ptr<const MQCredentials> MQCredentialsPtr;
+#endif
+
+/*
+ * the current credentials of a client and of the producers/consumers got
+ * from it. get() takes a snapshot without a lock, set() swaps in new
+ * credentials with one pointer exchange; requests already signing keep the
+ * snapshot they took.
+ *
+ * The slot holding the current MQCredentialsPtr is freed by set() once no
+ * reader of the previous epoch is copying out of it, readers only stay in
+ * an epoch for the copy of one shared_ptr.
+ */
+class MQCredentialsHolder
+{
+public:
+    MQCredentialsHolder(const MQCredentialsPtr& credentials);
+    ~MQCredentialsHolder();
+
+    MQCredentialsPtr get() const;
+
+    void set(const MQCredentialsPtr& credentials);
+
+private:
+    std::atomic<MQCredentialsPtr*> mCurrent;
+    std::atomic<uint32_t> mEpoch;
+    // readers copying out of mCurrent, by the parity of the epoch they entered in
+    mutable std::atomic<int32_t> mReaders[2];
+    // set() calls are rare, they wait for each other
+    PTMutex mWriteMutex;
+
+    MQCredentialsHolder(const MQCredentialsHolder&);
+    MQCredentialsHolder& operator=(const MQCredentialsHolder&);
+};
+#ifdef __APPLE__
+typedef std::shared_ptr<MQCredentialsHolder> MQCredentialsHolderPtr;
+#else
+typedef std::tr1::shared_ptr<MQCredentialsHolder> MQCredentialsHolderPtr;
+#endif
+
+/*
+ * where MQClient::setCredentialsProvider gets the credentials from. fetch()
+ * runs on the refresh thread, never on a thread sending requests.
+ */
+class MQCredentialsProvider
+{
+public:
+    virtual ~MQCredentialsProvider() {}
+
+    /* get the current credentials
+     *
+     * @param expireTimeMs: set to the epoch milliseconds they expire at,
+     *      0 if they do not expire
+     *
+     * throws MQExceptionBase when the credentials could not be got
+     */
+    virtual MQCredentialsPtr fetch(int64_t& expireTimeMs) = 0;
+};
+#ifdef __APPLE__
+typedef std::shared_ptr<MQCredentialsProvider> MQCredentialsProviderPtr;
+#else
+typedef std::tr1::shared_ptr<MQCredentialsProvider> MQCredentialsProviderPtr;
+#endif
+
+/*
+ * reads the environment on every fetch, by default
+ * ALIBABA_CLOUD_ACCESS_KEY_ID, ALIBABA_CLOUD_ACCESS_KEY_SECRET and the
+ * optional ALIBABA_CLOUD_SECURITY_TOKEN
+ */
+class MQEnvironmentCredentialsProvider : public MQCredentialsProvider
+{
+public:
+    MQEnvironmentCredentialsProvider(const std::string& accessIdVariable = "ALIBABA_CLOUD_ACCESS_KEY_ID",
+                                     const std::string& accessKeyVariable = "ALIBABA_CLOUD_ACCESS_KEY_SECRET",
+                                     const std::string& stsTokenVariable = "ALIBABA_CLOUD_SECURITY_TOKEN");
+
+    MQCredentialsPtr fetch(int64_t& expireTimeMs);
+
+protected:
+    std::string mAccessIdVariable;
+    std::string mAccessKeyVariable;
+    std::string mStsTokenVariable;
+};
+
+/*
+ * reads a file on every fetch, holding the JSON that STS AssumeRole and the
+ * ECS RAM role metadata return:
+ *     {"AccessKeyId": "...", "AccessKeySecret": "...",
+ *      "SecurityToken": "...", "Expiration": "2019-01-01T00:00:00Z"}
+ * SecurityToken and Expiration may be left out.
+ */
+class MQFileCredentialsProvider : public MQCredentialsProvider
+{
+public:
+    MQFileCredentialsProvider(const std::string& path);
+
+    MQCredentialsPtr fetch(int64_t& expireTimeMs);
+
+    /* the credentials of a JSON document as above, throws MQExceptionBase if it has none */
+    static MQCredentialsPtr parse(const std::string& document, int64_t& expireTimeMs);
+
+protected:
+    std::string mPath;
+};
+
+/*
+ * runs a shell command on every fetch, it prints the JSON of
+ * MQFileCredentialsProvider and exits with 0
+ */
+class MQCommandCredentialsProvider : public MQCredentialsProvider
+{
+public:
+    MQCommandCredentialsProvider(const std::string& command);
+
+    MQCredentialsPtr fetch(int64_t& expireTimeMs);
+
+protected:
+    std::string mCommand;
+};
+
+struct MQCredentialsRefreshConfig
+{
+    MQCredentialsRefreshConfig()
+        : refreshAheadMs(300000)
+        , refreshIntervalMs(60000)
+        , retryIntervalMs(5000)
+    {
+    }
+    // fetch again this long before the credentials expire
+    int64_t refreshAheadMs;
+    // fetch again this often when the credentials do not expire
+    int64_t refreshIntervalMs;
+    // wait between failed fetches, never past the expiry of the credentials
+    int64_t retryIntervalMs;
+};
+
+/*
+ * fetches from the provider on a background thread ahead of expiry and
+ * publishes the result to the holder. A failed fetch keeps the previous
+ * credentials and is retried. Stops in the destructor.
+ */
+class MQCredentialsRefresher
+{
+public:
+    /* fetches once on the calling thread, throws MQExceptionBase if that fails */
+    MQCredentialsRefresher(MQCredentialsProviderPtr provider,
+                           MQCredentialsHolderPtr holder,
+                           const MQCredentialsRefreshConfig& config);
+    ~MQCredentialsRefresher();
+
+    /* epoch milliseconds the published credentials expire at, 0 if they do not */
+    int64_t getExpireTimeMs() const
+    {
+        return mExpireTimeMs.load();
+    }
+
+    /* fetches failed since the last one that succeeded */
+    int64_t getFailureCount() const
+    {
+        return mFailureCount.load();
+    }
+
+protected:
+    class RefreshThread;
+    friend class RefreshThread;
+
+    // fetch and publish, the epoch milliseconds of the next refresh
+    int64_t refresh();
+    int64_t nextRefresh(const int64_t expireTimeMs) const;
+
+    MQCredentialsProviderPtr mProvider;
+    MQCredentialsHolderPtr mHolder;
+    MQCredentialsRefreshConfig mConfig;
+    std::atomic<int64_t> mExpireTimeMs;
+    std::atomic<int64_t> mFailureCount;
+    RefreshThread* mThread;
+
+private:
+    MQCredentialsRefresher(const MQCredentialsRefresher&);
+    MQCredentialsRefresher& operator=(const MQCredentialsRefresher&);
+};
+#ifdef __APPLE__
+typedef std::shared_ptr<MQCredentialsRefresher> MQCredentialsRefresherPtr;
+#else
+typedef std::tr1::shared_ptr<MQCredentialsRefresher> MQCredentialsRefresherPtr;
+#endif
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,1648 @@
+#include "mq_native_transport.h"
+#include "mq_exception.h"
+#include "mq_common_tool.h"
+#include "constants.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#if defined(IORING_FEAT_FAST_POLL) && defined(IO_URING_OP_SUPPORTED) && defined(__NR_io_uring_setup)
+#define MQ_HAVE_IO_URING 1
+#endif
+#endif
+
+using namespace std;
+using namespace mq::http::sdk;
+
+#ifdef __linux__
+
+namespace mq
+{
+namespace http
+{
+namespace sdk
+{
+
+class UringRing;
+
+struct NativeConnection
+{
+    NativeConnection()
+        : fd(-1)
+        , epfd(-1)
+        , ssl(NULL)
+        , rbio(NULL)
+        , wbio(NULL)
+        , in(16384)
+        , inBegin(0)
+        , inEnd(0)
+        , createdMs(0)
+        , lastUsedMs(0)
+        , reused(false)
+        , received(false)
+        , peerClosed(false)
+        , keepAlive(true)
+        , ring(NULL)
+    {
+    }
+    int fd;
+    int epfd;
+    SSL* ssl;
+    // memory BIOs owned by ssl, the socket IO stays ours so TLS waits on the same epoll
+    BIO* rbio;
+    BIO* wbio;
+    // request head and its iovecs, rewritten in place for every request
+    std::string head;
+    std::vector<struct iovec> iov;
+    // TLS records waiting to be sent
+    std::string tlsOut;
+    // received bytes, [inBegin, inEnd) not parsed yet
+    std::vector<char> in;
+    size_t inBegin;
+    size_t inEnd;
+    int64_t createdMs;
+    int64_t lastUsedMs;
+    // taken from the idle list rather than connected for this request
+    bool reused;
+    // any byte of the answer came in
+    bool received;
+    // the peer reset or closed the connection
+    bool peerClosed;
+    bool keepAlive;
+    // with useIoUring, the socket is blocking then; NULL with epoll
+    UringRing* ring;
+};
+
+struct NativeEndpoint
+{
+    std::string host;
+    std::string port;
+    bool tls;
+    PTMutex mutex;
+    std::vector<NativeConnection*> idle;
+};
+
+}
+}
+}
+
+// a response header larger than this is not from an MQ server
+static const size_t kMaxBufferedBytes = 1024 * 1024;
+// least a response body grows by while it is read
+static const size_t kBodyGrowStep = 64 * 1024;
+// larger chunks are taken for a broken or hostile server
+static const size_t kMaxChunkSize = (size_t)1 << 30;
+
+static void ThrowIoError(const std::string& what, const int err)
+{
+    MQ_THROW(MQExceptionBase, "Native Send Request Fail, " + what + " errno:"
+        + StringTool::ToString(err) + " errorStr:" + strerror(err));
+}
+
+static void ThrowTlsError(const std::string& what)
+{
+    char err[256];
+    ERR_error_string_n(ERR_get_error(), err, sizeof(err));
+    MQ_THROW(MQExceptionBase, "Native Send Request Fail, " + what + " " + err);
+}
+
+#ifdef MQ_HAVE_IO_URING
+
+namespace mq
+{
+namespace http
+{
+namespace sdk
+{
+
+/*
+ * a small io_uring of one connection, set up with raw syscalls. Like the
+ * epoll fd next to it, it is only used by the thread holding the connection,
+ * which queues its operations and waits for them in io_uring_enter itself:
+ * a plain http request goes out with the receive of its answer already
+ * queued, one io_uring_enter submits both and the next sleeps until the
+ * answer is there. A thread waits for all operations it queued before it
+ * returns, so no operation outlives the buffers it points to.
+ */
+class UringRing
+{
+public:
+    // one queued operation, its address is the user_data of the entry
+    struct Operation
+    {
+        Operation()
+            : res(0)
+            , done(false)
+        {
+        }
+        int32_t res;
+        bool done;
+    };
+
+    /* false when io_uring can not be used in this process */
+    static bool Available()
+    {
+        return Probe() == kUsable;
+    }
+
+    /* a ring for the connected socket, NULL when io_uring can not be used for it */
+    static UringRing* Create(const int socket)
+    {
+        if (Probe() != kUsable)
+        {
+            return NULL;
+        }
+        UringRing* ring = new UringRing(socket);
+        if (!ring->Init(kEntries))
+        {
+            delete ring;
+            return NULL;
+        }
+        return ring;
+    }
+
+    ~UringRing()
+    {
+        if (mSqes != MAP_FAILED)
+            munmap(mSqes, mSqesSize);
+        if (mCqRing != MAP_FAILED && mCqRing != mSqRing)
+            munmap(mCqRing, mCqRingSize);
+        if (mSqRing != MAP_FAILED)
+            munmap(mSqRing, mSqRingSize);
+        if (mFd >= 0)
+            close(mFd);
+    }
+
+    /*
+     * queues sqe for op and a LINK_TIMEOUT that fails it with -ECANCELED when
+     * timeoutMs passes; both complete, into op and timeoutOp
+     */
+    void Queue(const struct io_uring_sqe& sqe, Operation& op,
+               struct __kernel_timespec& ts, Operation& timeoutOp, const int64_t timeoutMs)
+    {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000;
+        if (mLocalTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE) + 2 > mSqEntries)
+        {
+            MQ_THROW(MQExceptionBase, "Native Send Request Fail, io_uring submission queue full");
+        }
+        struct io_uring_sqe* entry = Next();
+        memcpy(entry, &sqe, sizeof(sqe));
+        entry->flags |= IOSQE_IO_LINK;
+        entry->user_data = (uint64_t)(uintptr_t)&op;
+        entry = Next();
+        memset(entry, 0, sizeof(*entry));
+        entry->opcode = IORING_OP_LINK_TIMEOUT;
+        entry->fd = -1;
+        entry->addr = (uint64_t)(uintptr_t)&ts;
+        entry->len = 1;
+        entry->user_data = (uint64_t)(uintptr_t)&timeoutOp;
+        __atomic_store_n(mSqTail, mLocalTail, __ATOMIC_RELEASE);
+        mToSubmit += 2;
+        mPending += 2;
+    }
+
+    /* submits what is queued and returns once op completed */
+    void Wait(const Operation& op)
+    {
+        Reap();
+        while (!op.done)
+        {
+            int ret = (int)syscall(__NR_io_uring_enter, mFd, mToSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (ret >= 0)
+            {
+                mToSubmit -= (unsigned)ret;
+            }
+            else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                Fail(errno);
+            }
+            Reap();
+        }
+    }
+
+private:
+    // entries of the submission queue, a request has at most four queued
+    static const unsigned kEntries = 8;
+
+    enum Support
+    {
+        kUnknown,
+        kUsable,
+        kUnusable
+    };
+
+    UringRing(const int socket)
+        : mFd(-1)
+        , mSocket(socket)
+        , mSqRing(MAP_FAILED)
+        , mCqRing(MAP_FAILED)
+        , mSqes(static_cast<struct io_uring_sqe*>(MAP_FAILED))
+        , mSqRingSize(0)
+        , mCqRingSize(0)
+        , mSqesSize(0)
+        , mSqEntries(0)
+        , mLocalTail(0)
+        , mToSubmit(0)
+        , mPending(0)
+    {
+    }
+
+    // whether the kernel has what the rings need, asked once per process
+    static int Probe()
+    {
+        static std::atomic<int> sSupport(kUnknown);
+        int support = sSupport.load();
+        if (support == kUnknown)
+        {
+            UringRing ring(-1);
+            support = ring.Init(kEntries) && ring.Supports(IORING_OP_SENDMSG) && ring.Supports(IORING_OP_RECV)
+                && ring.Supports(IORING_OP_LINK_TIMEOUT) ? kUsable : kUnusable;
+            sSupport.store(support);
+        }
+        return support;
+    }
+
+    bool Init(const unsigned entries)
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        mFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (mFd < 0)
+        {
+            return false;
+        }
+        // blocking sockets are only waited for without a kernel thread with fast poll
+        if (!(params.features & IORING_FEAT_FAST_POLL) || !(params.features & IORING_FEAT_NODROP))
+        {
+            return false;
+        }
+
+        mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            mSqRingSize = mCqRingSize = mSqRingSize > mCqRingSize ? mSqRingSize : mCqRingSize;
+        }
+        mSqRing = mmap(NULL, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING);
+        if (mSqRing == MAP_FAILED)
+        {
+            return false;
+        }
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            mCqRing = mSqRing;
+        }
+        else
+        {
+            mCqRing = mmap(NULL, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_CQ_RING);
+            if (mCqRing == MAP_FAILED)
+            {
+                return false;
+            }
+        }
+        mSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        mSqes = static_cast<struct io_uring_sqe*>(mmap(NULL, mSqesSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQES));
+        if (mSqes == MAP_FAILED)
+        {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(mSqRing);
+        char* cq = static_cast<char*>(mCqRing);
+        mSqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        mSqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        mSqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        mSqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        mCqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        mCqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        mCqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        mCqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        mSqEntries = params.sq_entries;
+        mLocalTail = *mSqTail;
+        return true;
+    }
+
+    bool Supports(const uint8_t opcode)
+    {
+        const size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+        std::vector<char> buffer(size, 0);
+        struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(&buffer[0]);
+        if (syscall(__NR_io_uring_register, mFd, IORING_REGISTER_PROBE, probe, 256) < 0)
+        {
+            return false;
+        }
+        return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    struct io_uring_sqe* Next()
+    {
+        unsigned index = mLocalTail & *mSqMask;
+        mSqArray[index] = index;
+        ++mLocalTail;
+        return &mSqes[index];
+    }
+
+    void Reap()
+    {
+        unsigned head = *mCqHead;
+        unsigned tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            const struct io_uring_cqe& cqe = mCqes[head & *mCqMask];
+            Operation* op = reinterpret_cast<Operation*>((uintptr_t)cqe.user_data);
+            op->res = cqe.res;
+            op->done = true;
+            --mPending;
+        }
+        __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+    }
+
+    /*
+     * io_uring_enter failed for good. The operations in the kernel point into
+     * the frames of the callers, so they are ended before the exception
+     * unwinds those: entries not submitted yet are taken back, the socket is
+     * shut down so the rest completes at once, and their completions are
+     * reaped. If even that can not be done the process aborts, as the kernel
+     * would otherwise write into freed memory.
+     */
+    void Fail(const int err)
+    {
+        mLocalTail -= mToSubmit;
+        __atomic_store_n(mSqTail, mLocalTail, __ATOMIC_RELEASE);
+        mPending -= mToSubmit;
+        mToSubmit = 0;
+        shutdown(mSocket, SHUT_RDWR);
+        while (mPending > 0)
+        {
+            if (syscall(__NR_io_uring_enter, mFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+                && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                std::cerr << "io_uring_enter failed with operations in flight, errno:" << errno
+                    << " errorStr:" << strerror(errno) << ", abort()" << std::endl;
+                abort();
+            }
+            Reap();
+        }
+        ThrowIoError("io_uring_enter", err);
+    }
+
+    int mFd;
+    // the connection's socket, shut down by Fail
+    int mSocket;
+    void* mSqRing;
+    void* mCqRing;
+    struct io_uring_sqe* mSqes;
+    size_t mSqRingSize;
+    size_t mCqRingSize;
+    size_t mSqesSize;
+    unsigned mSqEntries;
+    unsigned* mSqHead;
+    unsigned* mSqTail;
+    unsigned* mSqMask;
+    unsigned* mSqArray;
+    unsigned* mCqHead;
+    unsigned* mCqTail;
+    unsigned* mCqMask;
+    struct io_uring_cqe* mCqes;
+    unsigned mLocalTail;
+    // queued entries the kernel was not given yet
+    unsigned mToSubmit;
+    // queued entries whose completion was not reaped yet
+    unsigned mPending;
+};
+
+}
+}
+}
+
+static int64_t RemainingMs(const int64_t deadline)
+{
+    int64_t remaining = deadline - TimeTool::GetMonotonicMs();
+    if (remaining <= 0)
+    {
+        MQ_THROW(MQExceptionBase, "Native Send Request Fail, timed out");
+    }
+    return remaining;
+}
+
+// a send and its timeout in flight
+struct UringSendOp
+{
+    struct msghdr msg;
+    struct __kernel_timespec ts;
+    UringRing::Operation op;
+    UringRing::Operation timeoutOp;
+};
+
+// a receive and its timeout in flight
+struct UringRecvOp
+{
+    struct __kernel_timespec ts;
+    UringRing::Operation op;
+    UringRing::Operation timeoutOp;
+};
+
+static void QueueSend(NativeConnection* conn, UringSendOp& send, const int64_t deadline)
+{
+    int64_t timeoutMs = RemainingMs(deadline);
+    send.op = UringRing::Operation();
+    send.timeoutOp = UringRing::Operation();
+    struct io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_SENDMSG;
+    sqe.fd = conn->fd;
+    sqe.addr = (uint64_t)(uintptr_t)&send.msg;
+    sqe.len = 1;
+    sqe.msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    conn->ring->Queue(sqe, send.op, send.ts, send.timeoutOp, timeoutMs);
+}
+
+static void QueueRecv(NativeConnection* conn, char* buffer, const size_t size, UringRecvOp& recv,
+                      const int64_t deadline)
+{
+    int64_t timeoutMs = RemainingMs(deadline);
+    recv.op = UringRing::Operation();
+    recv.timeoutOp = UringRing::Operation();
+    struct io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_RECV;
+    sqe.fd = conn->fd;
+    sqe.addr = (uint64_t)(uintptr_t)buffer;
+    sqe.len = (uint32_t)size;
+    conn->ring->Queue(sqe, recv.op, recv.ts, recv.timeoutOp, timeoutMs);
+}
+
+// both the operation and its timeout, the timespec lives until then
+template <typename T>
+static int32_t WaitBoth(UringRing* ring, T& pending)
+{
+    ring->Wait(pending.op);
+    ring->Wait(pending.timeoutOp);
+    return pending.op.res;
+}
+
+// skips what went out, true when all of it did
+static bool AdvanceIov(struct msghdr& msg, size_t sent)
+{
+    while (msg.msg_iovlen > 0 && sent >= msg.msg_iov->iov_len)
+    {
+        sent -= msg.msg_iov->iov_len;
+        ++msg.msg_iov;
+        --msg.msg_iovlen;
+    }
+    if (msg.msg_iovlen > 0)
+    {
+        msg.msg_iov->iov_base = static_cast<char*>(msg.msg_iov->iov_base) + sent;
+        msg.msg_iov->iov_len -= sent;
+    }
+    return msg.msg_iovlen == 0;
+}
+
+// false when the peer closed or reset the connection, throws on timeout and errors
+static bool CheckSendResult(NativeConnection* conn, const int32_t res)
+{
+    if (res >= 0 || res == -EINTR || res == -EAGAIN)
+    {
+        return true;
+    }
+    if (res == -EPIPE || res == -ECONNRESET)
+    {
+        conn->peerClosed = true;
+        return false;
+    }
+    if (res == -ECANCELED)
+    {
+        MQ_THROW(MQExceptionBase, "Native Send Request Fail, timed out");
+    }
+    ThrowIoError("send", -res);
+    return false;
+}
+
+static bool CheckRecvResult(NativeConnection* conn, const int32_t res)
+{
+    if (res >= 0 || res == -EINTR || res == -EAGAIN)
+    {
+        return true;
+    }
+    if (res == -ECONNRESET)
+    {
+        conn->peerClosed = true;
+        return true;
+    }
+    if (res == -ECANCELED)
+    {
+        MQ_THROW(MQExceptionBase, "Native Send Request Fail, timed out");
+    }
+    ThrowIoError("recv", -res);
+    return false;
+}
+
+static void UringSend(NativeConnection* conn, struct iovec* iov, const int count, const int64_t deadline)
+{
+    UringSendOp send;
+    memset(&send.msg, 0, sizeof(send.msg));
+    send.msg.msg_iov = iov;
+    send.msg.msg_iovlen = count;
+    while (send.msg.msg_iovlen > 0)
+    {
+        QueueSend(conn, send, deadline);
+        int32_t res = WaitBoth(conn->ring, send);
+        if (!CheckSendResult(conn, res))
+        {
+            return;
+        }
+        AdvanceIov(send.msg, res > 0 ? (size_t)res : 0);
+    }
+}
+
+static size_t UringRecv(NativeConnection* conn, char* buffer, const size_t size, const int64_t deadline)
+{
+    UringRecvOp recv;
+    while (true)
+    {
+        QueueRecv(conn, buffer, size, recv, deadline);
+        int32_t res = WaitBoth(conn->ring, recv);
+        CheckRecvResult(conn, res);
+        if (res >= 0 || conn->peerClosed)
+        {
+            return res > 0 ? (size_t)res : 0;
+        }
+    }
+}
+
+/*
+ * the request and the wait for the first bytes of its answer queued side by
+ * side, each with its own timeout, so they reach the kernel in the same
+ * io_uring_enter. Fills the connection buffer like Fill.
+ */
+static void UringExchange(NativeConnection* conn, struct iovec* iov, const int count, const int64_t deadline)
+{
+    UringRing* ring = conn->ring;
+    UringSendOp send;
+    UringRecvOp recv;
+    memset(&send.msg, 0, sizeof(send.msg));
+    send.msg.msg_iov = iov;
+    send.msg.msg_iovlen = count;
+    conn->inBegin = conn->inEnd = 0;
+
+    QueueSend(conn, send, deadline);
+    try
+    {
+        QueueRecv(conn, &conn->in[0], conn->in.size(), recv, deadline);
+    }
+    catch (...)
+    {
+        WaitBoth(ring, send);
+        throw;
+    }
+
+    int32_t sendRes = WaitBoth(ring, send);
+    bool sent = false;
+    try
+    {
+        // the receive stays queued while the rest of a short send goes out
+        while (CheckSendResult(conn, sendRes) && !(sent = AdvanceIov(send.msg, sendRes > 0 ? (size_t)sendRes : 0)))
+        {
+            QueueSend(conn, send, deadline);
+            sendRes = WaitBoth(ring, send);
+        }
+    }
+    catch (...)
+    {
+        WaitBoth(ring, recv);
+        throw;
+    }
+
+    int32_t recvRes = WaitBoth(ring, recv);
+    if (!sent)
+    {
+        return;
+    }
+    CheckRecvResult(conn, recvRes);
+    if (recvRes > 0)
+    {
+        conn->inEnd = (size_t)recvRes;
+        conn->received = true;
+    }
+}
+
+#endif
+
+static void CloseConnection(NativeConnection* conn)
+{
+#ifdef MQ_HAVE_IO_URING
+    delete conn->ring;
+#endif
+    if (conn->ssl != NULL)
+    {
+        SSL_free(conn->ssl);
+    }
+    if (conn->fd >= 0)
+    {
+        close(conn->fd);
+    }
+    if (conn->epfd >= 0)
+    {
+        close(conn->epfd);
+    }
+    delete conn;
+}
+
+static void SetInterest(NativeConnection* conn, const uint32_t events)
+{
+    struct epoll_event ev;
+    ev.events = events | EPOLLET;
+    ev.data.ptr = conn;
+    if (epoll_ctl(conn->epfd, EPOLL_CTL_MOD, conn->fd, &ev) < 0)
+    {
+        ThrowIoError("epoll_ctl", errno);
+    }
+}
+
+// edge triggered, callers retry their IO until EAGAIN before waiting again
+static void WaitReady(NativeConnection* conn, const int64_t deadline)
+{
+    while (true)
+    {
+        int64_t remaining = deadline - TimeTool::GetMonotonicMs();
+        if (remaining <= 0)
+        {
+            MQ_THROW(MQExceptionBase, "Native Send Request Fail, timed out");
+        }
+        struct epoll_event ev;
+        int n = epoll_wait(conn->epfd, &ev, 1, (int)remaining);
+        if (n > 0)
+        {
+            return;
+        }
+        if (n < 0 && errno != EINTR)
+        {
+            ThrowIoError("epoll_wait", errno);
+        }
+    }
+}
+
+static void PlainSend(NativeConnection* conn, struct iovec* iov, int count, const int64_t deadline)
+{
+#ifdef MQ_HAVE_IO_URING
+    if (conn->ring != NULL)
+    {
+        UringSend(conn, iov, count, deadline);
+        return;
+    }
+#endif
+    bool waitedForWrite = false;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    while (count > 0)
+    {
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (!waitedForWrite)
+                {
+                    SetInterest(conn, EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+                    waitedForWrite = true;
+                }
+                WaitReady(conn, deadline);
+                continue;
+            }
+            if (errno == EPIPE || errno == ECONNRESET)
+            {
+                conn->peerClosed = true;
+                return;
+            }
+            ThrowIoError("send", errno);
+        }
+        size_t sent = (size_t)n;
+        while (count > 0 && sent >= iov->iov_len)
+        {
+            sent -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    if (waitedForWrite)
+    {
+        SetInterest(conn, EPOLLIN | EPOLLRDHUP);
+    }
+}
+
+// 0 when the peer closed or reset the connection
+static size_t PlainRecv(NativeConnection* conn, char* buffer, const size_t size, const int64_t deadline)
+{
+#ifdef MQ_HAVE_IO_URING
+    if (conn->ring != NULL)
+    {
+        return UringRecv(conn, buffer, size, deadline);
+    }
+#endif
+    while (true)
+    {
+        ssize_t n = recv(conn->fd, buffer, size, 0);
+        if (n >= 0)
+        {
+            return (size_t)n;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            WaitReady(conn, deadline);
+            continue;
+        }
+        if (errno == ECONNRESET)
+        {
+            conn->peerClosed = true;
+            return 0;
+        }
+        ThrowIoError("recv", errno);
+    }
+}
+
+// send the records TLS produced so far in one go
+static void FlushTls(NativeConnection* conn, const int64_t deadline)
+{
+    size_t pending;
+    while ((pending = BIO_ctrl_pending(conn->wbio)) > 0)
+    {
+        size_t old = conn->tlsOut.size();
+        conn->tlsOut.resize(old + pending);
+        int n = BIO_read(conn->wbio, &conn->tlsOut[old], (int)pending);
+        conn->tlsOut.resize(old + (n > 0 ? n : 0));
+        if (n <= 0)
+        {
+            break;
+        }
+    }
+    if (!conn->tlsOut.empty())
+    {
+        struct iovec iov;
+        iov.iov_base = &conn->tlsOut[0];
+        iov.iov_len = conn->tlsOut.size();
+        PlainSend(conn, &iov, 1, deadline);
+        conn->tlsOut.clear();
+    }
+}
+
+static bool FeedTls(NativeConnection* conn, const int64_t deadline)
+{
+    char buffer[16384];
+    size_t n = PlainRecv(conn, buffer, sizeof(buffer), deadline);
+    if (n == 0)
+    {
+        return false;
+    }
+    BIO_write(conn->rbio, buffer, (int)n);
+    return true;
+}
+
+static size_t TlsRecv(NativeConnection* conn, char* buffer, const size_t size, const int64_t deadline)
+{
+    while (true)
+    {
+        ERR_clear_error();
+        int n = SSL_read(conn->ssl, buffer, (int)size);
+        if (n > 0)
+        {
+            return (size_t)n;
+        }
+        int err = SSL_get_error(conn->ssl, n);
+        if (err == SSL_ERROR_WANT_READ)
+        {
+            FlushTls(conn, deadline);
+            if (!FeedTls(conn, deadline))
+            {
+                return 0;
+            }
+            continue;
+        }
+        if (err == SSL_ERROR_ZERO_RETURN)
+        {
+            return 0;
+        }
+        ThrowTlsError("SSL_read");
+    }
+}
+
+static size_t Recv(NativeConnection* conn, char* buffer, const size_t size, const int64_t deadline)
+{
+    return conn->ssl != NULL ? TlsRecv(conn, buffer, size, deadline)
+        : PlainRecv(conn, buffer, size, deadline);
+}
+
+static void SendAll(NativeConnection* conn, struct iovec* iov, const int count, const int64_t deadline)
+{
+    if (conn->ssl == NULL)
+    {
+        PlainSend(conn, iov, count, deadline);
+        return;
+    }
+    // all pieces go into the memory BIO first, then out in one send
+    for (int i = 0; i < count; ++i)
+    {
+        if (iov[i].iov_len == 0)
+        {
+            continue;
+        }
+        ERR_clear_error();
+        if (SSL_write(conn->ssl, iov[i].iov_base, (int)iov[i].iov_len) != (int)iov[i].iov_len)
+        {
+            ThrowTlsError("SSL_write");
+        }
+    }
+    FlushTls(conn, deadline);
+}
+
+// read more into the connection buffer, false when the peer closed
+static bool Fill(NativeConnection* conn, const int64_t deadline)
+{
+    std::vector<char>& in = conn->in;
+    if (conn->inBegin == conn->inEnd)
+    {
+        conn->inBegin = conn->inEnd = 0;
+    }
+    else if (conn->inEnd == in.size())
+    {
+        if (conn->inBegin > 0)
+        {
+            memmove(&in[0], &in[conn->inBegin], conn->inEnd - conn->inBegin);
+            conn->inEnd -= conn->inBegin;
+            conn->inBegin = 0;
+        }
+        else if (in.size() < kMaxBufferedBytes)
+        {
+            in.resize(in.size() * 2);
+        }
+        else
+        {
+            MQ_THROW(MQExceptionBase, "Native Send Request Fail, response header too large");
+        }
+    }
+    size_t n = Recv(conn, &in[conn->inEnd], in.size() - conn->inEnd, deadline);
+    if (n == 0)
+    {
+        return false;
+    }
+    conn->inEnd += n;
+    conn->received = true;
+    return true;
+}
+
+static size_t FindInBuffer(NativeConnection* conn, const char* pattern, const size_t patternSize)
+{
+    const char* begin = &conn->in[0] + conn->inBegin;
+    const void* found = memmem(begin, conn->inEnd - conn->inBegin, pattern, patternSize);
+    return found == NULL ? std::string::npos : static_cast<const char*>(found) - &conn->in[0];
+}
+
+// offset of the next CRLF, reading more as needed
+static size_t WaitLine(NativeConnection* conn, const int64_t deadline)
+{
+    size_t lineEnd;
+    while ((lineEnd = FindInBuffer(conn, "\r\n", 2)) == std::string::npos)
+    {
+        if (!Fill(conn, deadline))
+        {
+            MQ_THROW(MQExceptionBase, "Native Send Request Fail, connection closed in the response");
+        }
+    }
+    return lineEnd;
+}
+
+static void ReadFixedBody(NativeConnection* conn, Response& resp, size_t remaining, const int64_t deadline)
+{
+    std::string& body = *resp.getRawDataPtr();
+    size_t buffered = conn->inEnd - conn->inBegin;
+    size_t take = buffered < remaining ? buffered : remaining;
+    body.append(&conn->in[conn->inBegin], take);
+    conn->inBegin += take;
+    remaining -= take;
+    if (take > 0)
+    {
+        resp.onBodyReceived(body.size());
+    }
+    if (remaining == 0)
+    {
+        return;
+    }
+    // the rest goes straight into the body, parsed as it lands; the body
+    // grows with what arrives so a bogus length cannot allocate up front
+    resp.reserveRawData(body.size() + remaining);
+    size_t pos = body.size();
+    while (remaining > 0)
+    {
+        if (pos == body.size())
+        {
+            size_t room = body.capacity() > pos ? body.capacity() - pos : pos;
+            if (room < kBodyGrowStep)
+            {
+                room = kBodyGrowStep;
+            }
+            body.resize(pos + (room < remaining ? room : remaining));
+        }
+        size_t n = Recv(conn, &body[pos], body.size() - pos, deadline);
+        if (n == 0)
+        {
+            body.resize(pos);
+            MQ_THROW(MQExceptionBase, "Native Send Request Fail, connection closed in the response body");
+        }
+        pos += n;
+        remaining -= n;
+        resp.onBodyReceived(pos);
+    }
+}
+
+static inline bool IsHeaderSpace(const char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static void ReadChunkedBody(NativeConnection* conn, Response& resp, const int64_t deadline)
+{
+    while (true)
+    {
+        size_t lineEnd = WaitLine(conn, deadline);
+        size_t chunkSize = 0;
+        size_t i = conn->inBegin;
+        for (; i < lineEnd; ++i)
+        {
+            char c = conn->in[i];
+            int digit;
+            if (c >= '0' && c <= '9')
+                digit = c - '0';
+            else if (c >= 'a' && c <= 'f')
+                digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                digit = c - 'A' + 10;
+            else
+                break;
+            chunkSize = chunkSize * 16 + digit;
+            if (chunkSize > kMaxChunkSize)
+            {
+                MQ_THROW(MQExceptionBase, "Native Send Request Fail, chunk size too large");
+            }
+        }
+        // at least one digit, then only chunk extensions
+        if (i == conn->inBegin || (i < lineEnd && conn->in[i] != ';' && !IsHeaderSpace(conn->in[i])))
+        {
+            MQ_THROW(MQExceptionBase, "Native Send Request Fail, bad chunk size line");
+        }
+        conn->inBegin = lineEnd + 2;
+        if (chunkSize == 0)
+        {
+            // trailers up to the empty line
+            while ((lineEnd = WaitLine(conn, deadline)) != conn->inBegin)
+            {
+                conn->inBegin = lineEnd + 2;
+            }
+            conn->inBegin += 2;
+            return;
+        }
+        ReadFixedBody(conn, resp, chunkSize, deadline);
+        lineEnd = WaitLine(conn, deadline);
+        if (lineEnd != conn->inBegin)
+        {
+            MQ_THROW(MQExceptionBase, "Native Send Request Fail, chunk longer than its size");
+        }
+        conn->inBegin = lineEnd + 2;
+    }
+}
+
+static bool HeaderNameIs(const char* name, const size_t nameSize, const char* expected)
+{
+    return strlen(expected) == nameSize && strncasecmp(name, expected, nameSize) == 0;
+}
+
+static bool TryConnect(NativeConnection* conn, const struct addrinfo* ai, const int64_t deadline, int& lastError)
+{
+    int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0)
+    {
+        lastError = errno;
+        return false;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLOUT | EPOLLET;
+    ev.data.ptr = conn;
+    if (epoll_ctl(conn->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        lastError = errno;
+        close(fd);
+        return false;
+    }
+    conn->fd = fd;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+    {
+        return true;
+    }
+    int err = errno;
+    if (err == EINPROGRESS)
+    {
+        WaitReady(conn, deadline);
+        socklen_t length = sizeof(err);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &length) < 0)
+        {
+            err = errno;
+        }
+        if (err == 0)
+        {
+            return true;
+        }
+    }
+    lastError = err;
+    epoll_ctl(conn->epfd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    conn->fd = -1;
+    return false;
+}
+
+namespace
+{
+
+class AddrInfoGuard
+{
+public:
+    AddrInfoGuard() : mResult(NULL) {}
+    ~AddrInfoGuard()
+    {
+        if (mResult != NULL)
+        {
+            freeaddrinfo(mResult);
+        }
+    }
+    struct addrinfo* mResult;
+};
+
+}
+
+static void ConnectSocket(NativeConnection* conn, NativeEndpoint* target,
+                          const MQConnectionConfig& config, const bool useIoUring, const int64_t deadline)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    AddrInfoGuard addresses;
+    int rc = getaddrinfo(target->host.c_str(), target->port.c_str(), &hints, &addresses.mResult);
+    if (rc != 0)
+    {
+        MQ_THROW(MQExceptionBase, "Native Send Request Fail, resolve " + target->host + ": " + gai_strerror(rc));
+    }
+    int lastError = 0;
+    for (struct addrinfo* ai = addresses.mResult; ai != NULL; ai = ai->ai_next)
+    {
+        if (TryConnect(conn, ai, deadline, lastError))
+        {
+            break;
+        }
+    }
+    if (conn->fd < 0)
+    {
+        ThrowIoError("connect " + target->host + ":" + target->port, lastError);
+    }
+
+    int on = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (config.tcpKeepAlive)
+    {
+        int idle = config.tcpKeepIdleSeconds;
+        int interval = config.tcpKeepIntervalSeconds;
+        setsockopt(conn->fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    }
+    SetInterest(conn, EPOLLIN | EPOLLRDHUP);
+
+#ifdef MQ_HAVE_IO_URING
+    // io_uring waits on a blocking socket itself, epoll is only used for the connect
+    if (useIoUring)
+    {
+        int flags = fcntl(conn->fd, F_GETFL);
+        if (flags >= 0 && fcntl(conn->fd, F_SETFL, flags & ~O_NONBLOCK) == 0)
+        {
+            conn->ring = UringRing::Create(conn->fd);
+            // without a ring, e.g. over RLIMIT_MEMLOCK on older kernels, the connection stays on epoll
+            if (conn->ring == NULL)
+            {
+                fcntl(conn->fd, F_SETFL, flags);
+            }
+        }
+    }
+#else
+    (void)useIoUring;
+#endif
+}
+
+static void Handshake(NativeConnection* conn, NativeEndpoint* target, SSL_CTX* ctx, const int64_t deadline)
+{
+    conn->ssl = SSL_new(ctx);
+    if (conn->ssl == NULL)
+    {
+        ThrowTlsError("SSL_new");
+    }
+    conn->rbio = BIO_new(BIO_s_mem());
+    conn->wbio = BIO_new(BIO_s_mem());
+    SSL_set_bio(conn->ssl, conn->rbio, conn->wbio);
+    SSL_set_tlsext_host_name(conn->ssl, const_cast<char*>(target->host.c_str()));
+    X509_VERIFY_PARAM_set1_host(SSL_get0_param(conn->ssl), target->host.c_str(), 0);
+    SSL_set_connect_state(conn->ssl);
+    while (true)
+    {
+        ERR_clear_error();
+        int rc = SSL_do_handshake(conn->ssl);
+        FlushTls(conn, deadline);
+        if (rc == 1)
+        {
+            return;
+        }
+        if (SSL_get_error(conn->ssl, rc) != SSL_ERROR_WANT_READ)
+        {
+            ThrowTlsError("TLS handshake with " + target->host);
+        }
+        if (conn->peerClosed || !FeedTls(conn, deadline))
+        {
+            MQ_THROW(MQExceptionBase, "Native Send Request Fail, connection closed in the TLS handshake with "
+                + target->host);
+        }
+    }
+}
+
+MQNativeTransport::MQNativeTransport(const MQConnectionConfig& config)
+    : mConfig(config)
+    , mSslCtx(NULL)
+    , mUseIoUring(false)
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    SSL_library_init();
+    SSL_load_error_strings();
+    SSL_CTX* ctx = SSL_CTX_new(SSLv23_client_method());
+#else
+    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+#endif
+    if (ctx == NULL)
+    {
+        ThrowTlsError("SSL_CTX_new");
+    }
+    SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    SSL_CTX_set_default_verify_paths(ctx);
+    mSslCtx = ctx;
+#ifdef MQ_HAVE_IO_URING
+    if (mConfig.useIoUring)
+    {
+        mUseIoUring = UringRing::Available();
+    }
+#endif
+}
+
+MQNativeTransport::~MQNativeTransport()
+{
+    for (std::map<std::string, NativeEndpoint*>::iterator iter = mEndpoints.begin();
+        iter != mEndpoints.end(); ++iter)
+    {
+        std::vector<NativeConnection*>& idle = iter->second->idle;
+        for (std::vector<NativeConnection*>::iterator conn = idle.begin(); conn != idle.end(); ++conn)
+        {
+            CloseConnection(*conn);
+        }
+        delete iter->second;
+    }
+    SSL_CTX_free(static_cast<SSL_CTX*>(mSslCtx));
+}
+
+NativeEndpoint* MQNativeTransport::GetEndpoint(const std::string& endpoint)
+{
+    PTScopedLock lock(mMutex);
+    std::map<std::string, NativeEndpoint*>::iterator iter = mEndpoints.find(endpoint);
+    if (iter != mEndpoints.end())
+    {
+        return iter->second;
+    }
+
+    NativeEndpoint* target = new NativeEndpoint();
+    size_t hostBegin = 0;
+    target->tls = false;
+    target->port = "80";
+    if (endpoint.compare(0, 8, "https://") == 0)
+    {
+        target->tls = true;
+        target->port = "443";
+        hostBegin = 8;
+    }
+    else if (endpoint.compare(0, 7, "http://") == 0)
+    {
+        hostBegin = 7;
+    }
+    size_t hostEnd = endpoint.find('/', hostBegin);
+    std::string authority = endpoint.substr(hostBegin,
+        hostEnd == std::string::npos ? std::string::npos : hostEnd - hostBegin);
+    size_t bracket = authority.find(']');
+    size_t colon = authority.rfind(':');
+    if (colon != std::string::npos && (bracket == std::string::npos || colon > bracket))
+    {
+        target->port = authority.substr(colon + 1);
+        authority.erase(colon);
+    }
+    if (authority.size() > 1 && authority[0] == '[' && authority[authority.size() - 1] == ']')
+    {
+        authority = authority.substr(1, authority.size() - 2);
+    }
+    target->host = authority;
+    mEndpoints[endpoint] = target;
+    return target;
+}
+
+NativeConnection* MQNativeTransport::TakeConnection(NativeEndpoint* target)
+{
+    int64_t now = TimeTool::GetMonotonicMs();
+    {
+        PTScopedLock lock(target->mutex);
+        while (!target->idle.empty())
+        {
+            NativeConnection* conn = target->idle.back();
+            target->idle.pop_back();
+            if ((mConfig.maxIdleTimeMs > 0 && now - conn->lastUsedMs > mConfig.maxIdleTimeMs)
+                || (mConfig.maxConnectionLifetimeMs > 0 && now - conn->createdMs > mConfig.maxConnectionLifetimeMs))
+            {
+                CloseConnection(conn);
+                continue;
+            }
+            conn->reused = true;
+            return conn;
+        }
+    }
+
+    return Connect(target, now + (int64_t)mConfig.connectTimeout * 1000);
+}
+
+NativeConnection* MQNativeTransport::Connect(NativeEndpoint* target, const int64_t deadline)
+{
+    NativeConnection* conn = new NativeConnection();
+    try
+    {
+        conn->createdMs = TimeTool::GetMonotonicMs();
+        conn->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (conn->epfd < 0)
+        {
+            ThrowIoError("epoll_create1", errno);
+        }
+        ConnectSocket(conn, target, mConfig, mUseIoUring, deadline);
+        if (target->tls)
+        {
+            Handshake(conn, target, static_cast<SSL_CTX*>(mSslCtx), deadline);
+        }
+    }
+    catch (...)
+    {
+        CloseConnection(conn);
+        throw;
+    }
+    return conn;
+}
+
+bool MQNativeTransport::WarmUp(const std::string& endpoint, const int32_t connections, const int32_t timeoutMs)
+{
+    NativeEndpoint* target = GetEndpoint(endpoint);
+    const int64_t now = TimeTool::GetMonotonicMs();
+    int64_t deadline = now + (int64_t)mConfig.connectTimeout * 1000;
+    if (now + timeoutMs < deadline)
+    {
+        deadline = now + timeoutMs;
+    }
+    int32_t count = connections < mConfig.connPoolSize ? connections : mConfig.connPoolSize;
+    {
+        PTScopedLock lock(target->mutex);
+        count -= (int32_t)target->idle.size();
+    }
+    for (int32_t i = 0; i < count; i++)
+    {
+        NativeConnection* conn = NULL;
+        try
+        {
+            conn = Connect(target, deadline);
+        }
+        catch (MQExceptionBase& e)
+        {
+            return false;
+        }
+        GiveBack(target, conn);
+    }
+    return true;
+}
+
+void MQNativeTransport::GiveBack(NativeEndpoint* target, NativeConnection* conn)
+{
+    // leftover bytes would be taken for the next answer
+    if (!conn->keepAlive || conn->peerClosed || conn->inBegin != conn->inEnd)
+    {
+        CloseConnection(conn);
+        return;
+    }
+    conn->inBegin = conn->inEnd = 0;
+    conn->lastUsedMs = TimeTool::GetMonotonicMs();
+    {
+        PTScopedLock lock(target->mutex);
+        if ((int32_t)target->idle.size() < mConfig.connPoolSize)
+        {
+            target->idle.push_back(conn);
+            return;
+        }
+    }
+    CloseConnection(conn);
+}
+
+bool MQNativeTransport::Perform(NativeConnection* conn, Request& req, Response& resp)
+{
+    const int64_t deadline = TimeTool::GetMonotonicMs() + (int64_t)mConfig.timeout * 1000;
+    const std::string& method = req.getMethod();
+    conn->received = false;
+    conn->keepAlive = true;
+    resp.setStatus(0);
+    resp.clearRawData();
+    resp.resetHeaders();
+
+    std::string& head = conn->head;
+    head.assign(method).append(" ").append(req.getCanonicalizedResource()).append(" HTTP/1.1\r\n");
+    const std::map<std::string, std::string>& headers = req.getHeaders();
+    for (std::map<std::string, std::string>::const_iterator iter = headers.begin();
+        iter != headers.end(); ++iter)
+    {
+        head.append(iter->first).append(": ").append(iter->second).append("\r\n");
+    }
+    head.append("User-Agent: ").append(AGENT).append("\r\nConnection: keep-alive\r\n");
+    if (req.getBodySize() == 0 && method != "GET")
+    {
+        head.append("Content-Length: 0\r\n");
+    }
+    head.append("\r\n");
+
+    // head and body segments in one sendmsg
+    const std::vector<RequestBodySegment>& segments = req.getBodySegments();
+    conn->iov.resize(1 + (req.getBodySize() > 0 ? segments.size() : 0));
+    conn->iov[0].iov_base = &head[0];
+    conn->iov[0].iov_len = head.size();
+    for (size_t i = 1; i < conn->iov.size(); ++i)
+    {
+        conn->iov[i].iov_base = const_cast<char*>(segments[i - 1].data);
+        conn->iov[i].iov_len = segments[i - 1].size;
+    }
+#ifdef MQ_HAVE_IO_URING
+    if (conn->ring != NULL && conn->ssl == NULL)
+    {
+        UringExchange(conn, &conn->iov[0], (int)conn->iov.size(), deadline);
+    }
+    else
+#endif
+    {
+        SendAll(conn, &conn->iov[0], (int)conn->iov.size(), deadline);
+    }
+    if (conn->peerClosed && !conn->received)
+    {
+        if (conn->reused)
+        {
+            return false;
+        }
+        MQ_THROW(MQExceptionBase, "Native Send Request Fail, connection closed while sending");
+    }
+
+    int32_t status = 0;
+    int64_t contentLength = -1;
+    bool chunked = false;
+    while (true)
+    {
+        size_t headEnd;
+        while ((headEnd = FindInBuffer(conn, "\r\n\r\n", 4)) == std::string::npos)
+        {
+            if (!Fill(conn, deadline))
+            {
+                // an idle connection the server had closed, the request never got there
+                if (conn->reused && !conn->received)
+                {
+                    return false;
+                }
+                MQ_THROW(MQExceptionBase, "Native Send Request Fail, connection closed before the response");
+            }
+        }
+
+        const char* base = &conn->in[0];
+        const char* line = base + conn->inBegin;
+        const char* end = base + headEnd + 2;
+        const char* lineEnd = static_cast<const char*>(memchr(line, '\r', end - line));
+        if (lineEnd - line < 12 || memcmp(line, "HTTP/1.", 7) != 0 || line[8] != ' '
+            || !isdigit((unsigned char)line[9]) || !isdigit((unsigned char)line[10])
+            || !isdigit((unsigned char)line[11]))
+        {
+            MQ_THROW(MQExceptionBase, "Native Send Request Fail, bad status line");
+        }
+        conn->keepAlive = line[7] != '0';
+        status = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+
+        for (line = lineEnd + 2; line < end; line = lineEnd + 2)
+        {
+            lineEnd = static_cast<const char*>(memchr(line, '\r', end - line));
+            const char* colon = static_cast<const char*>(memchr(line, ':', lineEnd - line));
+            if (colon == NULL)
+            {
+                continue;
+            }
+            const char* nameEnd = colon;
+            while (nameEnd > line && IsHeaderSpace(nameEnd[-1]))
+            {
+                --nameEnd;
+            }
+            const char* value = colon + 1;
+            const char* valueEnd = lineEnd;
+            while (value < valueEnd && IsHeaderSpace(*value))
+            {
+                ++value;
+            }
+            while (valueEnd > value && IsHeaderSpace(valueEnd[-1]))
+            {
+                --valueEnd;
+            }
+            size_t nameSize = nameEnd - line;
+            size_t valueSize = valueEnd - value;
+            if (HeaderNameIs(line, nameSize, "content-length"))
+            {
+                contentLength = 0;
+                for (const char* digit = value; digit < valueEnd && *digit >= '0' && *digit <= '9'; ++digit)
+                {
+                    contentLength = contentLength * 10 + (*digit - '0');
+                }
+            }
+            else if (HeaderNameIs(line, nameSize, "transfer-encoding"))
+            {
+                chunked = valueSize >= 7 && strncasecmp(valueEnd - 7, "chunked", 7) == 0;
+            }
+            else if (HeaderNameIs(line, nameSize, "connection"))
+            {
+                if (HeaderNameIs(value, valueSize, "close"))
+                    conn->keepAlive = false;
+                else if (HeaderNameIs(value, valueSize, "keep-alive"))
+                    conn->keepAlive = true;
+            }
+            resp.appendHeader(line, nameSize, value, valueSize);
+        }
+        conn->inBegin = headEnd + 4;
+
+        if (status >= 200)
+        {
+            break;
+        }
+        // 1xx, the final answer follows
+        resp.resetHeaders();
+        contentLength = -1;
+        chunked = false;
+    }
+
+    if (status == 204 || status == 304)
+    {
+    }
+    else if (chunked)
+    {
+        ReadChunkedBody(conn, resp, deadline);
+    }
+    else if (contentLength >= 0)
+    {
+        resp.reserveRawData((size_t)contentLength);
+        ReadFixedBody(conn, resp, (size_t)contentLength, deadline);
+    }
+    else
+    {
+        // no length, the body ends with the connection
+        conn->keepAlive = false;
+        std::string& body = *resp.getRawDataPtr();
+        do
+        {
+            body.append(&conn->in[conn->inBegin], conn->inEnd - conn->inBegin);
+            conn->inBegin = conn->inEnd;
+            resp.onBodyReceived(body.size());
+        } while (Fill(conn, deadline));
+    }
+    resp.setStatus(status);
+    return true;
+}
+
+void MQNativeTransport::Send(const std::string& endpoint, Request& req, Response& resp)
+{
+    NativeEndpoint* target = GetEndpoint(endpoint);
+    int retry = 3;
+    while (true)
+    {
+        try
+        {
+            NativeConnection* conn = TakeConnection(target);
+            bool answered = false;
+            try
+            {
+                answered = Perform(conn, req, resp);
+            }
+            catch (...)
+            {
+                CloseConnection(conn);
+                throw;
+            }
+            if (!answered)
+            {
+                // stale keep-alive connection, the next one comes from the idle list or is new
+                CloseConnection(conn);
+                continue;
+            }
+            GiveBack(target, conn);
+            resp.parseResponse();
+            return;
+        }
+        catch (MQExceptionBase& e)
+        {
+            if (retry > 0 && resp.getStatus() >= 500)
+            {
+                retry--;
+                continue;
+            }
+            throw;
+        }
+    }
+}
+
+#else
+
+MQNativeTransport::MQNativeTransport(const MQConnectionConfig& config)
+    : mConfig(config)
+    , mSslCtx(NULL)
+    , mUseIoUring(false)
+{
+    MQ_THROW(MQExceptionBase, "HTTP_ENGINE_NATIVE is only available on Linux");
+}
+
+MQNativeTransport::~MQNativeTransport()
+{
+}
+
+void MQNativeTransport::Send(const std::string& /*endpoint*/, Request& /*req*/, Response& /*resp*/)
+{
+    MQ_THROW(MQExceptionBase, "HTTP_ENGINE_NATIVE is only available on Linux");
+}
+
+bool MQNativeTransport::WarmUp(const std::string& /*endpoint*/, const int32_t /*connections*/, const int32_t /*timeoutMs*/)
+{
+    return false;
+}
+
+#endif
+
+void MQNativeTransport::SendAsync(const std::string& /*endpoint*/, const AsyncTransferPtr& transfer)
+{
+    MQAsyncHandlerPtr asyncHandler;
+    {
+        PTScopedLock lock(mMutex);
+        if (!mAsyncHandler)
+        {
+            MQCurlSharePtr share;
+            if (mConfig.shareDnsAndTlsCache)
+            {
+                share.reset(new MQCurlShare(true, false));
+            }
+            mAsyncHandler.reset(new MQAsyncHandler(mConfig, share));
+        }
+        asyncHandler = mAsyncHandler;
+    }
+    asyncHandler->submit(transfer);
+}
@@ -0,0 +1,85 @@
+// Copyright (C) 2019, Alibaba Cloud Computing
+
+#ifndef MQ_SDK_NATIVE_TRANSPORT_H
+#define MQ_SDK_NATIVE_TRANSPORT_H
+
+#include "mq_transport.h"
+#include "mq_utils.h"
+
+#include <string>
+#include <map>
+#include <vector>
+
+namespace mq
+{
+namespace http
+{
+namespace sdk
+{
+
+struct NativeConnection;
+struct NativeEndpoint;
+
+/*
+ * HTTP_ENGINE_NATIVE: a lean HTTP/1.1 keep-alive client for the GET, POST and
+ * DELETE requests of the MQ protocol, written on non-blocking sockets, epoll
+ * and OpenSSL. The request head and body go out in one sendmsg, the response
+ * is parsed in the connection's buffer and the body read straight into the
+ * Response. Same contract as MQNetworkTool::SendRequest: retries on 5xx,
+ * throws MQServerException / MQExceptionBase.
+ *
+ * Uses connPoolSize, timeout, connectTimeout, maxIdleTimeMs,
+ * maxConnectionLifetimeMs and the tcpKeepAlive settings of the config.
+ * With useIoUring (experimental) each connection does its socket IO through
+ * a small io_uring of its own instead of epoll: the sending thread submits a
+ * plain http request and the receive of its answer in one io_uring_enter and
+ * reaps the completions itself. epoll stays in use where the kernel or a
+ * seccomp filter does not allow io_uring, or a ring can not be set up.
+ * Linux only, the constructor throws elsewhere.
+ */
+class MQNativeTransport : public MQTransport
+{
+public:
+    MQNativeTransport(const MQConnectionConfig& config);
+    virtual ~MQNativeTransport();
+
+    void Send(const std::string& endpoint, Request& req, Response& resp);
+    // connects and handshakes in turn on the calling thread, up to connPoolSize idle connections
+    bool WarmUp(const std::string& endpoint, const int32_t connections, const int32_t timeoutMs);
+    // the engine has no event loop, async requests go to curl multi loops built on first use
+    void SendAsync(const std::string& endpoint, const AsyncTransferPtr& transfer);
+
+    /* false with useIoUring too when io_uring was not available */
+    bool UsesIoUring() const
+    {
+        return mUseIoUring;
+    }
+
+protected:
+    NativeEndpoint* GetEndpoint(const std::string& endpoint);
+    NativeConnection* TakeConnection(NativeEndpoint* target);
+    NativeConnection* Connect(NativeEndpoint* target, const int64_t deadline);
+    void GiveBack(NativeEndpoint* target, NativeConnection* conn);
+    // one attempt, false if a reused connection was found closed before any answer
+    bool Perform(NativeConnection* conn, Request& req, Response& resp);
+
+    MQConnectionConfig mConfig;
+    // SSL_CTX, kept opaque so the header does not pull in OpenSSL
+    void* mSslCtx;
+    // useIoUring and the kernel allows io_uring
+    bool mUseIoUring;
+    PTMutex mMutex;
+    std::map<std::string, NativeEndpoint*> mEndpoints;
+    // for SendAsync, guarded by mMutex
+    MQAsyncHandlerPtr mAsyncHandler;
+
+private:
+    MQNativeTransport(const MQNativeTransport&);
+    MQNativeTransport& operator=(const MQNativeTransport&);
+};
+
+}
+}
+}
+
+#endif
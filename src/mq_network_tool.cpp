@@ -1,16 +1,24 @@
 #include <time.h>
+// the SHA1 context API is deprecated by OpenSSL 3.0 but kept, Sign copies its states
+#define OPENSSL_SUPPRESS_DEPRECATED
 #ifdef _WIN32
 #include "openssl/hmac.h"
+#include "openssl/sha.h"
 #include "openssl/evp.h"
 #include "openssl/bio.h"
 #include "openssl/buffer.h"
 #else
 #include <openssl/hmac.h>
+#include <openssl/sha.h>
 #include <openssl/evp.h>
 #include <openssl/bio.h>
 #include <openssl/buffer.h>
 #endif
 #include <errno.h>
+#include <ctype.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 #include "pugixml.hpp"
 #include "mq_common_tool.h"
 #include "mq_network_tool.h"
@@ -18,253 +26,1790 @@
 #include "constants.h"
 #include <ctime>
 #include <iostream>
+#include <algorithm>
+
+using namespace std;
+using namespace mq::http::sdk;
+
+static int32_t BUFFER_SIZE = 10240;
+
+static size_t Stream_read(void *buffer, size_t size, size_t nmemb, void* stream)
+{
+    CurlBodyReader* reader = static_cast<CurlBodyReader*>(stream);
+    char* out = static_cast<char*>(buffer);
+    size_t room = size * nmemb;
+    size_t written = 0;
+    while (written < room && reader->index < reader->segments->size())
+    {
+        const RequestBodySegment& segment = (*reader->segments)[reader->index];
+        size_t count = segment.size - reader->offset;
+        if (count > room - written)
+        {
+            count = room - written;
+        }
+        memcpy(out + written, segment.data + reader->offset, count);
+        written += count;
+        reader->offset += count;
+        if (reader->offset == segment.size)
+        {
+            reader->index++;
+            reader->offset = 0;
+        }
+    }
+    return written;
+}
+
+// curl rewinds the body when it resends on a new connection
+static int Stream_seek(void* stream, curl_off_t offset, int origin)
+{
+    CurlBodyReader* reader = static_cast<CurlBodyReader*>(stream);
+    if (origin != SEEK_SET || offset < 0)
+    {
+        return CURL_SEEKFUNC_CANTSEEK;
+    }
+    size_t remain = (size_t)offset;
+    reader->index = 0;
+    reader->offset = 0;
+    while (reader->index < reader->segments->size())
+    {
+        size_t segmentSize = (*reader->segments)[reader->index].size;
+        if (remain < segmentSize)
+        {
+            reader->offset = remain;
+            return CURL_SEEKFUNC_OK;
+        }
+        remain -= segmentSize;
+        reader->index++;
+    }
+    return remain == 0 ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_FAIL;
+}
+
+static size_t Stream_discard(void* /*buffer*/, size_t size, size_t nmemb, void* /*stream*/)
+{
+    return size*nmemb;
+}
+
+static size_t Stream_write(void *buffer, size_t size, size_t nmemb, void* stream)
+{
+    Response* resp = static_cast<Response *>(stream);
+    std::string* body = resp->getRawDataPtr();
+    body->append(static_cast<char *>(buffer), size*nmemb);
+    // parse along with the transfer where the response can
+    resp->onBodyReceived(body->size());
+    return size*nmemb;
+}
+
+static inline bool IsHeaderSpace(const char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// one header line at a time, only Content-Length is looked at unless headers are retained
+static size_t Header_write(void *buffer, size_t size, size_t nmemb, void* stream)
+{
+    static const char kContentLength[] = "content-length";
+    static const size_t kContentLengthSize = sizeof(kContentLength) - 1;
+
+    CurlTransfer* transfer = static_cast<CurlTransfer*>(stream);
+    Response* resp = transfer != NULL ? transfer->response : NULL;
+    const char* line = static_cast<const char*>(buffer);
+    size_t length = size * nmemb;
+    if (resp == NULL)
+    {
+        return length;
+    }
+    // a 100 Continue or a redirect is followed by the headers of the final response
+    if (length >= 5 && memcmp(line, "HTTP/", 5) == 0)
+    {
+        resp->resetHeaders();
+        return length;
+    }
+    const char* colon = static_cast<const char*>(memchr(line, ':', length));
+    if (colon == NULL)
+    {
+        return length;
+    }
+    const char* nameEnd = colon;
+    while (nameEnd > line && IsHeaderSpace(nameEnd[-1]))
+    {
+        --nameEnd;
+    }
+    const char* value = colon + 1;
+    const char* valueEnd = line + length;
+    while (value < valueEnd && IsHeaderSpace(*value))
+    {
+        ++value;
+    }
+    while (valueEnd > value && IsHeaderSpace(valueEnd[-1]))
+    {
+        --valueEnd;
+    }
+    size_t nameSize = nameEnd - line;
+
+    // size the body buffer once instead of growing it chunk by chunk
+    if (nameSize == kContentLengthSize)
+    {
+        size_t i = 0;
+        while (i < kContentLengthSize && tolower((unsigned char)line[i]) == kContentLength[i])
+        {
+            ++i;
+        }
+        if (i == kContentLengthSize)
+        {
+            size_t contentLength = 0;
+            for (const char* digit = value; digit < valueEnd && *digit >= '0' && *digit <= '9'; ++digit)
+            {
+                contentLength = contentLength * 10 + (*digit - '0');
+            }
+            resp->reserveRawData(contentLength);
+        }
+    }
+    resp->appendHeader(line, nameSize, value, valueEnd - value);
+    return length;
+}
+
+void MQNetworkTool::SendRequest(const std::string& endpoint,
+                                 Request& req,
+                                 Response& resp,
+                                 MQConnectionToolPtr mqConTool)
+{
+    if (mqConTool->IsMultiplexed())
+    {
+        SendMultiplexedRequest(endpoint, req, resp, mqConTool->GetAsyncHandler());
+        return;
+    }
+
+    int retry = 3;
+    while (true)
+    {
+        try
+        {
+            CurlTransfer transfer;
+            transfer.curl = mqConTool->InvokeCurlConnection(transfer.isLongConnection, req.getRequestClass());
+            PrepareTransfer(endpoint, req, resp, transfer);
+
+            CURLcode curlret;
+            curlret = curl_easy_perform(transfer.curl);
+            mqConTool->RevokeCurlConnection(transfer.curl, transfer.isLongConnection,
+                curlret != CURLE_OK);
+            CompleteTransfer(curlret, transfer, resp);
+            resp.parseResponse();
+            return;
+        }
+        catch (MQExceptionBase& e)
+        {
+            if (retry > 0 && resp.getStatus() >= 500)
+            {
+                retry--;
+                continue;
+            }
+            throw;
+        }
+    }
+}
+
+namespace
+{
+
+/*
+ * a blocking request parked on the async handler, retries happen on the loop
+ */
+class BlockingTransfer : public AsyncTransfer
+{
+public:
+    BlockingTransfer(const std::string& endpoint, Request& req, Response& resp)
+        : AsyncTransfer(endpoint)
+        , mRequest(req)
+        , mResponse(resp)
+        , mDone(false)
+        , mFailed(false)
+        , mServerFailed(false)
+        , mServerException(ErrorInfo())
+    {
+    }
+
+    Request& getRequest() { return mRequest; }
+    Response& getResponse() { return mResponse; }
+
+    void onSuccess()
+    {
+        PTScopedLock lock(mWaitObject);
+        mDone = true;
+        mWaitObject.signal();
+    }
+
+    void onFailed(const MQExceptionBase& e)
+    {
+        PTScopedLock lock(mWaitObject);
+        const MQServerException* serverException = dynamic_cast<const MQServerException*>(&e);
+        if (serverException != NULL)
+        {
+            mServerException = *serverException;
+            mServerFailed = true;
+        }
+        else
+        {
+            mException = e;
+            mFailed = true;
+        }
+        mDone = true;
+        mWaitObject.signal();
+    }
+
+    void wait()
+    {
+        PTScopedLock lock(mWaitObject);
+        while (!mDone)
+        {
+            mWaitObject.wait();
+        }
+        if (mServerFailed)
+        {
+            throw mServerException;
+        }
+        if (mFailed)
+        {
+            throw mException;
+        }
+    }
+
+private:
+    Request& mRequest;
+    Response& mResponse;
+    WaitObject mWaitObject;
+    bool mDone;
+    bool mFailed;
+    bool mServerFailed;
+    MQExceptionBase mException;
+    MQServerException mServerException;
+};
+
+}
+
+void MQNetworkTool::SendMultiplexedRequest(const std::string& endpoint,
+                                            Request& req,
+                                            Response& resp,
+                                            MQAsyncHandlerPtr asyncHandler)
+{
+    BlockingTransfer* transfer = new BlockingTransfer(endpoint, req, resp);
+    AsyncTransferPtr transferPtr(transfer);
+    asyncHandler->submit(transferPtr);
+    transfer->wait();
+}
+
+static void SetRequestBody(Request& req, CurlTransfer& transfer)
+{
+    CURL* curl = transfer.curl;
+    const std::vector<RequestBodySegment>& segments = req.getBodySegments();
+    if (segments.size() == 1)
+    {
+        // curl sends straight from the serialized body, it is not copied
+        curl_easy_setopt( curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)segments[0].size);
+        curl_easy_setopt( curl, CURLOPT_POSTFIELDS, segments[0].data);
+        return;
+    }
+    // several segments are read in place, one curl buffer at a time
+    transfer.body.segments = &segments;
+    transfer.body.index = 0;
+    transfer.body.offset = 0;
+    curl_easy_setopt( curl, CURLOPT_POSTFIELDS, NULL);
+    curl_easy_setopt( curl, CURLOPT_POST, 1L);
+    curl_easy_setopt( curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)req.getBodySize());
+    curl_easy_setopt( curl, CURLOPT_READFUNCTION, &Stream_read);
+    curl_easy_setopt( curl, CURLOPT_READDATA, (void *)(&transfer.body));
+    curl_easy_setopt( curl, CURLOPT_SEEKFUNCTION, &Stream_seek);
+    curl_easy_setopt( curl, CURLOPT_SEEKDATA, (void *)(&transfer.body));
+}
+
+MQRequestTemplate::MQRequestTemplate(const std::string& endpoint, const bool withBody)
+{
+    size_t pos = endpoint.find_first_of("//");
+    AddHeader(HOST, endpoint.substr(pos + 2));
+    AddHeader(CONTENT_TYPE, DEFAULT_CONTENT_TYPE);
+    AddHeader(MQ_VERSION, CURRENT_VERSION);
+    mLines.push_back("Connection: keep-alive");
+    if (withBody)
+    {
+        // large bodies would wait a round trip for 100-continue
+        mLines.push_back("Expect:");
+    }
+
+    // mLines does not change any more, link the list over it
+    mNodes.resize(mLines.size());
+    for (size_t i = 0; i < mLines.size(); ++i)
+    {
+        mNodes[i].data = const_cast<char*>(mLines[i].c_str());
+        mNodes[i].next = i + 1 < mLines.size() ? &mNodes[i + 1] : NULL;
+    }
+}
+
+void MQRequestTemplate::AddHeader(const std::string& name, const std::string& value)
+{
+    mHeaders[name] = value;
+    mLines.push_back(name + ":" + value);
+}
+
+bool MQRequestTemplate::Covers(const std::string& name, const std::string& value) const
+{
+    std::map<std::string, std::string>::const_iterator iter = mHeaders.find(name);
+    return iter != mHeaders.end() && iter->second == value;
+}
+
+static CurlHandleState* GetHandleState(CURL* curl)
+{
+    CurlHandleState* state = NULL;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&state);
+    return state;
+}
+
+static std::string& NextHeaderLine(CurlHandleState& state, size_t& lineCount)
+{
+    if (state.headerLines.size() <= lineCount)
+    {
+        state.headerLines.push_back(std::string());
+    }
+    return state.headerLines[lineCount++];
+}
+
+// link the first lineCount lines of the handle in front of tail
+static curl_slist* LinkHeaderLines(CurlHandleState& state, const size_t lineCount, curl_slist* tail)
+{
+    if (state.headerNodes.size() < lineCount)
+    {
+        state.headerNodes.resize(lineCount);
+    }
+    for (size_t i = 0; i < lineCount; ++i)
+    {
+        state.headerNodes[i].data = const_cast<char*>(state.headerLines[i].c_str());
+        state.headerNodes[i].next = i + 1 < lineCount ? &state.headerNodes[i + 1] : tail;
+    }
+    return lineCount > 0 ? &state.headerNodes[0] : tail;
+}
+
+void MQNetworkTool::PrepareTransfer(const std::string& endpoint,
+                                     Request& req,
+                                     Response& resp,
+                                     CurlTransfer& transfer)
+{
+    // timeouts, callbacks and the like were set when the handle was created
+    CURL* curl = transfer.curl;
+    CurlHandleState& state = *GetHandleState(curl);
+    const MQRequestTemplate* requestTemplate = req.getTemplate().get();
+
+    size_t lineCount = 0;
+    const std::map<std::string, std::string>& headers = req.getHeaders();
+    for (std::map<std::string, std::string>::const_iterator iter = headers.begin();
+        iter != headers.end(); iter++)
+    {
+        if (requestTemplate != NULL && requestTemplate->Covers(iter->first, iter->second))
+        {
+            continue;
+        }
+        NextHeaderLine(state, lineCount).assign(iter->first).append(":").append(iter->second);
+    }
+    if (requestTemplate == NULL)
+    {
+        NextHeaderLine(state, lineCount).assign("Connection: keep-alive");
+        if (req.getBodySize() > 0)
+        {
+            // large bodies would wait a round trip for 100-continue
+            NextHeaderLine(state, lineCount).assign("Expect:");
+        }
+    }
+    transfer.header = LinkHeaderLines(state, lineCount,
+        requestTemplate != NULL ? requestTemplate->GetHeaderList() : NULL);
+
+    // curl keeps its own copy of the url, consume loops send the same one again and again
+    const std::string& resource = req.getCanonicalizedResource();
+    if (state.url.size() != endpoint.size() + resource.size()
+        || state.url.compare(0, endpoint.size(), endpoint) != 0
+        || state.url.compare(endpoint.size(), std::string::npos, resource) != 0)
+    {
+        state.url.assign(endpoint).append(resource);
+        curl_easy_setopt( curl, CURLOPT_URL, state.url.c_str());
+    }
+    curl_easy_setopt( curl, CURLOPT_HTTPHEADER, transfer.header);
+    if (!transfer.isLongConnection)
+        curl_easy_setopt( curl, CURLOPT_FORBID_REUSE, 1);
+    resp.clearRawData();
+    curl_easy_setopt( curl, CURLOPT_WRITEDATA, (void *)(&resp));
+    resp.resetHeaders();
+    transfer.response = &resp;
+    curl_easy_setopt( curl, CURLOPT_HEADERDATA, (void *)(&transfer));
+    // handles are reused, drop the post state a previous request may have left
+    curl_easy_setopt( curl, CURLOPT_HTTPGET, 1);
+    const std::string& method = req.getMethod();
+    if (method == "PUT" || method == "POST" || method == "DELETE")
+    {
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
+        if (req.getBodySize() > 0)
+        {
+            SetRequestBody(req, transfer);
+        }
+    }
+    else if (method == "GET")
+    {
+        curl_easy_setopt( curl, CURLOPT_CUSTOMREQUEST, "GET");
+    }
+}
+
+void MQNetworkTool::CompleteTransfer(CURLcode curlret,
+                                      CurlTransfer& transfer,
+                                      Response& resp)
+{
+    transfer.header = NULL;
+    if (curlret != CURLE_OK)
+    {
+        string errMes = "Curl Send Request Fail, errorcode:" + StringTool::ToString(curlret) + " errno:" + StringTool::ToString(errno) + " errorStr:" + StringTool::ToString(curl_easy_strerror(curlret));
+        MQ_THROW(MQExceptionBase, errMes);
+    }
+    // the headers were parsed as they arrived
+    long status = 0;
+    curl_easy_getinfo(transfer.curl, CURLINFO_RESPONSE_CODE, &status);
+    resp.setStatus((int32_t)status);
+}
+
+std::string MQNetworkTool::Signature(const std::string& method,
+                                      const std::string& canonicalizedResource,
+                                      const std::string& accessId,
+                                      const std::string& accessKey,
+                                      const std::map<string, string>& headers,
+                                      MQSignatureCache* cache)
+{
+    ostringstream os;
+	os << method << '\n';
+#define APPEND_IF_EXIST(key, newline) \
+    {\
+        std::map<string, string>::const_iterator iter = headers.find(string(key)); \
+        if (iter != headers.end()) \
+        os << iter->second; \
+        if (newline) \
+        os << '\n'; \
+    }
+    APPEND_IF_EXIST(CONTENT_MD5, true);
+    APPEND_IF_EXIST(CONTENT_TYPE, true);
+    APPEND_IF_EXIST(DATE, true);
+	std::map<string, string>::const_iterator iter = headers.lower_bound(CANONICALIZED_MQ_HEADER_PREFIX);
+    while (iter != headers.end() && StringTool::StartWith(iter->first, CANONICALIZED_MQ_HEADER_PREFIX))
+    {
+        os << iter->first << ':' << iter->second << '\n';
+        ++iter;
+    }
+#undef APPEND_IF_EXIST
+    os << canonicalizedResource;
+    if (cache == NULL)
+    {
+        return Sign(os.str(), accessId, accessKey);
+    }
+
+    string stringToSign = os.str();
+    string signature;
+    if (!cache->Get(stringToSign, accessId, accessKey, signature))
+    {
+        signature = Sign(stringToSign, accessId, accessKey);
+        cache->Put(stringToSign, accessId, accessKey, signature);
+    }
+    return signature;
+}
+
+int32_t MQSignatureCache::StripeOf(const std::string& stringToSign)
+{
+    // FNV-1a, the Date line and the resource differ between strings
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < stringToSign.size(); ++i)
+    {
+        hash = (hash ^ (unsigned char)stringToSign[i]) * 16777619u;
+    }
+    return (int32_t)(hash % kStripes);
+}
+
+bool MQSignatureCache::Get(const std::string& stringToSign,
+                           const std::string& accessId,
+                           const std::string& accessKey,
+                           std::string& signature)
+{
+    Stripe& stripe = mStripes[StripeOf(stringToSign)];
+    PTScopedLock lock(stripe.mutex);
+    for (int32_t i = 0; i < kEntriesPerStripe; ++i)
+    {
+        const Entry& entry = stripe.entries[i];
+        if (entry.stringToSign == stringToSign && entry.accessKey == accessKey
+            && entry.accessId == accessId && !entry.signature.empty())
+        {
+            signature = entry.signature;
+            mHits.fetch_add(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void MQSignatureCache::Put(const std::string& stringToSign,
+                           const std::string& accessId,
+                           const std::string& accessKey,
+                           const std::string& signature)
+{
+    Stripe& stripe = mStripes[StripeOf(stringToSign)];
+    PTScopedLock lock(stripe.mutex);
+    Entry& entry = stripe.entries[stripe.next];
+    stripe.next = (stripe.next + 1) % kEntriesPerStripe;
+    entry.stringToSign = stringToSign;
+    entry.accessId = accessId;
+    entry.accessKey = accessKey;
+    entry.signature = signature;
+}
+
+/*
+ * HMAC-SHA1 with the key already hashed into the inner and outer states,
+ * a signature is two copies of SHA_CTX and the hashing of data.
+ */
+struct HmacSha1Key
+{
+    HmacSha1Key()
+        : ready(false)
+    {
+    }
+
+    void Reset(const std::string& newKey)
+    {
+        unsigned char block[SHA_CBLOCK];
+        memset(block, 0, sizeof(block));
+        if (newKey.size() > sizeof(block))
+        {
+            SHA1((const unsigned char*) newKey.data(), newKey.size(), block);
+        }
+        else
+        {
+            memcpy(block, newKey.data(), newKey.size());
+        }
+
+        unsigned char pad[SHA_CBLOCK];
+        for (size_t i = 0; i < sizeof(pad); ++i)
+            pad[i] = block[i] ^ 0x36;
+        SHA1_Init(&inner);
+        SHA1_Update(&inner, pad, sizeof(pad));
+        for (size_t i = 0; i < sizeof(pad); ++i)
+            pad[i] = block[i] ^ 0x5c;
+        SHA1_Init(&outer);
+        SHA1_Update(&outer, pad, sizeof(pad));
+
+        key = newKey;
+        ready = true;
+    }
+
+    void Sign(const char* data, const size_t size, unsigned char* digest) const
+    {
+        SHA_CTX ctx = inner;
+        SHA1_Update(&ctx, data, size);
+        SHA1_Final(digest, &ctx);
+        ctx = outer;
+        SHA1_Update(&ctx, digest, SHA_DIGEST_LENGTH);
+        SHA1_Final(digest, &ctx);
+    }
+
+    bool ready;
+    std::string key;
+    SHA_CTX inner;
+    SHA_CTX outer;
+};
+
+string MQNetworkTool::Sign(const std::string& data, const std::string& accessId, const std::string& accessKey)
+{
+    // one key per thread, a thread signs for the same credential nearly always
+    static thread_local HmacSha1Key sKey;
+    if (!sKey.ready || sKey.key != accessKey)
+    {
+        sKey.Reset(accessKey);
+    }
+    unsigned char sha1sum[SHA_DIGEST_LENGTH];
+    sKey.Sign(data.data(), data.size(), sha1sum);
+    char base64[32];
+    size_t base64len = Base64Tool::Base64Encoding((const char*) sha1sum, SHA_DIGEST_LENGTH, base64);
+    string signature;
+    signature.reserve(4 + accessId.size() + base64len);
+    signature.append("MQ ").append(accessId).append(":").append(base64, base64len);
+    return signature;
+}
+
+string MQNetworkTool::Base64(const char *input, unsigned int& length)
+{
+    string output(Base64Tool::EncodedLength(length), '\0');
+    output.resize(Base64Tool::Base64Encoding(input, length, &output[0]));
+    return output;
+}
+
+static int32_t DefaultShardCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long cpus = info.dwNumberOfProcessors;
+#else
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return cpus > 0 ? (int32_t)cpus : 1;
+}
+
+static void SetKeepAliveOptions(CURL* curl, const MQConnectionConfig& config)
+{
+    if (!config.tcpKeepAlive)
+    {
+        return;
+    }
+    curl_easy_setopt( curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt( curl, CURLOPT_TCP_KEEPIDLE, (long)config.tcpKeepIdleSeconds);
+    curl_easy_setopt( curl, CURLOPT_TCP_KEEPINTVL, (long)config.tcpKeepIntervalSeconds);
+}
+
+// options that never change for a handle, set once when it is created
+static void SetStaticOptions(CURL* curl, const MQConnectionConfig& config)
+{
+    curl_easy_setopt( curl, CURLOPT_NOSIGNAL, 1);
+    curl_easy_setopt( curl, CURLOPT_TIMEOUT, config.timeout);
+    curl_easy_setopt( curl, CURLOPT_CONNECTTIMEOUT, config.connectTimeout);
+    curl_easy_setopt( curl, CURLOPT_BUFFERSIZE, BUFFER_SIZE);
+    curl_easy_setopt( curl, CURLOPT_USERAGENT, AGENT);
+    curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, &Stream_write);
+    curl_easy_setopt( curl, CURLOPT_HEADERFUNCTION, &Header_write);
+    SetKeepAliveOptions(curl, config);
+}
+
+static uint32_t NextShardSlot()
+{
+    static std::atomic<uint32_t> sNextSlot(0);
+    return sNextSlot.fetch_add(1);
+}
+
+MQCurlShare::MQCurlShare(const bool shareDnsAndTls, const bool shareConnections)
+{
+    mShare = curl_share_init();
+    if (mShare == NULL)
+    {
+        MQ_THROW(MQExceptionBase, "curl_share_init failed");
+    }
+    curl_share_setopt(mShare, CURLSHOPT_LOCKFUNC, &MQCurlShare::Lock);
+    curl_share_setopt(mShare, CURLSHOPT_UNLOCKFUNC, &MQCurlShare::Unlock);
+    curl_share_setopt(mShare, CURLSHOPT_USERDATA, this);
+    if (shareDnsAndTls)
+    {
+        curl_share_setopt(mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+#if LIBCURL_VERSION_NUM >= 0x073900
+    if (shareConnections)
+    {
+        curl_share_setopt(mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+#else
+    (void)shareConnections;
+#endif
+}
+
+MQCurlShare::~MQCurlShare()
+{
+    curl_share_cleanup(mShare);
+}
+
+void MQCurlShare::Lock(CURL* /*curl*/, curl_lock_data data, curl_lock_access /*access*/, void* userptr)
+{
+    if (data < 0 || data >= CURL_LOCK_DATA_LAST)
+    {
+        return;
+    }
+    static_cast<MQCurlShare*>(userptr)->mLocks[data].lock();
+}
+
+void MQCurlShare::Unlock(CURL* /*curl*/, curl_lock_data data, void* userptr)
+{
+    if (data < 0 || data >= CURL_LOCK_DATA_LAST)
+    {
+        return;
+    }
+    static_cast<MQCurlShare*>(userptr)->mLocks[data].unlock();
+}
+
+/*
+ * closes idle and expired connections, and the quarantined ones as soon as they come in
+ */
+class MQCurlPool::Reaper : public PTThread
+{
+public:
+    Reaper(MQCurlPool& pool) : mPool(pool), mStopping(false)
+    {
+    }
+
+    void stop()
+    {
+        {
+            PTScopedLock lock(mWaitObject);
+            mStopping = true;
+            mWaitObject.signal();
+        }
+        join();
+    }
+
+    void wake()
+    {
+        PTScopedLock lock(mWaitObject);
+        mWaitObject.signal();
+    }
+
+protected:
+    void run()
+    {
+        int64_t intervalUs = (int64_t)(mPool.mConfig.reaperIntervalMs > 0 ? mPool.mConfig.reaperIntervalMs : 5000) * 1000;
+        while (true)
+        {
+            {
+                PTScopedLock lock(mWaitObject);
+                if (mStopping)
+                {
+                    return;
+                }
+                mWaitObject.wait(intervalUs);
+                if (mStopping)
+                {
+                    return;
+                }
+            }
+            mPool.Reap();
+            if (mPool.mConfig.autoSizePool)
+            {
+                mPool.AutoSize();
+            }
+        }
+    }
+
+private:
+    MQCurlPool& mPool;
+    WaitObject mWaitObject;
+    bool mStopping;
+};
+
+// auto sizing grows the pool when more than 1% of the acquires overflowed or
+// failed, or the average wait with POOL_EXHAUSTED_BLOCK reached this
+static const int64_t kAutoSizeGrowWaitMs = 10;
+
+static int32_t ClampPoolSize(const MQConnectionConfig& config, const int32_t capacity)
+{
+    if (!config.autoSizePool)
+    {
+        return capacity;
+    }
+    int32_t minSize = config.minConnPoolSize > 0 ? config.minConnPoolSize : 1;
+    int32_t maxSize = config.maxConnPoolSize > minSize ? config.maxConnPoolSize : minSize;
+    return capacity < minSize ? minSize : (capacity > maxSize ? maxSize : capacity);
+}
+
+MQCurlPool::MQCurlPool(const MQConnectionConfig& config, const int32_t capacity,
+    MQCurlSharePtr share)
+    : mConfig(config)
+    , mCapacity(ClampPoolSize(config, capacity))
+    , mShare(share)
+    , mCurrentSize(0)
+    , mWaiters(0)
+    , mInUseTotal(0)
+    , mPeakInUse(0)
+    , mAcquireCount(0)
+    , mOverflowCount(0)
+    , mExhaustedCount(0)
+    , mWaitCount(0)
+    , mWaitTimeMs(0)
+    , mLastAcquireCount(0)
+    , mLastPressureCount(0)
+    , mLastWaitCount(0)
+    , mLastWaitTimeMs(0)
+    , mGrowCount(0)
+    , mShrinkCount(0)
+    , mLastResizeFrom(0)
+    , mLastResizeTo(0)
+    , mReaper(NULL)
+{
+    int32_t shardCount = config.poolShardCount > 0 ? config.poolShardCount : DefaultShardCount();
+    if (shardCount > mCapacity)
+        shardCount = mCapacity;
+    if (shardCount < 1)
+        shardCount = 1;
+    for (int32_t i = 0; i < shardCount; i++)
+    {
+        mShards.push_back(new Shard());
+    }
+
+    for (int32_t i = 0; i < REQUEST_CLASS_COUNT; i++)
+    {
+        mInUse[i] = 0;
+    }
+    mInUseShared = 0;
+    SetClassLimits(mCapacity);
+
+    mReaper = new Reaper(*this);
+    mReaper->start();
+}
+
+MQCurlPool::~MQCurlPool()
+{
+    mReaper->stop();
+    delete mReaper;
+    for (std::vector<Shard*>::iterator iter = mShards.begin(); iter != mShards.end(); ++iter)
+    {
+        Shard* shard = *iter;
+        {
+            PTScopedLock lock(shard->mutex);
+            for (std::vector<IdleHandle>::iterator it = shard->idle.begin(); it != shard->idle.end(); ++it)
+            {
+                DestroyHandle(it->curl);
+            }
+            shard->idle.clear();
+        }
+        delete shard;
+    }
+    for (std::vector<CURL*>::iterator iter = mRetired.begin(); iter != mRetired.end(); ++iter)
+    {
+        DestroyHandle(*iter);
+    }
+}
+
+size_t MQCurlPool::HomeShard() const
+{
+    // threads are spread round robin over the shards on first use, 0 is unassigned
+    static MQ_THREAD_LOCAL uint32_t sSlot = 0;
+    if (sSlot == 0)
+    {
+        sSlot = NextShardSlot() + 1;
+    }
+    return (sSlot - 1) % mShards.size();
+}
+
+void MQCurlPool::SetClassLimits(const int32_t capacity)
+{
+    // long polls park their handle for up to waitSeconds, by default they may hold
+    // half of the pool so the other half always serves publish and ack
+    int32_t classSize[REQUEST_CLASS_COUNT];
+    classSize[REQUEST_CLASS_DEFAULT] = capacity;
+    classSize[REQUEST_CLASS_LONG_POLL] = mConfig.longPollConnPoolSize > 0 ?
+        mConfig.longPollConnPoolSize : (capacity + 1) / 2;
+    classSize[REQUEST_CLASS_PUBLISH] = mConfig.publishConnPoolSize > 0 ? mConfig.publishConnPoolSize : capacity;
+    classSize[REQUEST_CLASS_ACK] = mConfig.ackConnPoolSize > 0 ? mConfig.ackConnPoolSize : capacity;
+    for (int32_t i = 0; i < REQUEST_CLASS_COUNT; i++)
+    {
+        mClassLimit[i] = classSize[i] < capacity ? classSize[i] : capacity;
+    }
+
+    // acks keep a slice of the pool to themselves, the other classes always leave one handle
+    int32_t ackReserved = mConfig.ackReservedConnPoolSize != 0 ?
+        mConfig.ackReservedConnPoolSize : (capacity + 9) / 10;
+    if (ackReserved > capacity - 1)
+    {
+        ackReserved = capacity - 1;
+    }
+    if (ackReserved < 0)
+    {
+        ackReserved = 0;
+    }
+    mSharedLimit = capacity - ackReserved;
+}
+
+bool MQCurlPool::IsExpired(CURL* curl, const int64_t idleSinceMs, const int64_t now) const
+{
+    if (mConfig.maxIdleTimeMs > 0 && now - idleSinceMs >= mConfig.maxIdleTimeMs)
+    {
+        return true;
+    }
+    if (mConfig.maxConnectionLifetimeMs > 0)
+    {
+        if (now - GetInfo(curl)->createdMs >= mConfig.maxConnectionLifetimeMs)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MQCurlPool::PushIdle(Shard* shard, CURL* curl, const int64_t now)
+{
+    IdleHandle idle;
+    idle.curl = curl;
+    idle.idleSinceMs = now;
+    PTScopedLock lock(shard->mutex);
+    shard->idle.push_back(idle);
+}
+
+CURL* MQCurlPool::TakeIdle(const size_t home, const bool blocking)
+{
+    int64_t now = TimeTool::GetMonotonicMs();
+    size_t count = mShards.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        Shard* shard = mShards[(home + i) % count];
+        // the home shard is always locked, others are only stolen from when free
+        if (i == 0 || blocking)
+        {
+            shard->mutex.lock();
+        }
+        else if (!shard->mutex.trylock())
+        {
+            continue;
+        }
+        // the most recently used handle first, expired ones on the way go to the reaper
+        CURL* curl = NULL;
+        std::vector<CURL*> expired;
+        while (curl == NULL && !shard->idle.empty())
+        {
+            IdleHandle idle = shard->idle.back();
+            shard->idle.pop_back();
+            if (IsExpired(idle.curl, idle.idleSinceMs, now))
+            {
+                expired.push_back(idle.curl);
+            }
+            else
+            {
+                curl = idle.curl;
+            }
+        }
+        shard->mutex.unlock();
+        for (std::vector<CURL*>::iterator iter = expired.begin(); iter != expired.end(); ++iter)
+        {
+            // the caller is short of a handle and takes the freed slot itself
+            Retire(*iter);
+        }
+        if (curl != NULL)
+        {
+            return curl;
+        }
+    }
+    return NULL;
+}
+
+void MQCurlPool::Retire(CURL* curl)
+{
+    {
+        PTScopedLock lock(mRetiredMutex);
+        mRetired.push_back(curl);
+    }
+    // the slot is free at once, closing the connection is left to the reaper,
+    // callers wake the waiters when they have one
+    mCurrentSize--;
+    mReaper->wake();
+}
+
+void MQCurlPool::Reap()
+{
+    std::vector<CURL*> closing;
+    {
+        PTScopedLock lock(mRetiredMutex);
+        closing.swap(mRetired);
+    }
+    int64_t now = TimeTool::GetMonotonicMs();
+    int32_t expired = 0;
+    for (std::vector<Shard*>::iterator iter = mShards.begin(); iter != mShards.end(); ++iter)
+    {
+        Shard* shard = *iter;
+        PTScopedLock lock(shard->mutex);
+        std::vector<IdleHandle>::iterator keep = shard->idle.begin();
+        for (std::vector<IdleHandle>::iterator it = shard->idle.begin(); it != shard->idle.end(); ++it)
+        {
+            if (IsExpired(it->curl, it->idleSinceMs, now))
+            {
+                closing.push_back(it->curl);
+                expired++;
+            }
+            else
+            {
+                *keep++ = *it;
+            }
+        }
+        shard->idle.erase(keep, shard->idle.end());
+    }
+    if (expired > 0)
+    {
+        mCurrentSize -= expired;
+        NotifyWaiters();
+    }
+    // after a shrink, close the oldest idle handles above the capacity
+    for (std::vector<Shard*>::iterator iter = mShards.begin(); iter != mShards.end(); ++iter)
+    {
+        int32_t excess = mCurrentSize.load() - mCapacity.load();
+        if (excess <= 0)
+        {
+            break;
+        }
+        Shard* shard = *iter;
+        PTScopedLock lock(shard->mutex);
+        int32_t count = (int32_t)shard->idle.size() < excess ? (int32_t)shard->idle.size() : excess;
+        for (int32_t i = 0; i < count; i++)
+        {
+            closing.push_back(shard->idle[i].curl);
+        }
+        shard->idle.erase(shard->idle.begin(), shard->idle.begin() + count);
+        mCurrentSize -= count;
+    }
+    // closing may send a TLS close notify, done without any pool lock held
+    for (std::vector<CURL*>::iterator iter = closing.begin(); iter != closing.end(); ++iter)
+    {
+        DestroyHandle(*iter);
+    }
+}
+
+void MQCurlPool::AutoSize()
+{
+    int64_t acquires = mAcquireCount.load();
+    int64_t pressure = mOverflowCount.load() + mExhaustedCount.load();
+    int64_t waits = mWaitCount.load();
+    int64_t waitTimeMs = mWaitTimeMs.load();
+    int64_t intervalAcquires = acquires - mLastAcquireCount;
+    int64_t intervalPressure = pressure - mLastPressureCount;
+    int64_t intervalWaits = waits - mLastWaitCount;
+    int64_t intervalWaitTimeMs = waitTimeMs - mLastWaitTimeMs;
+    mLastAcquireCount = acquires;
+    mLastPressureCount = pressure;
+    mLastWaitCount = waits;
+    mLastWaitTimeMs = waitTimeMs;
+    // the peak of the next interval starts from what is in use now
+    int32_t peak = mPeakInUse.exchange(mInUseTotal.load());
+
+    int32_t capacity = mCapacity.load();
+    int32_t target = capacity;
+    std::string reason;
+    if (intervalAcquires > 0 && intervalPressure * 100 > intervalAcquires)
+    {
+        target = capacity + (capacity / 4 > 0 ? capacity / 4 : 1);
+        reason = "overflow or exhausted " + StringTool::ToString(intervalPressure)
+            + " of " + StringTool::ToString(intervalAcquires) + " acquires";
+    }
+    else if (intervalWaits > 0 && intervalWaitTimeMs / intervalWaits >= kAutoSizeGrowWaitMs)
+    {
+        target = capacity + (capacity / 4 > 0 ? capacity / 4 : 1);
+        reason = "average acquire wait " + StringTool::ToString(intervalWaitTimeMs / intervalWaits) + "ms";
+    }
+    else if (peak * 2 < capacity)
+    {
+        // shrink by a quarter at most per interval, keeping twice the peak
+        target = capacity - (capacity / 4 > 0 ? capacity / 4 : 1);
+        if (target < peak * 2)
+        {
+            target = peak * 2;
+        }
+        reason = "peak in use " + StringTool::ToString(peak);
+    }
+    target = ClampPoolSize(mConfig, target);
+    if (target == capacity)
+    {
+        return;
+    }
+
+    mCapacity = target;
+    SetClassLimits(target);
+    {
+        PTScopedLock lock(mStatsMutex);
+        if (target > capacity)
+        {
+            mGrowCount++;
+        }
+        else
+        {
+            mShrinkCount++;
+        }
+        mLastResizeFrom = capacity;
+        mLastResizeTo = target;
+        mLastResizeReason = reason;
+    }
+    if (target > capacity)
+    {
+        NotifyWaiters();
+    }
+}
+
+MQConnectionPoolStats MQCurlPool::GetStats()
+{
+    MQConnectionPoolStats stats;
+    stats.capacity = mCapacity.load();
+    stats.openHandles = mCurrentSize.load();
+    stats.inUseHandles = mInUseTotal.load();
+    stats.acquireCount = mAcquireCount.load();
+    stats.overflowCount = mOverflowCount.load();
+    stats.exhaustedCount = mExhaustedCount.load();
+    stats.waitCount = mWaitCount.load();
+    stats.waitTimeMs = mWaitTimeMs.load();
+    PTScopedLock lock(mStatsMutex);
+    stats.growCount = mGrowCount;
+    stats.shrinkCount = mShrinkCount;
+    stats.lastResizeFrom = mLastResizeFrom;
+    stats.lastResizeTo = mLastResizeTo;
+    stats.lastResizeReason = mLastResizeReason;
+    return stats;
+}
+
+bool MQCurlPool::ReserveSlot()
+{
+    int32_t current = mCurrentSize.load();
+    while (current < mCapacity.load())
+    {
+        if (mCurrentSize.compare_exchange_weak(current, current + 1))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+CURL* MQCurlPool::CreateHandle()
+{
+    CURL* curl = curl_easy_init();
+    if (curl == NULL)
+    {
+        MQ_THROW(MQExceptionBase, "curl_easy_init failed");
+    }
+    SetStaticOptions(curl, mConfig);
+    if (mShare)
+    {
+        mShare->Attach(curl);
+    }
+    HandleInfo* info = new HandleInfo();
+    info->createdMs = TimeTool::GetMonotonicMs();
+    info->requestClass = -1;
+    curl_easy_setopt( curl, CURLOPT_PRIVATE, static_cast<CurlHandleState*>(info));
+    return curl;
+}
+
+void MQCurlPool::DestroyHandle(CURL* curl)
+{
+    HandleInfo* info = GetInfo(curl);
+    curl_easy_cleanup(curl);
+    delete info;
+}
+
+MQCurlPool::HandleInfo* MQCurlPool::GetInfo(CURL* curl)
+{
+    return static_cast<HandleInfo*>(GetHandleState(curl));
+}
+
+bool MQCurlPool::ReserveClassSlot(const RequestClass requestClass)
+{
+    std::atomic<int32_t>& inUse = mInUse[requestClass];
+    int32_t current = inUse.load();
+    bool reserved = false;
+    while (current < mClassLimit[requestClass].load())
+    {
+        if (inUse.compare_exchange_weak(current, current + 1))
+        {
+            reserved = true;
+            break;
+        }
+    }
+    if (!reserved || requestClass == REQUEST_CLASS_ACK)
+    {
+        return reserved;
+    }
+
+    // the ack slice is off limits to the other classes
+    current = mInUseShared.load();
+    while (current < mSharedLimit.load())
+    {
+        if (mInUseShared.compare_exchange_weak(current, current + 1))
+        {
+            return true;
+        }
+    }
+    inUse--;
+    return false;
+}
+
+void MQCurlPool::ReleaseClassSlot(const int32_t requestClass)
+{
+    mInUse[requestClass]--;
+    if (requestClass != REQUEST_CLASS_ACK)
+    {
+        mInUseShared--;
+    }
+}
+
+CURL* MQCurlPool::Acquire(bool& isLongConnection, const RequestClass requestClass)
+{
+    // acks must make their visibility window, they overflow rather than wait or fail
+    PoolExhaustedPolicy policy = requestClass == REQUEST_CLASS_ACK ?
+        POOL_EXHAUSTED_OVERFLOW : mConfig.poolExhaustedPolicy;
+    int64_t deadline = policy == POOL_EXHAUSTED_BLOCK ?
+        TimeTool::GetMonotonicMs() + mConfig.acquireTimeoutMs : 0;
+    mAcquireCount++;
+
+    bool reserved = ReserveClassSlot(requestClass);
+    if (!reserved && policy == POOL_EXHAUSTED_BLOCK)
+    {
+        int64_t start = TimeTool::GetMonotonicMs();
+        {
+            PTScopedLock lock(mWaitObject);
+            mWaiters++;
+            while (!(reserved = ReserveClassSlot(requestClass)))
+            {
+                int64_t remainMs = deadline - TimeTool::GetMonotonicMs();
+                if (remainMs <= 0)
+                {
+                    break;
+                }
+                mWaitObject.wait(remainMs * 1000);
+            }
+            mWaiters--;
+        }
+        mWaitCount++;
+        mWaitTimeMs += TimeTool::GetMonotonicMs() - start;
+    }
+    if (!reserved)
+    {
+        if (policy == POOL_EXHAUSTED_OVERFLOW)
+        {
+            mOverflowCount++;
+            isLongConnection = false;
+            return CreateHandle();
+        }
+        mExhaustedCount++;
+        if (policy == POOL_EXHAUSTED_FAIL_FAST)
+        {
+            MQ_THROW(MQExceptionBase, "Curl connection pool exhausted for request class:" + StringTool::ToString(requestClass)
+                + ", size:" + StringTool::ToString(mClassLimit[requestClass].load()));
+        }
+        MQ_THROW(MQExceptionBase, "Wait for curl connection timeout, request class:" + StringTool::ToString(requestClass)
+            + ", size:" + StringTool::ToString(mClassLimit[requestClass].load())
+            + " timeout(ms):" + StringTool::ToString(mConfig.acquireTimeoutMs));
+    }
+
+    CURL* curl = NULL;
+    try
+    {
+        curl = AcquireHandle(isLongConnection, policy, deadline);
+    }
+    catch (MQExceptionBase& e)
+    {
+        ReleaseClassSlot(requestClass);
+        NotifyWaiters();
+        throw;
+    }
+    GetInfo(curl)->requestClass = requestClass;
+    if (isLongConnection)
+    {
+        int32_t inUse = ++mInUseTotal;
+        int32_t peak = mPeakInUse.load();
+        while (inUse > peak && !mPeakInUse.compare_exchange_weak(peak, inUse))
+        {
+        }
+    }
+    return curl;
+}
+
+CURL* MQCurlPool::AcquireUnpooled(bool& isLongConnection)
+{
+    mAcquireCount++;
+    mOverflowCount++;
+    isLongConnection = false;
+    return CreateHandle();
+}
+
+CURL* MQCurlPool::AcquireHandle(bool& isLongConnection, const PoolExhaustedPolicy policy, const int64_t deadline)
+{
+    isLongConnection = true;
+    size_t home = HomeShard();
+    CURL* curl = TakeIdle(home, false);
+    if (curl != NULL)
+    {
+        return curl;
+    }
+    if (ReserveSlot())
+    {
+        try
+        {
+            return CreateHandle();
+        }
+        catch (MQExceptionBase& e)
+        {
+            mCurrentSize--;
+            throw;
+        }
+    }
+    // at capacity, a last locking pass before applying the policy
+    curl = TakeIdle(home, true);
+    if (curl != NULL)
+    {
+        return curl;
+    }
+
+    if (policy == POOL_EXHAUSTED_OVERFLOW)
+    {
+        mOverflowCount++;
+        isLongConnection = false;
+        return CreateHandle();
+    }
+    if (policy == POOL_EXHAUSTED_FAIL_FAST)
+    {
+        mExhaustedCount++;
+        MQ_THROW(MQExceptionBase, "Curl connection pool exhausted, size:" + StringTool::ToString(mCapacity.load()));
+    }
+
+    int64_t start = TimeTool::GetMonotonicMs();
+    PTScopedLock lock(mWaitObject);
+    mWaiters++;
+    while (true)
+    {
+        // a Release either left a handle we see here or sees mWaiters and signals,
+        // a retired or reaped handle leaves a free slot instead
+        curl = TakeIdle(home, true);
+        if (curl != NULL)
+        {
+            break;
+        }
+        if (ReserveSlot())
+        {
+            try
+            {
+                curl = CreateHandle();
+            }
+            catch (MQExceptionBase& e)
+            {
+                mCurrentSize--;
+                mWaiters--;
+                throw;
+            }
+            break;
+        }
+        int64_t remainMs = deadline - TimeTool::GetMonotonicMs();
+        if (remainMs <= 0)
+        {
+            break;
+        }
+        mWaitObject.wait(remainMs * 1000);
+    }
+    mWaiters--;
+    mWaitCount++;
+    mWaitTimeMs += TimeTool::GetMonotonicMs() - start;
+    if (curl == NULL)
+    {
+        mExhaustedCount++;
+        MQ_THROW(MQExceptionBase, "Wait for curl connection timeout, pool size:" + StringTool::ToString(mCapacity.load())
+            + " timeout(ms):" + StringTool::ToString(mConfig.acquireTimeoutMs));
+    }
+    return curl;
+}
+
+void MQCurlPool::NotifyWaiters()
+{
+    // waiters for a class slot and for a handle share the wait object, wake them all
+    if (mWaiters.load() > 0)
+    {
+        PTScopedLock lock(mWaitObject);
+        mWaitObject.broadcast();
+    }
+}
+
+void MQCurlPool::Release(CURL* curl, const bool isLongConnection, const bool failed)
+{
+    if (curl == NULL)
+    {
+        return;
+    }
+    HandleInfo* info = GetInfo(curl);
+    if (info->requestClass >= 0)
+    {
+        ReleaseClassSlot(info->requestClass);
+        info->requestClass = -1;
+    }
+    int64_t now = TimeTool::GetMonotonicMs();
+    if (!isLongConnection)
+    {
+        DestroyHandle(curl);
+        NotifyWaiters();
+        return;
+    }
+    mInUseTotal--;
+    // a pool shrunk by auto sizing drops handles as they come back
+    if (failed || IsExpired(curl, now, now) || mCurrentSize.load() > mCapacity.load())
+    {
+        Retire(curl);
+    }
+    else
+    {
+        PushIdle(mShards[HomeShard()], curl, now);
+    }
+    NotifyWaiters();
+}
+
+int32_t MQCurlPool::WarmUp(const std::string& endpoint, const int32_t count, const std::atomic<bool>& abort)
+{
+    std::vector<CURL*> handles;
+    for (int32_t i = 0; i < count && ReserveSlot(); i++)
+    {
+        try
+        {
+            handles.push_back(CreateHandle());
+        }
+        catch (MQExceptionBase& e)
+        {
+            mCurrentSize--;
+            break;
+        }
+    }
+    if (handles.empty())
+    {
+        return 0;
+    }
+
+    // a HEAD on the endpoint resolves, connects and handshakes, the status does not matter
+    std::string url = endpoint + "/";
+    // no response to fill, Header_write skips the lines of a transfer without one
+    CurlTransfer discard;
+    CURLM* multi = curl_multi_init();
+    for (std::vector<CURL*>::iterator iter = handles.begin(); iter != handles.end(); ++iter)
+    {
+        CURL* curl = *iter;
+        curl_easy_setopt( curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt( curl, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, &Stream_discard);
+        curl_easy_setopt( curl, CURLOPT_WRITEDATA, NULL);
+        curl_easy_setopt( curl, CURLOPT_HEADERDATA, (void *)(&discard));
+        curl_easy_setopt( curl, CURLOPT_TIMEOUT, mConfig.connectTimeout);
+        curl_multi_add_handle(multi, curl);
+    }
+
+    int running = (int)handles.size();
+    while (running > 0 && !abort.load())
+    {
+        curl_multi_perform(multi, &running);
+        if (running > 0)
+        {
+            curl_multi_wait(multi, NULL, 0, 100, NULL);
+        }
+    }
+
+    std::map<CURL*, bool> succeeded;
+    int left = 0;
+    CURLMsg* msg = NULL;
+    while ((msg = curl_multi_info_read(multi, &left)) != NULL)
+    {
+        if (msg->msg == CURLMSG_DONE)
+        {
+            long status = 0;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &status);
+            succeeded[msg->easy_handle] = msg->data.result == CURLE_OK && status > 0;
+        }
+    }
+
+    int32_t ready = 0;
+    for (std::vector<CURL*>::iterator iter = handles.begin(); iter != handles.end(); ++iter)
+    {
+        CURL* curl = *iter;
+        curl_multi_remove_handle(multi, curl);
+        std::map<CURL*, bool>::iterator result = succeeded.find(curl);
+        if (result == succeeded.end() || !result->second)
+        {
+            DestroyHandle(curl);
+            mCurrentSize--;
+            continue;
+        }
+        // back to what SetStaticOptions left, PrepareTransfer sets the url and the data pointers
+        curl_easy_setopt( curl, CURLOPT_NOBODY, 0L);
+        curl_easy_setopt( curl, CURLOPT_TIMEOUT, mConfig.timeout);
+        curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, &Stream_write);
+        curl_easy_setopt( curl, CURLOPT_HEADERDATA, NULL);
+        GetHandleState(curl)->url.clear();
+        // spread over the shards so every thread finds a hot handle at home
+        PushIdle(mShards[ready % mShards.size()], curl, TimeTool::GetMonotonicMs());
+        ready++;
+    }
+    curl_multi_cleanup(multi);
+
+    if (ready > 0)
+    {
+        NotifyWaiters();
+    }
+    return ready;
+}
+
+class MQConnectionPool::WarmUpThread : public PTThread
+{
+public:
+    WarmUpThread(MQConnectionPool& tool, const std::string& endpoint, const int32_t connections)
+        : mTool(tool), mEndPoint(endpoint), mConnections(connections)
+    {
+    }
+
+protected:
+    void run()
+    {
+        int32_t ready = 0;
+        try
+        {
+            ready = mTool.mCurlPool->WarmUp(mEndPoint, mConnections, mTool.mWarmUpAbort);
+        }
+        catch (...)
+        {
+        }
+        PTScopedLock lock(mTool.mWarmUpWaitObject);
+        mTool.mWarmUpDone = true;
+        mTool.mWarmUpComplete = ready >= mConnections;
+        mTool.mWarmUpWaitObject.broadcast();
+    }
+
+private:
+    MQConnectionPool& mTool;
+    std::string mEndPoint;
+    int32_t mConnections;
+};
+
+MQConnectionPool::MQConnectionPool(const MQConnectionConfig& config)
+    : mConfig(config)
+    , mWarmUpThread(NULL)
+    , mWarmUpAbort(false)
+    , mWarmUpDone(false)
+    , mWarmUpComplete(false)
+{
+    if (mConfig.shareDnsAndTlsCache || mConfig.shareConnectionCache)
+    {
+        mShare.reset(new MQCurlShare(mConfig.shareDnsAndTlsCache, mConfig.shareConnectionCache));
+    }
+    mCurlPool = new MQCurlPool(mConfig, mConfig.connPoolSize, mShare);
+}
+
+MQConnectionPool::~MQConnectionPool()
+{
+    if (mWarmUpThread != NULL)
+    {
+        mWarmUpAbort = true;
+        mWarmUpThread->join();
+        delete mWarmUpThread;
+    }
+    delete mCurlPool;
+}
+
+void MQConnectionPool::StartWarmUp(const std::string& endpoint, const int32_t connections)
+{
+    PTScopedLock lock(mWarmUpWaitObject);
+    if (mWarmUpThread != NULL)
+    {
+        return;
+    }
+    mWarmUpThread = new WarmUpThread(*this, endpoint, connections);
+    mWarmUpThread->start();
+}
+
+bool MQConnectionPool::WaitWarmUp(const int32_t timeoutMs)
+{
+    int64_t deadline = TimeTool::GetMonotonicMs() + timeoutMs;
+    PTScopedLock lock(mWarmUpWaitObject);
+    while (!mWarmUpDone)
+    {
+        int64_t remainMs = deadline - TimeTool::GetMonotonicMs();
+        if (remainMs <= 0)
+        {
+            return false;
+        }
+        mWarmUpWaitObject.wait(remainMs * 1000);
+    }
+    return mWarmUpComplete;
+}
+
+CURL* MQConnectionPool::InvokeCurlConnection(bool& isLongConnection, const RequestClass requestClass)
+{
+    return mCurlPool->Acquire(isLongConnection, requestClass);
+}
+
+CURL* MQConnectionPool::InvokeUnpooledConnection(bool& isLongConnection)
+{
+    return mCurlPool->AcquireUnpooled(isLongConnection);
+}
 
-using namespace std;
-using namespace mq::http::sdk;
+MQConnectionPoolStats MQConnectionPool::GetPoolStats()
+{
+    return mCurlPool->GetStats();
+}
 
-static int32_t BUFFER_SIZE = 10240;
+void MQConnectionPool::RevokeCurlConnection(CURL* curlConnection, const bool isLongConnection,
+    const bool failed)
+{
+    mCurlPool->Release(curlConnection, isLongConnection, failed);
+}
 
-static size_t Stream_read(void *buffer, size_t size, size_t nmemb, void* stream)
+MQAsyncHandlerPtr MQConnectionPool::GetAsyncHandler()
 {
-    memcpy(buffer, (*(static_cast<string *>(stream))).data(), (*(static_cast<string *>(stream))).size());
-    return (*(static_cast<string *>(stream))).size();
+    PTScopedLock lock(mAsyncHandlerMutex);
+    if (!mAsyncHandler)
+    {
+        mAsyncHandler.reset(new MQAsyncHandler(mConfig, mShare));
+    }
+    return mAsyncHandler;
 }
 
-static size_t Stream_write(void *buffer, size_t size, size_t nmemb, void* stream)
+std::string MQConnectionRegistry::MakeKey(const std::string& endpoint, const MQConnectionConfig& config)
 {
-    *(static_cast<string *>(stream)) += string(static_cast<char *>(buffer), size*nmemb);
-    return size*nmemb;
+    // everything that changes how connections are made keeps clients apart
+    std::string key = endpoint;
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    key += "|" + StringTool::ToString(config.connectTimeout);
+    key += "|" + StringTool::ToString(config.timeout);
+    key += config.enableHttp2 ? "|h2" : "|h1";
+    key += config.tcpKeepAlive ? "|ka" : "|noka";
+    key += config.shareConnectionCache ? "|sc" : "|nosc";
+    return key;
 }
 
-void MQNetworkTool::SendRequest(const std::string& endpoint,
-                                 Request& req,
-                                 Response& resp,
-                                 MQConnectionToolPtr mqConTool)
+MQConnectionPoolPtr MQConnectionRegistry::GetPool(const std::string& endpoint, const MQConnectionConfig& config)
 {
-    int retry = 3;
-    while (true)
+    static PTMutex sMutex;
+    static std::map<std::string, MQConnectionPoolWeakPtr> sPools;
+
+    std::string key = MakeKey(endpoint, config);
+    PTScopedLock lock(sMutex);
+    MQConnectionPoolPtr pool;
+    std::map<std::string, MQConnectionPoolWeakPtr>::iterator iter = sPools.find(key);
+    if (iter != sPools.end())
     {
-        try
+        pool = iter->second.lock();
+    }
+    if (!pool)
+    {
+        // drop entries of pools whose clients are all gone
+        for (iter = sPools.begin(); iter != sPools.end();)
         {
-            string receiveHeader;
-            bool isLongConnection = true;
-            CURL* curl = mqConTool->InvokeCurlConnection(isLongConnection);
-            curl_slist* header = NULL;
-            const std::map<std::string, std::string> headers = req.getHeaders();
-            for (std::map<std::string, std::string>::const_iterator iter = headers.begin();
-                iter != headers.end(); iter++)
-            {
-                header = curl_slist_append(header, (iter->first + ":" + iter->second).c_str());
-            }
-            header = curl_slist_append(header, "Connection: keep-alive");
-
-            std::string url = endpoint + req.getCanonicalizedResource();
-            curl_easy_setopt( curl, CURLOPT_NOSIGNAL, 1);
-            curl_easy_setopt( curl, CURLOPT_URL, url.c_str());
-            curl_easy_setopt( curl, CURLOPT_HTTPHEADER, header);
-            curl_easy_setopt( curl, CURLOPT_BUFFERSIZE, BUFFER_SIZE);
-            curl_easy_setopt( curl, CURLOPT_USERAGENT, AGENT);
-            if (!isLongConnection)
-                curl_easy_setopt( curl, CURLOPT_FORBID_REUSE, 1);
-            curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, &Stream_write);
-            resp.clearRawData();
-            curl_easy_setopt( curl, CURLOPT_WRITEDATA, (void *)(resp.getRawDataPtr()));
-            curl_easy_setopt( curl, CURLOPT_WRITEHEADER, (void *)(&receiveHeader));
-            if (req.getMethod() == "PUT" || req.getMethod() == "POST")
-            {
-                if (req.getMethod() == "PUT")
-                    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-                else
-                    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
-                const std::string& requestBody = req.getRequestBody();
-                if (requestBody != "")
-                {
-                    curl_easy_setopt( curl, CURLOPT_READFUNCTION, &Stream_read);
-                    curl_easy_setopt( curl, CURLOPT_READDATA, (void *)(&requestBody));
-                    curl_easy_setopt( curl, CURLOPT_INFILESIZE_LARGE, requestBody.size());
-                    curl_easy_setopt( curl, CURLOPT_POSTFIELDS, requestBody.data());
-                    curl_easy_setopt( curl, CURLOPT_POSTFIELDSIZE, requestBody.size());
-                }
-            }
-            else if (req.getMethod() == "GET")
-            {
-                curl_easy_setopt( curl, CURLOPT_CUSTOMREQUEST, "GET");
-            }
-            else if ( req.getMethod() == "DELETE" )
-            {
-                curl_easy_setopt( curl, CURLOPT_CUSTOMREQUEST, "DELETE");
-                const std::string& requestBody = req.getRequestBody();
-                if (requestBody != "")
-                {
-                    curl_easy_setopt( curl, CURLOPT_READDATA, (void *)(&requestBody));
-                    curl_easy_setopt( curl, CURLOPT_INFILESIZE_LARGE, requestBody.size());
-                    curl_easy_setopt( curl, CURLOPT_POSTFIELDS, requestBody.data());
-                    curl_easy_setopt( curl, CURLOPT_POSTFIELDSIZE, requestBody.size());
-                }
-            }
-
-            CURLcode curlret;
-            curlret = curl_easy_perform(curl);
-            curl_slist_free_all(header);
-            if (curlret != CURLE_OK)
-            {
-                string errMes = "Curl Send Request Fail, errorcode:" + StringTool::ToString(curlret) + " errno:" + StringTool::ToString(errno) + " errorStr:" + StringTool::ToString(curl_easy_strerror(curlret));
-                mqConTool->RevokeCurlConnection(curl, isLongConnection);
-                MQ_THROW(MQExceptionBase, errMes);
-                return;
-            }
-            vector<string> tmpVec = StringTool::StringToVector(receiveHeader, "\n");
-            for (vector<string>::iterator iter = tmpVec.begin(); iter != tmpVec.end(); ++iter)
+            if (iter->second.expired())
             {
-                if (iter->find(":") != string::npos)
-                {
-                    int pos = iter->find(":");
-                    resp.setHeader(
-                        StringTool::TrimString(iter->substr(0, pos)),
-                        StringTool::TrimString(iter->substr(pos+1)));
-                }
-                else if (iter->find("HTTP") != string::npos)
-                {
-                    vector<string> v = StringTool::StringToVector(*iter, " ");
-                    resp.setStatus(atoi(v[1].c_str()));
-                }
+                sPools.erase(iter++);
             }
-            mqConTool->RevokeCurlConnection(curl, isLongConnection);
-            resp.parseResponse();
-            return;
-        }
-        catch (MQExceptionBase& e)
-        {
-            if (retry > 0 && resp.getStatus() >= 500)
+            else
             {
-                retry--;
-                continue;
+                ++iter;
             }
-            throw;
         }
+        pool.reset(new MQConnectionPool(config));
+        sPools[key] = pool;
     }
+    return pool;
 }
 
-std::string MQNetworkTool::Signature(const std::string& method,
-                                      const std::string& canonicalizedResource,
-                                      const std::string& accessId,
-                                      const std::string& accessKey,
-                                      const std::map<string, string>& headers)
+MQConnectionTool::MQConnectionTool(const int32_t curlPoolSize, const int32_t connectTimeout,
+    const int32_t timeout)
+    : mClientPoolLimit(0)
+    , mPolicy(POOL_EXHAUSTED_OVERFLOW)
+    , mAcquireTimeoutMs(0)
+    , mInUse(0)
+    , mWaiters(0)
 {
-    ostringstream os;
-	os << method << '\n';
-#define APPEND_IF_EXIST(key, newline) \
-    {\
-        std::map<string, string>::const_iterator iter = headers.find(string(key)); \
-        if (iter != headers.end()) \
-        os << iter->second; \
-        if (newline) \
-        os << '\n'; \
-    }
-    APPEND_IF_EXIST(CONTENT_MD5, true);
-    APPEND_IF_EXIST(CONTENT_TYPE, true);
-    APPEND_IF_EXIST(DATE, true);
-	std::map<string, string>::const_iterator iter = headers.lower_bound(CANONICALIZED_MQ_HEADER_PREFIX);
-    while (iter != headers.end() && StringTool::StartWith(iter->first, CANONICALIZED_MQ_HEADER_PREFIX))
-    {
-        os << iter->first << ':' << iter->second << '\n';
-        ++iter;
-    }
-#undef APPEND_IF_EXIST
-    os << canonicalizedResource;
-    string stringToSign = os.str();
-    return Sign(stringToSign.c_str(), accessId, accessKey);
+    MQConnectionConfig config;
+    config.connPoolSize = curlPoolSize;
+    config.connectTimeout = connectTimeout;
+    config.timeout = timeout;
+    mPool.reset(new MQConnectionPool(config));
 }
 
-string MQNetworkTool::Sign(const char* data, const std::string& accessId, const std::string& accessKey)
+MQConnectionTool::MQConnectionTool(const MQConnectionConfig& config)
+    : mPool(new MQConnectionPool(config))
+    , mClientPoolLimit(config.clientPoolLimit)
+    , mPolicy(config.poolExhaustedPolicy)
+    , mAcquireTimeoutMs(config.acquireTimeoutMs)
+    , mInUse(0)
+    , mWaiters(0)
 {
-    char sha1sum[EVP_MAX_MD_SIZE];
-    unsigned int sha1len;
-    HMAC(EVP_sha1(), accessKey.c_str(), strlen(accessKey.c_str()), (const unsigned char*) data, strlen(data), (unsigned char*) sha1sum, &sha1len);
-    string base64_str = Base64(sha1sum, sha1len);
-    return "MQ " + accessId + ":" + base64_str;
 }
 
-string MQNetworkTool::Base64(const char *input, unsigned int& length)
+MQConnectionTool::MQConnectionTool(const MQConnectionConfig& config, const std::string& endpoint)
+    : mClientPoolLimit(config.clientPoolLimit)
+    , mPolicy(config.poolExhaustedPolicy)
+    , mAcquireTimeoutMs(config.acquireTimeoutMs)
+    , mInUse(0)
+    , mWaiters(0)
 {
-    istringstream eis;
-    ostringstream eos;
-    string str(input, length);
-    eis.str(str);
-    eos.str("");
-    Base64Encoding(eis, eos);
-    return eos.str();
+    if (config.sharePoolAcrossClients)
+    {
+        mPool = MQConnectionRegistry::GetPool(endpoint, config);
+    }
+    else
+    {
+        mPool.reset(new MQConnectionPool(config));
+    }
 }
 
 MQConnectionTool::~MQConnectionTool()
 {
-    int retry = mCurlPoolSize + 10;
-    do
+}
+
+bool MQConnectionTool::ReserveClientSlot()
+{
+    int32_t current = mInUse.load();
+    while (current < mClientPoolLimit)
     {
-        PTScopedLock lock(mWaitObject);
-        if (!mCurlPool.empty())
+        if (mInUse.compare_exchange_weak(current, current + 1))
         {
-            CURL* curl = mCurlPool.front();
-            if (curl)
-            {
-                mCurlPool.pop();
-                curl_easy_cleanup(curl);
-                mCurrentPoolSize--;
-            }
+            return true;
         }
-        else
-            mWaitObject.wait(1000);
-    }while(retry-- > 0);
+    }
+    return false;
 }
 
-CURL* MQConnectionTool::InvokeCurlConnection(bool& isLongConnection)
+CURL* MQConnectionTool::InvokeCurlConnection(bool& isLongConnection, const RequestClass requestClass)
 {
-    int retry = 3;
-    isLongConnection = true;
-    do
+    if (mClientPoolLimit <= 0)
+    {
+        return mPool->InvokeCurlConnection(isLongConnection, requestClass);
+    }
+
+    bool reserved = ReserveClientSlot();
+    if (!reserved && mPolicy == POOL_EXHAUSTED_BLOCK && requestClass != REQUEST_CLASS_ACK)
     {
+        int64_t deadline = TimeTool::GetMonotonicMs() + mAcquireTimeoutMs;
         PTScopedLock lock(mWaitObject);
-        if (!mCurlPool.empty())
+        mWaiters++;
+        while (!(reserved = ReserveClientSlot()))
         {
-            CURL* curl = mCurlPool.front();
-            mCurlPool.pop();
-            return curl;
+            int64_t remainMs = deadline - TimeTool::GetMonotonicMs();
+            if (remainMs <= 0)
+            {
+                break;
+            }
+            mWaitObject.wait(remainMs * 1000);
         }
-        else if (mCurrentPoolSize < mCurlPoolSize)
+        mWaiters--;
+    }
+    if (!reserved)
+    {
+        // past its share the client is treated like a full pool, acks always overflow
+        if (mPolicy == POOL_EXHAUSTED_OVERFLOW || requestClass == REQUEST_CLASS_ACK)
         {
-            CURL* curl = curl_easy_init();
-            if (curl)
-                mCurrentPoolSize++;
-            curl_easy_setopt( curl, CURLOPT_TIMEOUT, mTimeout);
-            curl_easy_setopt( curl, CURLOPT_CONNECTTIMEOUT, mConnectTimeout);
-            return curl;
+            return mPool->InvokeUnpooledConnection(isLongConnection);
         }
-        if (--retry > 0)
-            mWaitObject.wait(100);
-        else
-            break;
-    }while(true);
-    isLongConnection = false;
-    CURL* curl = curl_easy_init();
-    curl_easy_setopt( curl, CURLOPT_TIMEOUT, mTimeout);
-    curl_easy_setopt( curl, CURLOPT_CONNECTTIMEOUT, mConnectTimeout);
+        MQ_THROW(MQExceptionBase, "Client share of the connection pool exhausted, limit:"
+            + StringTool::ToString(mClientPoolLimit));
+    }
+
+    CURL* curl = NULL;
+    try
+    {
+        curl = mPool->InvokeCurlConnection(isLongConnection, requestClass);
+    }
+    catch (MQExceptionBase& e)
+    {
+        ReleaseClientSlot();
+        throw;
+    }
+    // an unpooled handle does not count against the share
+    if (!isLongConnection)
+    {
+        ReleaseClientSlot();
+    }
     return curl;
 }
 
-void MQConnectionTool::RevokeCurlConnection(CURL* curlConnection, const bool isLongConnection)
+void MQConnectionTool::ReleaseClientSlot()
 {
-    if (isLongConnection)
+    mInUse--;
+    if (mWaiters.load() > 0)
     {
         PTScopedLock lock(mWaitObject);
-        if (curlConnection)
-        {
-            mCurlPool.push(curlConnection);
-            mWaitObject.signal();
-        }
+        mWaitObject.signal();
     }
-    else
+}
+
+void MQConnectionTool::RevokeCurlConnection(CURL* curlConnection, const bool isLongConnection,
+    const bool failed)
+{
+    mPool->RevokeCurlConnection(curlConnection, isLongConnection, failed);
+    if (mClientPoolLimit > 0 && isLongConnection)
     {
-        curl_easy_cleanup(curlConnection);
+        ReleaseClientSlot();
     }
 }
 
@@ -324,3 +1869,290 @@ void MQNetworkTool::Base64Encoding(std::istream& is, std::ostream& os, char make
         }
     }
 }
+
+#if LIBCURL_VERSION_NUM >= 0x074400
+// curl_multi_poll/curl_multi_wakeup, since 7.68.0
+#define MQ_CURL_HAS_MULTI_WAKEUP 1
+#endif
+
+class MQAsyncHandler::AsyncLoop : public PTThread
+{
+public:
+    AsyncLoop(MQAsyncHandler& handler)
+        : mHandler(handler)
+        , mStopped(false)
+    {
+        const MQConnectionConfig& config = mHandler.mConfig;
+        mMulti = curl_multi_init();
+        curl_multi_setopt(mMulti, CURLMOPT_MAXCONNECTS, (long)config.connPoolSize);
+        if (config.enableHttp2)
+        {
+            curl_multi_setopt(mMulti, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+            curl_multi_setopt(mMulti, CURLMOPT_MAX_HOST_CONNECTIONS, (long)config.maxConnectionsPerHost);
+#if LIBCURL_VERSION_NUM >= 0x074300
+            curl_multi_setopt(mMulti, CURLMOPT_MAX_CONCURRENT_STREAMS, (long)config.maxStreamsPerConnection);
+#endif
+        }
+    }
+
+    ~AsyncLoop()
+    {
+        for (std::vector<CURL*>::iterator iter = mIdleHandles.begin();
+            iter != mIdleHandles.end(); ++iter)
+        {
+            CurlHandleState* state = GetHandleState(*iter);
+            curl_easy_cleanup(*iter);
+            delete state;
+        }
+        curl_multi_cleanup(mMulti);
+    }
+
+    void submit(const AsyncTransferPtr& transfer)
+    {
+        {
+            PTScopedLock lock(mWaitObject);
+            if (mStopped)
+            {
+                MQ_THROW(MQExceptionBase, "MQAsyncHandler is stopped");
+            }
+            mPending.push_back(transfer);
+            mWaitObject.signal();
+        }
+#ifdef MQ_CURL_HAS_MULTI_WAKEUP
+        curl_multi_wakeup(mMulti);
+#endif
+    }
+
+    void stop()
+    {
+        {
+            PTScopedLock lock(mWaitObject);
+            mStopped = true;
+            mWaitObject.signal();
+        }
+#ifdef MQ_CURL_HAS_MULTI_WAKEUP
+        curl_multi_wakeup(mMulti);
+#endif
+        join();
+    }
+
+protected:
+    void run()
+    {
+        while (true)
+        {
+            std::deque<AsyncTransferPtr> pending;
+            bool stopped = false;
+            {
+                PTScopedLock lock(mWaitObject);
+                pending.swap(mPending);
+                stopped = mStopped;
+            }
+            if (stopped)
+            {
+                abortAll(pending);
+                return;
+            }
+            for (std::deque<AsyncTransferPtr>::iterator iter = pending.begin();
+                iter != pending.end(); ++iter)
+            {
+                startTransfer(*iter);
+            }
+
+            int running = 0;
+            curl_multi_perform(mMulti, &running);
+
+            int left = 0;
+            CURLMsg* msg = NULL;
+            while ((msg = curl_multi_info_read(mMulti, &left)) != NULL)
+            {
+                if (msg->msg == CURLMSG_DONE)
+                {
+                    finishTransfer(msg->easy_handle, msg->data.result);
+                }
+            }
+
+#ifdef MQ_CURL_HAS_MULTI_WAKEUP
+            curl_multi_poll(mMulti, NULL, 0, 1000, NULL);
+#else
+            if (!mRunning.empty())
+            {
+                curl_multi_wait(mMulti, NULL, 0, 10, NULL);
+            }
+            else
+            {
+                // curl_multi_wait returns at once without handles, park on the queue
+                PTScopedLock lock(mWaitObject);
+                if (mPending.empty() && !mStopped)
+                {
+                    mWaitObject.wait(100000);
+                }
+            }
+#endif
+        }
+    }
+
+private:
+    CURL* acquireHandle()
+    {
+        if (!mIdleHandles.empty())
+        {
+            CURL* curl = mIdleHandles.back();
+            mIdleHandles.pop_back();
+            return curl;
+        }
+        CURL* curl = curl_easy_init();
+        if (curl == NULL)
+        {
+            MQ_THROW(MQExceptionBase, "curl_easy_init failed");
+        }
+        const MQConnectionConfig& config = mHandler.mConfig;
+        SetStaticOptions(curl, config);
+        curl_easy_setopt( curl, CURLOPT_PRIVATE, new CurlHandleState());
+        if (config.enableHttp2)
+        {
+            curl_easy_setopt( curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+            // queue on a connection that can take another stream rather than open a new one
+            curl_easy_setopt( curl, CURLOPT_PIPEWAIT, 1L);
+        }
+        // the multi handle pools connections itself, only take DNS and TLS sessions from the share
+        if (mHandler.mShare && !config.shareConnectionCache)
+        {
+            mHandler.mShare->Attach(curl);
+        }
+        return curl;
+    }
+
+    void startTransfer(const AsyncTransferPtr& transfer)
+    {
+        try
+        {
+            CurlTransfer& curlTransfer = transfer->mTransfer;
+            curlTransfer.curl = acquireHandle();
+            MQNetworkTool::PrepareTransfer(transfer->mEndPoint,
+                transfer->getRequest(), transfer->getResponse(), curlTransfer);
+            CURLMcode ret = curl_multi_add_handle(mMulti, curlTransfer.curl);
+            if (ret != CURLM_OK)
+            {
+                curlTransfer.header = NULL;
+                mIdleHandles.push_back(curlTransfer.curl);
+                MQ_THROW(MQExceptionBase, "curl_multi_add_handle failed, errorcode:"
+                    + StringTool::ToString(ret));
+            }
+            mRunning[curlTransfer.curl] = transfer;
+        }
+        catch (MQExceptionBase& e)
+        {
+            notifyFailed(transfer, e);
+        }
+    }
+
+    void finishTransfer(CURL* curl, CURLcode result)
+    {
+        std::map<CURL*, AsyncTransferPtr>::iterator iter = mRunning.find(curl);
+        if (iter == mRunning.end())
+        {
+            return;
+        }
+        AsyncTransferPtr transfer = iter->second;
+        mRunning.erase(iter);
+        curl_multi_remove_handle(mMulti, curl);
+        mIdleHandles.push_back(curl);
+
+        Response& resp = transfer->getResponse();
+        try
+        {
+            MQNetworkTool::CompleteTransfer(result, transfer->mTransfer, resp);
+            resp.parseResponse();
+        }
+        catch (MQExceptionBase& e)
+        {
+            if (transfer->mRetry > 0 && resp.getStatus() >= 500)
+            {
+                transfer->mRetry--;
+                startTransfer(transfer);
+                return;
+            }
+            notifyFailed(transfer, e);
+            return;
+        }
+        try
+        {
+            transfer->onSuccess();
+        }
+        catch (...)
+        {
+            // callbacks must not throw, do not let them kill the loop
+        }
+    }
+
+    void notifyFailed(const AsyncTransferPtr& transfer, const MQExceptionBase& e)
+    {
+        try
+        {
+            transfer->onFailed(e);
+        }
+        catch (...)
+        {
+        }
+    }
+
+    void abortAll(std::deque<AsyncTransferPtr>& pending)
+    {
+        MQExceptionBase e("MQAsyncHandler stopped before the request completed");
+        e.Init(__FILE__, FUNCTION_NAME, __LINE__);
+        for (std::map<CURL*, AsyncTransferPtr>::iterator iter = mRunning.begin();
+            iter != mRunning.end(); ++iter)
+        {
+            curl_multi_remove_handle(mMulti, iter->first);
+            iter->second->mTransfer.header = NULL;
+            mIdleHandles.push_back(iter->first);
+            notifyFailed(iter->second, e);
+        }
+        mRunning.clear();
+        for (std::deque<AsyncTransferPtr>::iterator iter = pending.begin();
+            iter != pending.end(); ++iter)
+        {
+            notifyFailed(*iter, e);
+        }
+    }
+
+private:
+    MQAsyncHandler& mHandler;
+    CURLM* mMulti;
+    WaitObject mWaitObject;
+    bool mStopped;
+    std::deque<AsyncTransferPtr> mPending;
+    std::map<CURL*, AsyncTransferPtr> mRunning;
+    std::vector<CURL*> mIdleHandles;
+};
+
+MQAsyncHandler::MQAsyncHandler(const MQConnectionConfig& config, MQCurlSharePtr share)
+    : mConfig(config)
+    , mShare(share)
+    , mNextLoop(0)
+{
+    int32_t count = config.asyncThreadCount > 0 ? config.asyncThreadCount : 1;
+    for (int32_t i = 0; i < count; i++)
+    {
+        AsyncLoop* loop = new AsyncLoop(*this);
+        mLoops.push_back(loop);
+        loop->start();
+    }
+}
+
+MQAsyncHandler::~MQAsyncHandler()
+{
+    for (std::vector<AsyncLoop*>::iterator iter = mLoops.begin();
+        iter != mLoops.end(); ++iter)
+    {
+        (*iter)->stop();
+        delete *iter;
+    }
+}
+
+void MQAsyncHandler::submit(const AsyncTransferPtr& transfer)
+{
+    uint32_t index = mNextLoop.fetch_add(1) % mLoops.size();
+    mLoops[index]->submit(transfer);
+}
@@ -8,7 +8,6 @@
 #include "mq_protocol.h"
 #include "mq_utils.h"
 
-#include <queue>
 #ifdef _WIN32
 #include "curl-win/curl.h"
 #else
@@ -21,6 +20,8 @@
 #include <sstream>
 #include <map>
 #include <vector>
+#include <deque>
+#include <atomic>
 
 namespace mq
 {
@@ -29,30 +30,672 @@ namespace http
 namespace sdk
 {
 
+/*
+ * connection settings of MQClient, the defaults match the plain constructors
+ */
+enum PoolExhaustedPolicy
+{
+    // wait up to acquireTimeoutMs for a handle to come back, then throw
+    POOL_EXHAUSTED_BLOCK = 0,
+    // throw at once
+    POOL_EXHAUSTED_FAIL_FAST = 1,
+    // use an unpooled handle which is closed after the request
+    POOL_EXHAUSTED_OVERFLOW = 2
+};
+
+/*
+ * what sends the blocking requests of MQClient
+ */
+enum HttpEngine
+{
+    // libcurl, the default
+    HTTP_ENGINE_CURL = 0,
+    // the SDK's own HTTP/1.1 keep-alive client on epoll and OpenSSL, Linux only;
+    // the async client and enableHttp2 still use libcurl. Of the pool settings
+    // it keeps connPoolSize idle connections per endpoint, honours maxIdleTimeMs
+    // and maxConnectionLifetimeMs, and rejects sharePoolAcrossClients and
+    // clientPoolLimit; the other curl pool settings do not apply
+    HTTP_ENGINE_NATIVE = 1
+};
+
+struct MQConnectionConfig
+{
+    MQConnectionConfig()
+        : connPoolSize(200)
+        , timeout(35)
+        , connectTimeout(35)
+        , longPollConnPoolSize(0)
+        , publishConnPoolSize(0)
+        , ackConnPoolSize(0)
+        , ackReservedConnPoolSize(0)
+        , poolShardCount(0)
+        , poolExhaustedPolicy(POOL_EXHAUSTED_OVERFLOW)
+        , acquireTimeoutMs(1000)
+        , warmUpConnections(0)
+        , shareDnsAndTlsCache(true)
+        , shareConnectionCache(false)
+        , maxIdleTimeMs(50000)
+        , maxConnectionLifetimeMs(0)
+        , reaperIntervalMs(5000)
+        , autoSizePool(false)
+        , minConnPoolSize(8)
+        , maxConnPoolSize(1000)
+        , tcpKeepAlive(false)
+        , tcpKeepIdleSeconds(30)
+        , tcpKeepIntervalSeconds(15)
+        , sharePoolAcrossClients(false)
+        , clientPoolLimit(0)
+        , asyncThreadCount(1)
+        , enableHttp2(false)
+        , maxConnectionsPerHost(2)
+        , maxStreamsPerConnection(100)
+        , httpEngine(HTTP_ENGINE_CURL)
+        , useIoUring(false)
+    {
+    }
+    // connections kept alive in the pool
+    int32_t connPoolSize;
+    // request timeout in seconds
+    int32_t timeout;
+    // connect timeout in seconds
+    int32_t connectTimeout;
+    // handles long polling consumes may hold at once, 0 for half of connPoolSize
+    int32_t longPollConnPoolSize;
+    // handles publishes may hold at once, 0 for connPoolSize
+    int32_t publishConnPoolSize;
+    // handles acks may hold at once, 0 for connPoolSize; acks never wait,
+    // past the limit they use an unpooled handle
+    int32_t ackConnPoolSize;
+    // handles only acks may take: the other classes together hold at most
+    // connPoolSize minus this, so a publish burst cannot push acks onto
+    // unpooled handles; 0 for a tenth of connPoolSize, negative for none
+    int32_t ackReservedConnPoolSize;
+    // idle handle shards, 0 for one per cpu
+    int32_t poolShardCount;
+    // what a request does when all connPoolSize handles are in use
+    PoolExhaustedPolicy poolExhaustedPolicy;
+    // upper bound of the wait with POOL_EXHAUSTED_BLOCK
+    int32_t acquireTimeoutMs;
+    // keep-alive connections opened in the background when the client is built,
+    // 0 to open them lazily, see MQClient::warmUp; not in the background with HTTP_ENGINE_NATIVE
+    int32_t warmUpConnections;
+    // one DNS cache and TLS session cache for all handles of the client
+    bool shareDnsAndTlsCache;
+    // one connection cache too, libcurl >= 7.57.0; libcurl documents this
+    // as not safe with handles used from concurrent threads, so opt-in only
+    bool shareConnectionCache;
+    // pooled connections idle longer are closed, keep it below the idle
+    // timeout of the server and load balancers, 0 keeps them forever
+    int32_t maxIdleTimeMs;
+    // connections older than this are closed when they come back, 0 for no limit
+    int32_t maxConnectionLifetimeMs;
+    // how often the pool looks for idle and expired connections
+    int32_t reaperIntervalMs;
+    // resize the pool every reaperIntervalMs, starting from connPoolSize: grow it
+    // on overflows or long acquire waits, shrink it when most handles sit idle
+    bool autoSizePool;
+    // bounds of the pool size with autoSizePool
+    int32_t minConnPoolSize;
+    int32_t maxConnPoolSize;
+    // send TCP keep-alive probes on idle connections
+    bool tcpKeepAlive;
+    // idle seconds before the first probe
+    int32_t tcpKeepIdleSeconds;
+    // seconds between probes
+    int32_t tcpKeepIntervalSeconds;
+    // clients with the same endpoint and connection settings use one
+    // process wide pool, sized by the first of them
+    bool sharePoolAcrossClients;
+    // pooled handles one client may hold at once, past it the client follows
+    // poolExhaustedPolicy on its own, 0 for no limit
+    int32_t clientPoolLimit;
+    // event loop threads of the async handler
+    int32_t asyncThreadCount;
+    // negotiate h2 over ALPN (https only) and multiplex all requests,
+    // blocking ones included, on a few connections per host
+    bool enableHttp2;
+    // h2 connections per host, further requests wait for a free stream
+    int32_t maxConnectionsPerHost;
+    // concurrent streams per h2 connection, honoured from libcurl 7.67.0
+    int32_t maxStreamsPerConnection;
+    // see HttpEngine
+    HttpEngine httpEngine;
+    // experimental: with HTTP_ENGINE_NATIVE, do socket IO through an io_uring
+    // per connection instead of epoll; falls back to epoll when the kernel
+    // (5.7+) or seccomp does not allow it. On one core it is still a little
+    // behind epoll for publish (bench/mq_io_bench), many cores are unmeasured
+    bool useIoUring;
+};
+
+/*
+ * counters of the blocking connection pool, see MQClient::getPoolStats
+ */
+struct MQConnectionPoolStats
+{
+    MQConnectionPoolStats()
+        : capacity(0)
+        , openHandles(0)
+        , inUseHandles(0)
+        , acquireCount(0)
+        , overflowCount(0)
+        , exhaustedCount(0)
+        , waitCount(0)
+        , waitTimeMs(0)
+        , growCount(0)
+        , shrinkCount(0)
+        , lastResizeFrom(0)
+        , lastResizeTo(0)
+    {
+    }
+    // the current pool size, changes with autoSizePool
+    int32_t capacity;
+    // pooled handles, idle or in use
+    int32_t openHandles;
+    int32_t inUseHandles;
+    // totals since the pool was created
+    int64_t acquireCount;
+    // requests served by an unpooled handle
+    int64_t overflowCount;
+    // requests failed for lack of a handle, fail fast or wait timeout
+    int64_t exhaustedCount;
+    // requests that waited for a handle, and the time they spent
+    int64_t waitCount;
+    int64_t waitTimeMs;
+    // decisions of the auto sizing
+    int32_t growCount;
+    int32_t shrinkCount;
+    int32_t lastResizeFrom;
+    int32_t lastResizeTo;
+    std::string lastResizeReason;
+};
+
+/*
+ * curl share object attached to every handle of a client,
+ * each kind of shared data has its own lock
+ */
+class MQCurlShare
+{
+public:
+    MQCurlShare(const bool shareDnsAndTls, const bool shareConnections);
+    ~MQCurlShare();
+
+    void Attach(CURL* curl)
+    {
+        curl_easy_setopt(curl, CURLOPT_SHARE, mShare);
+    }
+
+private:
+    static void Lock(CURL* curl, curl_lock_data data, curl_lock_access access, void* userptr);
+    static void Unlock(CURL* curl, curl_lock_data data, void* userptr);
+
+    CURLSH* mShare;
+    PTMutex mLocks[CURL_LOCK_DATA_LAST];
+
+    MQCurlShare(const MQCurlShare&);
+    MQCurlShare& operator=(const MQCurlShare&);
+};
+#ifdef __APPLE__
+typedef std::shared_ptr<MQCurlShare> MQCurlSharePtr;
+#else
+typedef std::tr1::shared_ptr<MQCurlShare> MQCurlSharePtr;
+#endif
+
+/*
+ * Authorization values by string-to-sign. The Date header has a one second
+ * resolution, so the requests of one operation sent in the same second sign
+ * the same string. Striped by the hash of the string, each stripe keeps its
+ * last few entries.
+ */
+class MQSignatureCache
+{
+public:
+    MQSignatureCache()
+        : mHits(0)
+    {
+    }
+
+    /* the cached Authorization of stringToSign into signature */
+    bool Get(const std::string& stringToSign,
+             const std::string& accessId,
+             const std::string& accessKey,
+             std::string& signature);
+
+    void Put(const std::string& stringToSign,
+             const std::string& accessId,
+             const std::string& accessKey,
+             const std::string& signature);
+
+    int64_t GetHits() const
+    {
+        return mHits.load();
+    }
+
+private:
+    static const int32_t kStripes = 8;
+    static const int32_t kEntriesPerStripe = 4;
+
+    struct Entry
+    {
+        std::string stringToSign;
+        std::string accessId;
+        std::string accessKey;
+        std::string signature;
+    };
+    struct Stripe
+    {
+        Stripe() : next(0) {}
+        PTMutex mutex;
+        Entry entries[kEntriesPerStripe];
+        // the entry replaced by the next Put
+        int32_t next;
+    };
+
+    static int32_t StripeOf(const std::string& stringToSign);
+
+    Stripe mStripes[kStripes];
+    std::atomic<int64_t> mHits;
+
+    MQSignatureCache(const MQSignatureCache&);
+    MQSignatureCache& operator=(const MQSignatureCache&);
+};
+
+/*
+ * header lines that are the same for every request of one operation of a
+ * producer/consumer, linked into a curl_slist once and shared by all its
+ * requests. Immutable after construction, except for the signature cache
+ * of the operation.
+ */
+class MQRequestTemplate
+{
+public:
+    /* @param withBody: the operation sends a body, adds "Expect:" */
+    MQRequestTemplate(const std::string& endpoint, const bool withBody);
+
+    /* the constant lines, sent after the per request ones */
+    curl_slist* GetHeaderList() const
+    {
+        return mNodes.empty() ? NULL : const_cast<curl_slist*>(&mNodes[0]);
+    }
+
+    /* true if the request header is already one of the constant lines */
+    bool Covers(const std::string& name, const std::string& value) const;
+
+    /* Authorization values of the requests of this operation */
+    MQSignatureCache& GetSignatureCache() const
+    {
+        return mSignatureCache;
+    }
+
+private:
+    void AddHeader(const std::string& name, const std::string& value);
+
+    std::map<std::string, std::string> mHeaders;
+    std::vector<std::string> mLines;
+    std::vector<curl_slist> mNodes;
+    mutable MQSignatureCache mSignatureCache;
+
+    MQRequestTemplate(const MQRequestTemplate&);
+    MQRequestTemplate& operator=(const MQRequestTemplate&);
+};
+
+/*
+ * kept in CURLOPT_PRIVATE of every handle, the url last given to curl and
+ * the per request header lines are rewritten in place so that a reused
+ * handle does not allocate for them
+ */
+struct CurlHandleState
+{
+    std::string url;
+    std::vector<std::string> headerLines;
+    std::vector<curl_slist> headerNodes;
+};
+
+/*
+ * read position in the body segments of a request
+ */
+struct CurlBodyReader
+{
+    CurlBodyReader()
+        : segments(NULL)
+        , index(0)
+        , offset(0)
+    {
+    }
+    const std::vector<RequestBodySegment>* segments;
+    size_t index;
+    size_t offset;
+};
+
+/*
+ * state of one curl transfer, shared by the blocking path and
+ * the curl multi driven async path
+ */
+struct CurlTransfer
+{
+    CurlTransfer()
+        : curl(NULL)
+        , header(NULL)
+        , response(NULL)
+        , isLongConnection(true)
+    {
+    }
+    CURL* curl;
+    // points into the handle state and the request template, not owned
+    curl_slist* header;
+    CurlBodyReader body;
+    Response* response;
+    bool isLongConnection;
+};
+
+/*
+ * one request in flight on the MQAsyncHandler, owns its Request and Response
+ */
+class AsyncTransfer
+{
+public:
+    AsyncTransfer(const std::string& endpoint)
+        : mEndPoint(endpoint), mRetry(3)
+    {
+    }
+    virtual ~AsyncTransfer() {}
+
+    virtual Request& getRequest() = 0;
+    virtual Response& getResponse() = 0;
+
+    /* called on the event loop thread after parseResponse succeeded */
+    virtual void onSuccess() = 0;
+    /* called on the event loop thread when sending or parsing failed */
+    virtual void onFailed(const MQExceptionBase& e) = 0;
+
+    friend class MQAsyncHandler;
+
+protected:
+    std::string mEndPoint;
+    CurlTransfer mTransfer;
+    int32_t mRetry;
+};
+#ifdef __APPLE__
+typedef std::shared_ptr<AsyncTransfer> AsyncTransferPtr;
+#else
+typedef std::tr1::shared_ptr<AsyncTransfer> AsyncTransferPtr;
+#endif
+
+/*
+ * drives transfers on one or a few event loop threads, each owning a CURLM
+ */
+class MQAsyncHandler
+{
+public:
+    MQAsyncHandler(const MQConnectionConfig& config, MQCurlSharePtr share);
+    ~MQAsyncHandler();
+
+    /* queue a signed request, the transfer callbacks fire on a loop thread */
+    void submit(const AsyncTransferPtr& transfer);
+
+    class AsyncLoop;
+    friend class AsyncLoop;
+
+protected:
+    MQConnectionConfig mConfig;
+    MQCurlSharePtr mShare;
+    std::vector<AsyncLoop*> mLoops;
+    std::atomic<uint32_t> mNextLoop;
+};
+#ifdef __APPLE__
+typedef std::shared_ptr<MQAsyncHandler> MQAsyncHandlerPtr;
+#else
+typedef std::tr1::shared_ptr<MQAsyncHandler> MQAsyncHandlerPtr;
+#endif
+
+/*
+ * easy handles pooled in per thread shards, an empty shard steals from the others
+ *
+ * idle handles are shared by all request classes, each class may only hold
+ * its own share of the pool at once and all but acks leave ackReservedConnPoolSize
+ * handles to acks, so neither parked long polls nor publishes can starve acks
+ */
+class MQCurlPool
+{
+public:
+    MQCurlPool(const MQConnectionConfig& config, const int32_t capacity,
+        MQCurlSharePtr share);
+    ~MQCurlPool();
+
+    /* isLongConnection is false for an overflow handle, which is closed on release */
+    CURL* Acquire(bool& isLongConnection, const RequestClass requestClass = REQUEST_CLASS_DEFAULT);
+
+    /* an overflow handle, for callers over a limit of their own */
+    CURL* AcquireUnpooled(bool& isLongConnection);
+
+    /* failed handles are quarantined and closed by the reaper instead of reused */
+    void Release(CURL* curl, const bool isLongConnection, const bool failed = false);
+
+    /* open up to count connections to endpoint and pool those that answered,
+     * returns the number pooled, gives up early once abort is set */
+    int32_t WarmUp(const std::string& endpoint, const int32_t count, const std::atomic<bool>& abort);
+
+    MQConnectionPoolStats GetStats();
+
+    class Reaper;
+    friend class Reaper;
+
+private:
+    struct IdleHandle
+    {
+        CURL* curl;
+        int64_t idleSinceMs;
+    };
+
+    struct Shard
+    {
+        PTMutex mutex;
+        std::vector<IdleHandle> idle;
+        // keep hot shard locks on separate cache lines
+        char padding[64];
+    };
+
+    // kept in CURLOPT_PRIVATE of every pooled handle
+    struct HandleInfo : public CurlHandleState
+    {
+        int64_t createdMs;
+        // class slot held by the handle, -1 when idle
+        int32_t requestClass;
+    };
+
+    void SetClassLimits(const int32_t capacity);
+    void AutoSize();
+    bool ReserveClassSlot(const RequestClass requestClass);
+    void ReleaseClassSlot(const int32_t requestClass);
+    CURL* AcquireHandle(bool& isLongConnection, const PoolExhaustedPolicy policy, const int64_t deadline);
+    void NotifyWaiters();
+    CURL* CreateHandle();
+    void DestroyHandle(CURL* curl);
+    static HandleInfo* GetInfo(CURL* curl);
+    bool IsExpired(CURL* curl, const int64_t idleSinceMs, const int64_t now) const;
+    void PushIdle(Shard* shard, CURL* curl, const int64_t now);
+    CURL* TakeIdle(const size_t home, const bool blocking);
+    void Retire(CURL* curl);
+    void Reap();
+    bool ReserveSlot();
+    size_t HomeShard() const;
+
+private:
+    MQConnectionConfig mConfig;
+    std::atomic<int32_t> mCapacity;
+    MQCurlSharePtr mShare;
+    std::vector<Shard*> mShards;
+    std::atomic<int32_t> mCurrentSize;
+    std::atomic<int32_t> mWaiters;
+    WaitObject mWaitObject;
+    std::atomic<int32_t> mClassLimit[REQUEST_CLASS_COUNT];
+    std::atomic<int32_t> mInUse[REQUEST_CLASS_COUNT];
+    // slots held by all classes but ack, below mSharedLimit
+    std::atomic<int32_t> mSharedLimit;
+    std::atomic<int32_t> mInUseShared;
+    // pooled handles in use and their peak since the last AutoSize
+    std::atomic<int32_t> mInUseTotal;
+    std::atomic<int32_t> mPeakInUse;
+    std::atomic<int64_t> mAcquireCount;
+    std::atomic<int64_t> mOverflowCount;
+    std::atomic<int64_t> mExhaustedCount;
+    std::atomic<int64_t> mWaitCount;
+    std::atomic<int64_t> mWaitTimeMs;
+    // only touched by the reaper
+    int64_t mLastAcquireCount;
+    int64_t mLastPressureCount;
+    int64_t mLastWaitCount;
+    int64_t mLastWaitTimeMs;
+    PTMutex mStatsMutex;
+    int32_t mGrowCount;
+    int32_t mShrinkCount;
+    int32_t mLastResizeFrom;
+    int32_t mLastResizeTo;
+    std::string mLastResizeReason;
+    // handles waiting to be closed off the request path
+    PTMutex mRetiredMutex;
+    std::vector<CURL*> mRetired;
+    Reaper* mReaper;
+
+    MQCurlPool(const MQCurlPool&);
+    MQCurlPool& operator=(const MQCurlPool&);
+};
+
+/*
+ * the curl pool, share and async handler of one endpoint, owned by one
+ * MQConnectionTool or shared through MQConnectionRegistry
+ */
+class MQConnectionPool
+{
+public:
+    MQConnectionPool(const MQConnectionConfig& config);
+    ~MQConnectionPool();
+
+    CURL* InvokeCurlConnection(bool& isLongConnection,
+        const RequestClass requestClass = REQUEST_CLASS_DEFAULT);
+    CURL* InvokeUnpooledConnection(bool& isLongConnection);
+    void RevokeCurlConnection(CURL* curlConnection, const bool isLongConnection,
+        const bool failed = false);
+
+    /* the curl multi handler shared by async requests and multiplexed blocking ones */
+    MQAsyncHandlerPtr GetAsyncHandler();
+
+    /* start opening connections to endpoint in the background, only the first call counts */
+    void StartWarmUp(const std::string& endpoint, const int32_t connections);
+
+    /* wait for the warm up, true if it finished in time with all connections open */
+    bool WaitWarmUp(const int32_t timeoutMs);
+
+    MQConnectionPoolStats GetPoolStats();
+
+    const MQConnectionConfig& GetConfig() const
+    {
+        return mConfig;
+    }
+
+    class WarmUpThread;
+    friend class WarmUpThread;
+
+private:
+    MQConnectionConfig mConfig;
+    MQCurlSharePtr mShare;
+    MQCurlPool* mCurlPool;
+
+    WaitObject mWarmUpWaitObject;
+    WarmUpThread* mWarmUpThread;
+    std::atomic<bool> mWarmUpAbort;
+    bool mWarmUpDone;
+    bool mWarmUpComplete;
+
+    PTMutex mAsyncHandlerMutex;
+    MQAsyncHandlerPtr mAsyncHandler;
+
+    MQConnectionPool(const MQConnectionPool&);
+    MQConnectionPool& operator=(const MQConnectionPool&);
+};
+#ifdef __APPLE__
+typedef std::shared_ptr<MQConnectionPool> MQConnectionPoolPtr;
+typedef std::weak_ptr<MQConnectionPool> MQConnectionPoolWeakPtr;
+#else
+typedef std::tr1::shared_ptr<MQConnectionPool> MQConnectionPoolPtr;
+typedef std::tr1::weak_ptr<MQConnectionPool> MQConnectionPoolWeakPtr;
+#endif
+
+/*
+ * process wide pools of clients with MQConnectionConfig::sharePoolAcrossClients,
+ * one per endpoint and connection settings, released with the last client
+ */
+class MQConnectionRegistry
+{
+public:
+    static MQConnectionPoolPtr GetPool(const std::string& endpoint, const MQConnectionConfig& config);
+
+private:
+    static std::string MakeKey(const std::string& endpoint, const MQConnectionConfig& config);
+};
+
+/*
+ * the connections of one client, its pool may be shared with other clients
+ */
 class MQConnectionTool
 {
 public:
     MQConnectionTool(const int32_t curlPoolSize, const int32_t connectTimeout,
-        const int32_t timeout)
-        : mConnectTimeout(connectTimeout)
-        , mTimeout(timeout)
-        , mCurlPoolSize(curlPoolSize)
-        , mCurrentPoolSize(0)
+        const int32_t timeout);
+    MQConnectionTool(const MQConnectionConfig& config);
+    /* takes the shared pool of endpoint if config.sharePoolAcrossClients */
+    MQConnectionTool(const MQConnectionConfig& config, const std::string& endpoint);
+    ~MQConnectionTool();
+
+    CURL* InvokeCurlConnection(bool& isLongConnection,
+        const RequestClass requestClass = REQUEST_CLASS_DEFAULT);
+    void RevokeCurlConnection(CURL* curlConnection, const bool isLongConnection,
+        const bool failed = false);
+
+    MQAsyncHandlerPtr GetAsyncHandler()
     {
+        return mPool->GetAsyncHandler();
+    }
+
+    void StartWarmUp(const std::string& endpoint, const int32_t connections)
+    {
+        mPool->StartWarmUp(endpoint, connections);
     }
-    ~MQConnectionTool();
 
-    CURL* InvokeCurlConnection(bool& isLongConnection);
-    void RevokeCurlConnection(CURL* curlConnection, const bool isLongConnection);
+    bool WaitWarmUp(const int32_t timeoutMs)
+    {
+        return mPool->WaitWarmUp(timeoutMs);
+    }
+
+    /* blocking requests go through the multiplexing async handler */
+    bool IsMultiplexed() const
+    {
+        return mPool->GetConfig().enableHttp2;
+    }
+
+    MQConnectionPoolStats GetPoolStats()
+    {
+        return mPool->GetPoolStats();
+    }
+
+    /* the settings of the pool, those of the first client when it is shared */
+    const MQConnectionConfig& GetConfig() const
+    {
+        return mPool->GetConfig();
+    }
 
 private:
-    int32_t mConnectTimeout;
-    int32_t mTimeout;
-    int32_t mCurlPoolSize;
-    int32_t mCurrentPoolSize;
-    WaitObject mWaitObject;
+    bool ReserveClientSlot();
+    void ReleaseClientSlot();
 
-    std::queue<CURL*> mCurlPool;
+private:
+    MQConnectionPoolPtr mPool;
+    // pooled handles this client may hold at once, 0 for no limit
+    int32_t mClientPoolLimit;
+    PoolExhaustedPolicy mPolicy;
+    int32_t mAcquireTimeoutMs;
+    std::atomic<int32_t> mInUse;
+    std::atomic<int32_t> mWaiters;
+    WaitObject mWaitObject;
 };
 #ifdef __APPLE__
 typedef std::shared_ptr<MQConnectionTool> MQConnectionToolPtr;
@@ -68,14 +711,33 @@ public:
                             Response& resp,
                             MQConnectionToolPtr mqConnTool);
 
+    /* send through the async handler and block until the response is parsed */
+    static void SendMultiplexedRequest(const std::string& endpoint,
+                                       Request& req,
+                                       Response& resp,
+                                       MQAsyncHandlerPtr asyncHandler);
+
+    /* set up the easy handle in transfer for req, the response body goes to resp */
+    static void PrepareTransfer(const std::string& endpoint,
+                                Request& req,
+                                Response& resp,
+                                CurlTransfer& transfer);
+
+    /* release per transfer resources and fill status/headers of resp, throws on curl error */
+    static void CompleteTransfer(CURLcode curlret,
+                                 CurlTransfer& transfer,
+                                 Response& resp);
+
+    /* @param cache: reuses the Authorization of an identical string-to-sign, may be NULL */
     static std::string Signature(const std::string& method,
                                  const std::string& canonicalizedResource,
                                  const std::string& accessId,
                                  const std::string& accessKey,
-                                 const std::map<std::string, std::string>& headers);
+                                 const std::map<std::string, std::string>& headers,
+                                 MQSignatureCache* cache = NULL);
 
 protected:
-    static std::string Sign(const char* data, const std::string& accessId, const std::string& accessKey);
+    static std::string Sign(const std::string& data, const std::string& accessId, const std::string& accessKey);
     static std::string Base64(const char* input, unsigned int& length);
     static void Base64Encoding(std::istream&, std::ostream&, char makeupChar = '=',
                                const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
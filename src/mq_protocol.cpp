@@ -68,9 +68,132 @@ void Message::initFromXml(const xml_node& messageNode)
     }
 }
 
+namespace
+{
+
+/*
+ * response bodies released on this thread, handed to the next responses
+ * so a steady stream of requests stops allocating them
+ */
+class ResponseBufferPool
+{
+public:
+    ResponseBufferPool()
+    {
+        mBuffers.reserve(kMaxBuffers);
+    }
+
+    void take(std::string& buffer)
+    {
+        if (!mBuffers.empty())
+        {
+            buffer.swap(mBuffers.back());
+            mBuffers.pop_back();
+        }
+    }
+
+    void give(std::string& buffer)
+    {
+        // huge one-off bodies are not worth keeping around
+        if (mBuffers.size() >= kMaxBuffers || buffer.capacity() > kMaxBufferCapacity)
+        {
+            return;
+        }
+        buffer.clear();
+        mBuffers.push_back(std::string());
+        mBuffers.back().swap(buffer);
+    }
+
+    static ResponseBufferPool& local()
+    {
+        static thread_local ResponseBufferPool sPool;
+        return sPool;
+    }
+
+private:
+    static const size_t kMaxBuffers = 8;
+    static const size_t kMaxBufferCapacity = 4 * 1024 * 1024;
+
+    std::vector<std::string> mBuffers;
+};
+
+}
+
 Response::Response()
-    : mRawData(""), mStatus(0)
+    : mRetainHeaders(true), mHeadersMaterialized(false), mRawData(""), mStatus(0)
 {
+    ResponseBufferPool::local().take(mRawData);
+}
+
+void Response::appendHeader(const char* name, const size_t nameSize,
+                            const char* value, const size_t valueSize)
+{
+    if (!mRetainHeaders)
+    {
+        return;
+    }
+    HeaderView view;
+    view.nameOffset = (uint32_t)mHeaderBuffer.size();
+    view.nameSize = (uint32_t)nameSize;
+    mHeaderBuffer.append(name, nameSize);
+    view.valueOffset = (uint32_t)mHeaderBuffer.size();
+    view.valueSize = (uint32_t)valueSize;
+    mHeaderBuffer.append(value, valueSize);
+    mHeaderViews.push_back(view);
+}
+
+const std::map<std::string, std::string>& Response::getHeaders()
+{
+    if (!mHeadersMaterialized)
+    {
+        // a later line of the same name wins, as it did with the map
+        for (std::vector<HeaderView>::const_iterator iter = mHeaderViews.begin();
+            iter != mHeaderViews.end(); ++iter)
+        {
+            mHeaders[mHeaderBuffer.substr(iter->nameOffset, iter->nameSize)] =
+                mHeaderBuffer.substr(iter->valueOffset, iter->valueSize);
+        }
+        mHeadersMaterialized = true;
+    }
+    return mHeaders;
+}
+
+std::string Response::getHeader(std::string key)
+{
+    if (!mHeadersMaterialized)
+    {
+        for (std::vector<HeaderView>::const_reverse_iterator iter = mHeaderViews.rbegin();
+            iter != mHeaderViews.rend(); ++iter)
+        {
+            if (key.size() == iter->nameSize
+                && mHeaderBuffer.compare(iter->nameOffset, iter->nameSize, key) == 0)
+            {
+                return mHeaderBuffer.substr(iter->valueOffset, iter->valueSize);
+            }
+        }
+        return "";
+    }
+    std::map<std::string, std::string>::iterator iter = mHeaders.find(key);
+    if (iter != mHeaders.end())
+    {
+        return iter->second;
+    }
+    return "";
+}
+
+Response::~Response()
+{
+    ResponseBufferPool::local().give(mRawData);
+}
+
+void Response::reserveRawData(const size_t size)
+{
+    // a bogus Content-Length must not reserve without bound
+    static const size_t kMaxReserve = 64 * 1024 * 1024;
+    if (size > mRawData.capacity() && size <= kMaxReserve)
+    {
+        mRawData.reserve(size);
+    }
 }
 
 bool Response::isCommonError(const pugi::xml_node& rootNode)
@@ -133,10 +256,772 @@ void Response::parseCommonError(const pugi::xml_node& rootNode)
 
 ConsumeMessageResponse::ConsumeMessageResponse(
     std::vector<Message>& messages)
-    : Response(), mMessages(&messages)
+    : Response(), mMessages(&messages), mParser(mStaged)
+{
+    // only the body is looked at, consume loops skip storing headers
+    setRetainHeaders(false);
+}
+
+void ConsumeMessageResponse::onBodyReceived(const size_t size)
+{
+    mParser.feed(mRawData.data(), size);
+}
+
+void ConsumeMessageResponse::onBodyCleared()
+{
+    mParser.reset();
+}
+
+void ConsumeMessageResponse::publish()
+{
+    if (mMessages->empty())
+    {
+        mMessages->swap(mStaged);
+    }
+    else
+    {
+        mMessages->insert(mMessages->end(), mStaged.begin(), mStaged.end());
+    }
+    mStaged.clear();
+}
+
+MessagesStreamParser::MessagesStreamParser(std::vector<Message>& messages)
+    : mMessages(&messages), mViews(NULL), mBase(messages.size()), mState(STATE_PARSING),
+        mPos(0), mScan(0), mQuote(0), mInMessage(false), mPart(-1), mTarget(NULL), mTextTaken(false)
+{
+}
+
+MessagesStreamParser::MessagesStreamParser(std::vector<MessageView>& views)
+    : mMessages(NULL), mViews(&views), mBase(views.size()), mState(STATE_PARSING),
+        mPos(0), mScan(0), mQuote(0), mInMessage(false), mPart(-1), mTarget(NULL), mTextTaken(false)
 {
 }
 
+void MessagesStreamParser::reset()
+{
+    if (mMessages != NULL && mMessages->size() > mBase)
+    {
+        mMessages->resize(mBase);
+    }
+    if (mViews != NULL && mViews->size() > mBase)
+    {
+        mViews->resize(mBase);
+    }
+    mState = STATE_PARSING;
+    mPos = 0;
+    mScan = 0;
+    mQuote = 0;
+    mOpenTags.clear();
+    mInMessage = false;
+    mPart = -1;
+    mTarget = NULL;
+    mText.clear();
+    mTextTaken = false;
+}
+
+// offset of term at or after from, npos while it has not been received
+static size_t FindTerm(const char* data, size_t from, const size_t size, const char* term, const size_t termSize)
+{
+    while (from + termSize <= size)
+    {
+        const char* hit = (const char*)memchr(data + from, term[0], size - from - termSize + 1);
+        if (hit == NULL)
+        {
+            break;
+        }
+        from = hit - data;
+        if (memcmp(hit, term, termSize) == 0)
+        {
+            return from;
+        }
+        ++from;
+    }
+    return std::string::npos;
+}
+
+void MessagesStreamParser::feed(const char* data, const size_t size)
+{
+    while (mState == STATE_PARSING && mPos < size)
+    {
+        if (data[mPos] != '<')
+        {
+            const char* lt = (const char*)memchr(data + mScan, '<', size - mScan);
+            if (lt == NULL)
+            {
+                mScan = size;
+                return;
+            }
+            size_t end = lt - data;
+            if (mPart >= 0 && mOpenTags.size() == 3)
+            {
+                text(data, mPos, end - mPos, false);
+            }
+            mPos = mScan = end;
+            continue;
+        }
+
+        // enough of the markup to tell what it is, "<![CDATA[" is the longest
+        if (size - mPos < 2 || (data[mPos + 1] == '!' && size - mPos < 9))
+        {
+            return;
+        }
+        const char* term = ">";
+        size_t termSize = 1;
+        size_t skip = 1;
+        char kind = data[mPos + 1];
+        if (kind == '?')
+        {
+            term = "?>";
+            termSize = 2;
+            skip = 2;
+        }
+        else if (kind == '!')
+        {
+            if (memcmp(data + mPos, "<!--", 4) == 0)
+            {
+                term = "-->";
+                termSize = 3;
+                skip = 4;
+            }
+            else if (memcmp(data + mPos, "<![CDATA[", 9) == 0)
+            {
+                term = "]]>";
+                termSize = 3;
+                skip = 9;
+            }
+            else
+            {
+                mState = STATE_FALLBACK;
+                return;
+            }
+        }
+        if (mScan < mPos + skip)
+        {
+            mScan = mPos + skip;
+        }
+
+        size_t end;
+        if (kind == '?' || kind == '!' || kind == '/')
+        {
+            end = FindTerm(data, mScan, size, term, termSize);
+            if (end == std::string::npos)
+            {
+                mScan = size >= mScan + termSize ? size - termSize + 1 : mScan;
+                return;
+            }
+        }
+        else
+        {
+            // a start tag ends at the first '>' outside an attribute value
+            end = mScan;
+            if (mQuote == 0)
+            {
+                const char* gt = (const char*)memchr(data + mScan, '>', size - mScan);
+                if (gt != NULL && memchr(data + mScan, '"', gt - data - mScan) == NULL
+                    && memchr(data + mScan, '\'', gt - data - mScan) == NULL)
+                {
+                    end = gt - data;
+                }
+            }
+            while (end < size && (mQuote != 0 || data[end] != '>'))
+            {
+                char c = data[end];
+                if (mQuote != 0)
+                {
+                    if (c == mQuote)
+                        mQuote = 0;
+                }
+                else if (c == '"' || c == '\'')
+                {
+                    mQuote = c;
+                }
+                ++end;
+            }
+            if (end == size)
+            {
+                mScan = size;
+                return;
+            }
+        }
+
+        if (kind == '!' && skip == 9)
+        {
+            if (mPart >= 0 && mOpenTags.size() == 3)
+            {
+                text(data, mPos + skip, end - mPos - skip, true);
+            }
+        }
+        else if (kind != '?' && kind != '!' && !markup(data, mPos, end))
+        {
+            mState = STATE_FALLBACK;
+            return;
+        }
+        mPos = mScan = end + termSize;
+    }
+}
+
+static inline bool IsXmlSpace(const char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool MessagesStreamParser::markup(const char* data, const size_t begin, const size_t end)
+{
+    // data[begin] is '<', data[end] is '>'
+    bool closing = data[begin + 1] == '/';
+    size_t nameBegin = begin + (closing ? 2 : 1);
+    size_t nameEnd = nameBegin;
+    while (nameEnd < end && !IsXmlSpace(data[nameEnd]) && data[nameEnd] != '/')
+    {
+        ++nameEnd;
+    }
+    if (nameEnd == nameBegin)
+    {
+        return false;
+    }
+    if (closing)
+    {
+        return endTag(data, nameBegin, nameEnd - nameBegin);
+    }
+    bool selfClosing = data[end - 1] == '/';
+    return startTag(data, nameBegin, nameEnd - nameBegin, selfClosing);
+}
+
+static inline bool NameIs(const char* name, const size_t nameSize, const char* expected)
+{
+    return strlen(expected) == nameSize && memcmp(name, expected, nameSize) == 0;
+}
+
+// the MessageView::Part an element of <Message> is read into, -1 for none
+static int32_t PartOf(const char* name, const size_t nameSize)
+{
+    static const char* const kNames[] = {MESSAGE_ID, RECEIPT_HANDLE, MESSAGE_BODY, MESSAGE_BODY_MD5,
+        MESSAGE_TAG, PUBLISH_TIME, FIRST_CONSUME_TIME, NEXT_CONSUME_TIME, CONSUMED_TIMES, MESSAGE_PROPERTIES};
+    for (int32_t i = 0; i < (int32_t)(sizeof(kNames) / sizeof(kNames[0])); ++i)
+    {
+        if (NameIs(name, nameSize, kNames[i]))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool MessagesStreamParser::startTag(const char* data, const size_t nameOffset,
+                                    const size_t nameSize, const bool selfClosing)
+{
+    const char* name = data + nameOffset;
+    size_t depth = mOpenTags.size();
+    if (depth == 0)
+    {
+        // <Error> and the like are for parseCommonError
+        if (!NameIs(name, nameSize, "Messages"))
+        {
+            return false;
+        }
+    }
+    else if (depth == 1)
+    {
+        mInMessage = NameIs(name, nameSize, MESSAGE);
+        if (mInMessage && mViews != NULL)
+        {
+            mViews->push_back(MessageView());
+        }
+        else if (mInMessage)
+        {
+            mMessages->push_back(Message());
+        }
+    }
+    else if (depth == 2 && mInMessage)
+    {
+        mPart = PartOf(name, nameSize);
+        mTextTaken = false;
+        if (mPart >= 0 && mViews != NULL)
+        {
+            // the last of repeated elements counts
+            MessageView& view = mViews->back();
+            uint32_t bit = 1u << mPart;
+            view.mPresent |= bit;
+            view.mCdata &= ~bit;
+            view.mEscaped &= ~bit;
+            view.mOffsets[mPart] = 0;
+            view.mSizes[mPart] = 0;
+        }
+        else if (mPart >= 0)
+        {
+            Message& message = mMessages->back();
+            std::string* targets[] = {&message.mMessageId, &message.mReceiptHandle, &message.mMessageBody,
+                &message.mMessageBodyMD5, &message.mMessageTag};
+            mTarget = mPart < MessageView::PART_PUBLISH_TIME ? targets[mPart] : &mText;
+            mTarget->clear();
+        }
+    }
+
+    if (selfClosing)
+    {
+        if (depth == 2)
+        {
+            finishField();
+        }
+        return true;
+    }
+    OpenTag tag;
+    tag.nameOffset = nameOffset;
+    tag.nameSize = nameSize;
+    mOpenTags.push_back(tag);
+    return true;
+}
+
+bool MessagesStreamParser::endTag(const char* data, const size_t nameOffset, const size_t nameSize)
+{
+    if (mOpenTags.empty())
+    {
+        return false;
+    }
+    const OpenTag& open = mOpenTags.back();
+    if (open.nameSize != nameSize || memcmp(data + open.nameOffset, data + nameOffset, nameSize) != 0)
+    {
+        return false;
+    }
+    mOpenTags.pop_back();
+    if (mOpenTags.size() == 2)
+    {
+        finishField();
+    }
+    else if (mOpenTags.empty())
+    {
+        mState = STATE_DONE;
+    }
+    return true;
+}
+
+// the UTF-8 of code at out, its length
+static size_t EncodeUtf8(char* out, const uint32_t code)
+{
+    if (code < 0x80)
+    {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800)
+    {
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+// length of the entity at data, 0 if it is not one and the '&' stays as it is;
+// what it stands for is written to out, which is never longer than the entity
+static size_t DecodeEntity(const char* data, const size_t size, char* out, size_t& outSize)
+{
+    const char* semi = (const char*)memchr(data, ';', size < 12 ? size : 12);
+    if (semi == NULL)
+    {
+        return 0;
+    }
+    size_t length = semi - data + 1;
+    if (data[1] == '#')
+    {
+        bool hex = length > 3 && data[2] == 'x';
+        uint32_t code = 0;
+        size_t digits = 0;
+        for (const char* p = data + (hex ? 3 : 2); p < semi; ++p, ++digits)
+        {
+            char c = *p;
+            if (c >= '0' && c <= '9')
+                code = code * (hex ? 16 : 10) + (c - '0');
+            else if (hex && c >= 'a' && c <= 'f')
+                code = code * 16 + (c - 'a' + 10);
+            else if (hex && c >= 'A' && c <= 'F')
+                code = code * 16 + (c - 'A' + 10);
+            else
+                return 0;
+        }
+        if (digits == 0 || code > 0x10FFFF)
+        {
+            return 0;
+        }
+        outSize = EncodeUtf8(out, code);
+        return length;
+    }
+    static const char* const kNames[] = {"&lt;", "&gt;", "&amp;", "&quot;", "&apos;"};
+    static const char kChars[] = {'<', '>', '&', '"', '\''};
+    for (size_t i = 0; i < sizeof(kChars); ++i)
+    {
+        if (strlen(kNames[i]) == length && memcmp(data, kNames[i], length) == 0)
+        {
+            out[0] = kChars[i];
+            outSize = 1;
+            return length;
+        }
+    }
+    return 0;
+}
+
+// whether text has anything DecodeText changes
+static inline bool NeedsDecoding(const char* data, const size_t size, const bool cdata)
+{
+    return memchr(data, '\r', size) != NULL || (!cdata && memchr(data, '&', size) != NULL);
+}
+
+/*
+ * the text as pugixml gives it: entities decoded unless in CDATA, line ends
+ * as '\n'. out may be data itself, the result is never longer; its length
+ */
+static size_t DecodeText(const char* data, const size_t size, const bool cdata, char* out)
+{
+    size_t i = 0;
+    size_t o = 0;
+    while (i < size)
+    {
+        size_t run = i;
+        while (i < size && data[i] != '\r' && (cdata || data[i] != '&'))
+        {
+            ++i;
+        }
+        memmove(out + o, data + run, i - run);
+        o += i - run;
+        if (i == size)
+        {
+            break;
+        }
+        if (data[i] == '\r')
+        {
+            out[o++] = '\n';
+            i += (i + 1 < size && data[i + 1] == '\n') ? 2 : 1;
+            continue;
+        }
+        size_t outSize = 0;
+        size_t length = DecodeEntity(data + i, size - i, out + o, outSize);
+        if (length == 0)
+        {
+            out[o++] = '&';
+            length = 1;
+        }
+        else
+        {
+            o += outSize;
+        }
+        i += length;
+    }
+    return o;
+}
+
+void MessagesStreamParser::text(const char* data, const size_t begin, const size_t size, const bool cdata)
+{
+    // the text of an element is its first text node, as text() of pugixml
+    if (mTextTaken)
+    {
+        return;
+    }
+    const char* text = data + begin;
+    bool blank = !cdata;
+    for (size_t i = 0; blank && i < size; ++i)
+    {
+        blank = IsXmlSpace(text[i]);
+    }
+    // pugixml keeps no whitespace-only text nodes
+    if (blank)
+    {
+        return;
+    }
+    mTextTaken = true;
+    bool escaped = NeedsDecoding(text, size, cdata);
+    if (mViews != NULL)
+    {
+        // decoded in place once the body is complete, see ConsumeBatch::finish
+        MessageView& view = mViews->back();
+        uint32_t bit = 1u << mPart;
+        view.mOffsets[mPart] = (uint32_t)begin;
+        view.mSizes[mPart] = (uint32_t)size;
+        if (cdata)
+            view.mCdata |= bit;
+        if (escaped)
+            view.mEscaped |= bit;
+        return;
+    }
+    std::string& out = *mTarget;
+    if (!escaped)
+    {
+        out.append(text, size);
+        return;
+    }
+    size_t old = out.size();
+    out.resize(old + size);
+    out.resize(old + DecodeText(text, size, cdata, &out[old]));
+}
+
+void MessagesStreamParser::finishField()
+{
+    if (mPart >= MessageView::PART_PUBLISH_TIME && mViews == NULL)
+    {
+        Message& message = mMessages->back();
+        switch (mPart)
+        {
+            case MessageView::PART_PUBLISH_TIME:
+                message.mPublishTime = atol(mText.c_str());
+                break;
+            case MessageView::PART_FIRST_CONSUME_TIME:
+                message.mFirstConsumeTime = atol(mText.c_str());
+                break;
+            case MessageView::PART_NEXT_CONSUME_TIME:
+                message.mNextConsumeTime = atol(mText.c_str());
+                break;
+            case MessageView::PART_CONSUMED_TIMES:
+                message.mConsumedTimes = atoi(mText.c_str());
+                break;
+            case MessageView::PART_PROPERTIES:
+                MQUtils::stringToMap(mText, message.mProperties);
+                break;
+            default:
+                break;
+        }
+    }
+    mPart = -1;
+    mTarget = NULL;
+}
+
+// atol of a piece of text
+static int64_t ParseInteger(const char* data, const size_t size)
+{
+    size_t i = 0;
+    while (i < size && (IsXmlSpace(data[i]) || data[i] == '\v' || data[i] == '\f'))
+    {
+        ++i;
+    }
+    bool negative = false;
+    if (i < size && (data[i] == '-' || data[i] == '+'))
+    {
+        negative = data[i] == '-';
+        ++i;
+    }
+    int64_t value = 0;
+    for (; i < size && data[i] >= '0' && data[i] <= '9'; ++i)
+    {
+        value = value * 10 + (data[i] - '0');
+    }
+    return negative ? -value : value;
+}
+
+// read as MQUtils::stringToMap does: "key:value|" pairs, the last of a key counts
+static MQStringView FindProperty(const MQStringView& properties, const MQStringView& key)
+{
+    MQStringView value;
+    const char* kv = properties.begin();
+    const char* end = properties.end();
+    while (kv < end)
+    {
+        const char* bar = (const char*)memchr(kv, '|', end - kv);
+        if (bar == NULL)
+        {
+            break;
+        }
+        const char* colon = (const char*)memchr(kv, ':', bar - kv);
+        MQStringView name(kv, (colon != NULL ? colon : bar) - kv);
+        if (name == key)
+        {
+            value = colon != NULL ? MQStringView(colon + 1, bar - colon - 1) : MQStringView(kv, bar - kv);
+        }
+        kv = bar + 1;
+    }
+    return value;
+}
+
+MQStringView MessageView::getProperty(const MQStringView& key) const
+{
+    return FindProperty(part(PART_PROPERTIES), key);
+}
+
+int32_t MessageView::getTransCheckImmunityTime() const
+{
+    MQStringView value = getProperty(MQStringView(MESSAGE_PROP_TRANS_CHECK, strlen(MESSAGE_PROP_TRANS_CHECK)));
+    return (int32_t)ParseInteger(value.data(), value.size());
+}
+
+int64_t MessageView::getStartDeliverTime() const
+{
+    MQStringView value = getProperty(MQStringView(MESSAGE_PROP_TIMER, strlen(MESSAGE_PROP_TIMER)));
+    return ParseInteger(value.data(), value.size());
+}
+
+void MessageView::toMessage(Message& message) const
+{
+    message.mMessageId.assign(getMessageId().data(), getMessageId().size());
+    message.mReceiptHandle.assign(getReceiptHandle().data(), getReceiptHandle().size());
+    message.mMessageBody.assign(getMessageBody().data(), getMessageBody().size());
+    message.mMessageBodyMD5.assign(getMessageBodyMD5().data(), getMessageBodyMD5().size());
+    message.mMessageTag.assign(getMessageTag().data(), getMessageTag().size());
+    message.mPublishTime = mPublishTime;
+    message.mFirstConsumeTime = mFirstConsumeTime;
+    message.mNextConsumeTime = mNextConsumeTime;
+    message.mConsumedTimes = mConsumedTimes;
+    message.mProperties.clear();
+    MQUtils::stringToMap(getPropertiesAsString().str(), message.mProperties);
+}
+
+void MessageView::finish(char* base)
+{
+    for (int32_t i = 0; i < PART_COUNT; ++i)
+    {
+        if (mEscaped & (1u << i))
+        {
+            char* text = base + mOffsets[i];
+            mSizes[i] = (uint32_t)DecodeText(text, mSizes[i], (mCdata & (1u << i)) != 0, text);
+        }
+    }
+    mEscaped = 0;
+    if (mPresent & (1u << PART_PUBLISH_TIME))
+    {
+        mPublishTime = ParseInteger(base + mOffsets[PART_PUBLISH_TIME], mSizes[PART_PUBLISH_TIME]);
+    }
+    if (mPresent & (1u << PART_FIRST_CONSUME_TIME))
+    {
+        mFirstConsumeTime = ParseInteger(base + mOffsets[PART_FIRST_CONSUME_TIME], mSizes[PART_FIRST_CONSUME_TIME]);
+    }
+    if (mPresent & (1u << PART_NEXT_CONSUME_TIME))
+    {
+        mNextConsumeTime = ParseInteger(base + mOffsets[PART_NEXT_CONSUME_TIME], mSizes[PART_NEXT_CONSUME_TIME]);
+    }
+    if (mPresent & (1u << PART_CONSUMED_TIMES))
+    {
+        mConsumedTimes = (int32_t)ParseInteger(base + mOffsets[PART_CONSUMED_TIMES], mSizes[PART_CONSUMED_TIMES]);
+    }
+}
+
+void MessageView::assign(Message& message, std::string& buffer)
+{
+    std::string properties;
+    const std::map<std::string, std::string>& map = message.getProperties();
+    for (std::map<std::string, std::string>::const_iterator iter = map.begin(); iter != map.end(); ++iter)
+    {
+        properties.append(iter->first).append(":").append(iter->second).append("|");
+    }
+    const std::string* parts[] = {&message.getMessageId(), &message.getReceiptHandle(), &message.getMessageBody(),
+        &message.getMessageBodyMD5(), &message.getMessageTag(), NULL, NULL, NULL, NULL, &properties};
+
+    for (int32_t i = 0; i < PART_COUNT; ++i)
+    {
+        if (parts[i] != NULL)
+        {
+            mOffsets[i] = (uint32_t)buffer.size();
+            mSizes[i] = (uint32_t)parts[i]->size();
+            buffer.append(*parts[i]);
+        }
+    }
+    mPublishTime = message.getPublishTime();
+    mFirstConsumeTime = message.getFirstConsumeTime();
+    mNextConsumeTime = message.getNextConsumeTime();
+    mConsumedTimes = message.getConsumedTimes();
+}
+
+void ConsumeBatch::getReceiptHandles(std::vector<std::string>& receiptHandles) const
+{
+    receiptHandles.reserve(receiptHandles.size() + mMessages.size());
+    for (const_iterator iter = mMessages.begin(); iter != mMessages.end(); ++iter)
+    {
+        MQStringView receiptHandle = iter->getReceiptHandle();
+        receiptHandles.push_back(std::string(receiptHandle.data(), receiptHandle.size()));
+    }
+}
+
+void ConsumeBatch::finish(std::string& body)
+{
+    mBuffer.swap(body);
+    char* base = mBuffer.empty() ? NULL : &mBuffer[0];
+    for (std::vector<MessageView>::iterator iter = mMessages.begin(); iter != mMessages.end(); ++iter)
+    {
+        iter->finish(base);
+    }
+    bind();
+}
+
+void ConsumeBatch::append(Message& message)
+{
+    mMessages.push_back(MessageView());
+    mMessages.back().assign(message, mBuffer);
+}
+
+MQStringView MessageBatch::getProperty(const size_t index, const MQStringView& key) const
+{
+    return FindProperty(column(COLUMN_PROPERTIES, index), key);
+}
+
+void MessageBatch::getReceiptHandles(std::vector<std::string>& receiptHandles) const
+{
+    const std::vector<Slice>& slices = mColumns[COLUMN_RECEIPT_HANDLE];
+    receiptHandles.reserve(receiptHandles.size() + slices.size());
+    for (std::vector<Slice>::const_iterator iter = slices.begin(); iter != slices.end(); ++iter)
+    {
+        receiptHandles.push_back(std::string(mArena.data() + iter->offset, iter->size));
+    }
+}
+
+void MessageBatch::clear()
+{
+    mArena.clear();
+    for (int32_t i = 0; i < COLUMN_COUNT; ++i)
+    {
+        mColumns[i].clear();
+    }
+    mPublishTimes.clear();
+    mFirstConsumeTimes.clear();
+    mNextConsumeTimes.clear();
+    mConsumedTimes.clear();
+}
+
+void MessageBatch::assign(std::string& arena, const std::vector<MessageView>& views)
+{
+    static const int32_t kParts[COLUMN_COUNT] = {MessageView::PART_MESSAGE_ID, MessageView::PART_RECEIPT_HANDLE,
+        MessageView::PART_MESSAGE_BODY, MessageView::PART_MESSAGE_BODY_MD5, MessageView::PART_MESSAGE_TAG,
+        MessageView::PART_PROPERTIES};
+
+    clear();
+    // the previous arena goes back with the response, to its buffer pool
+    mArena.swap(arena);
+    for (int32_t i = 0; i < COLUMN_COUNT; ++i)
+    {
+        std::vector<Slice>& slices = mColumns[i];
+        slices.resize(views.size());
+        for (size_t j = 0; j < views.size(); ++j)
+        {
+            slices[j].offset = views[j].mOffsets[kParts[i]];
+            slices[j].size = views[j].mSizes[kParts[i]];
+        }
+    }
+    mPublishTimes.resize(views.size());
+    mFirstConsumeTimes.resize(views.size());
+    mNextConsumeTimes.resize(views.size());
+    mConsumedTimes.resize(views.size());
+    for (size_t j = 0; j < views.size(); ++j)
+    {
+        mPublishTimes[j] = views[j].mPublishTime;
+        mFirstConsumeTimes[j] = views[j].mFirstConsumeTime;
+        mNextConsumeTimes[j] = views[j].mNextConsumeTime;
+        mConsumedTimes[j] = views[j].mConsumedTimes;
+    }
+}
+
+void ConsumeBatch::bind()
+{
+    for (std::vector<MessageView>::iterator iter = mMessages.begin(); iter != mMessages.end(); ++iter)
+    {
+        iter->mBase = mBuffer.data();
+    }
+}
+
 ConsumeMessageRequest::ConsumeMessageRequest(
     const std::string& instanceId,
     const std::string& topicName,
@@ -184,6 +1069,18 @@ const std::string& ConsumeMessageRequest::generateRequestBody()
 
 void ConsumeMessageResponse::parseResponse()
 {
+    if (isSuccess())
+    {
+        // the transports without streaming hand over the whole body here
+        mParser.feed(mRawData.data(), mRawData.size());
+        if (mParser.isComplete())
+        {
+            publish();
+            return;
+        }
+    }
+    mParser.reset();
+
     pugi::xml_node rootNode = toXML();
     if (!isSuccess())
     {
@@ -203,13 +1100,14 @@ void ConsumeMessageResponse::parseResponse()
         if (0 == strcmp(MESSAGE, name))
         {
             Message message;
-            mMessages->push_back(message);
-            mMessages->at(index).initFromXml(iterNode);
+            mStaged.push_back(message);
+            mStaged.at(index).initFromXml(iterNode);
             index += 1;
         }
 
         iterNode = iterNode.next_sibling();
     }
+    publish();
 }
 
 bool ConsumeMessageResponse::isSuccess()
@@ -217,12 +1115,193 @@ bool ConsumeMessageResponse::isSuccess()
     return mStatus == 200;
 }
 
+ConsumeBatchResponse::ConsumeBatchResponse(ConsumeBatch& batch)
+    : Response(), mBatch(&batch), mParser(batch.mMessages)
+{
+    setRetainHeaders(false);
+}
+
+void ConsumeBatchResponse::onBodyReceived(const size_t size)
+{
+    mParser.feed(mRawData.data(), size);
+}
+
+void ConsumeBatchResponse::onBodyCleared()
+{
+    mParser.reset();
+}
+
+void ConsumeBatchResponse::parseResponse()
+{
+    if (isSuccess())
+    {
+        mParser.feed(mRawData.data(), mRawData.size());
+        if (mParser.isComplete())
+        {
+            mBatch->finish(mRawData);
+            return;
+        }
+    }
+    mParser.reset();
+
+    pugi::xml_node rootNode = toXML();
+    if (!isSuccess())
+    {
+        parseCommonError(rootNode);
+        return;
+    }
+
+    // what the stream parser left to pugixml is copied into the batch
+    for (xml_node iterNode = rootNode.first_child(); !iterNode.empty(); iterNode = iterNode.next_sibling())
+    {
+        if (iterNode.type() == node_element && 0 == strcmp(MESSAGE, iterNode.name()))
+        {
+            Message message;
+            message.initFromXml(iterNode);
+            mBatch->append(message);
+        }
+    }
+    mBatch->bind();
+}
+
+bool ConsumeBatchResponse::isSuccess()
+{
+    return mStatus == 200;
+}
+
+MessageBatchResponse::MessageBatchResponse(MessageBatch& batch)
+    : Response(), mBatch(&batch), mParser(mViews)
+{
+    setRetainHeaders(false);
+}
+
+void MessageBatchResponse::onBodyReceived(const size_t size)
+{
+    mParser.feed(mRawData.data(), size);
+}
+
+void MessageBatchResponse::onBodyCleared()
+{
+    mParser.reset();
+}
+
+void MessageBatchResponse::parseResponse()
+{
+    if (isSuccess())
+    {
+        mParser.feed(mRawData.data(), mRawData.size());
+        if (mParser.isComplete())
+        {
+            char* base = mRawData.empty() ? NULL : &mRawData[0];
+            for (std::vector<MessageView>::iterator iter = mViews.begin(); iter != mViews.end(); ++iter)
+            {
+                iter->finish(base);
+            }
+            mBatch->assign(mRawData, mViews);
+            return;
+        }
+    }
+    mParser.reset();
+
+    pugi::xml_node rootNode = toXML();
+    if (!isSuccess())
+    {
+        parseCommonError(rootNode);
+        return;
+    }
+
+    // what the stream parser left to pugixml is copied into a new arena
+    std::string arena;
+    for (xml_node iterNode = rootNode.first_child(); !iterNode.empty(); iterNode = iterNode.next_sibling())
+    {
+        if (iterNode.type() == node_element && 0 == strcmp(MESSAGE, iterNode.name()))
+        {
+            Message message;
+            message.initFromXml(iterNode);
+            mViews.push_back(MessageView());
+            mViews.back().assign(message, arena);
+        }
+    }
+    mBatch->assign(arena, mViews);
+}
+
+bool MessageBatchResponse::isSuccess()
+{
+    return mStatus == 200;
+}
+
+// what pugixml escapes in pcdata: &, <, > and control characters but \t, \r, \n
+static inline bool IsSpecialPcdata(const unsigned char c)
+{
+    return c == '&' || c == '<' || c == '>' || (c < 32 && c != '\t' && c != '\r' && c != '\n');
+}
+
+// pugixml stops at the first NUL of a c string, so does the escaping
+static size_t PcdataLength(const std::string& text)
+{
+    size_t pos = text.find('\0');
+    return pos == std::string::npos ? text.size() : pos;
+}
+
+static void AppendEscapedPcdata(std::string& out, const char* text, const size_t size)
+{
+    const char* end = text + size;
+    while (text < end)
+    {
+        const char* prev = text;
+        while (text < end && !IsSpecialPcdata((unsigned char)*text))
+        {
+            ++text;
+        }
+        out.append(prev, text - prev);
+        if (text == end)
+        {
+            break;
+        }
+        unsigned char ch = (unsigned char)*text++;
+        switch (ch)
+        {
+            case '&':
+                out.append("&amp;");
+                break;
+            case '<':
+                out.append("&lt;");
+                break;
+            case '>':
+                out.append("&gt;");
+                break;
+            default:
+                out.push_back('&');
+                out.push_back('#');
+                out.push_back((char)('0' + ch / 10));
+                out.push_back((char)('0' + ch % 10));
+                out.push_back(';');
+        }
+    }
+}
+
+static void AppendPcdataElement(std::string& out, const char* name, const std::string& text)
+{
+    out.append("\t<").append(name).append(">");
+    AppendEscapedPcdata(out, text.data(), PcdataLength(text));
+    out.append("</").append(name).append(">\n");
+}
+
 AckMessageRequest::AckMessageRequest(const std::string& instanceId,
     const std::string& topicName,
     const std::string& consumer,
     const std::vector<std::string>& receiptHandles)
     : Request("DELETE"), mInstanceId(&instanceId), mTopicName(&topicName), mConsumer(&consumer),
-        mReceiptHandles(&receiptHandles)
+        mReceiptHandles(&receiptHandles), mBatch(NULL)
+{
+}
+
+AckMessageRequest::AckMessageRequest(const std::string& instanceId,
+    const std::string& topicName,
+    const std::string& consumer,
+    const MessageBatch& batch)
+    : Request("DELETE"), mInstanceId(&instanceId), mTopicName(&topicName), mConsumer(&consumer),
+        mReceiptHandles(NULL), mBatch(&batch)
 {
 }
 
@@ -242,21 +1321,26 @@ std::string AckMessageRequest::getQueryString()
 
 const std::string& AckMessageRequest::generateRequestBody()
 {
-    pugi::xml_document doc;
-    doc.load("<?xml version=\"1.0\" encoding=\"UTF-8\"?>", pugi::parse_declaration);
-    pugi::xml_node node = doc.append_child("ReceiptHandles");
-    node.append_attribute("xmlns") = MQ_XML_NAMESPACE_V1;
-
-    for (std::vector<std::string>::const_iterator iter = mReceiptHandles->begin();
-        iter != mReceiptHandles->end(); ++iter)
+    // the layout pugixml wrote with format_default, without building a document
+    size_t count = mBatch != NULL ? mBatch->size() : mReceiptHandles->size();
+    mRequestBody = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<ReceiptHandles xmlns=\"";
+    mRequestBody.append(MQ_XML_NAMESPACE_V1);
+    if (count == 0)
     {
-        node.append_child("ReceiptHandle").append_child(
-            pugi::node_pcdata).set_value(iter->c_str());
+        mRequestBody.append("\" />\n");
+        return mRequestBody;
     }
-
-    ostringstream os;
-    doc.save(os);
-    mRequestBody = os.str();
+    mRequestBody.append("\">\n");
+    for (size_t i = 0; i < count; ++i)
+    {
+        MQStringView receiptHandle = mBatch != NULL ? mBatch->getReceiptHandle(i) : MQStringView((*mReceiptHandles)[i]);
+        const char* nul = (const char*)memchr(receiptHandle.data(), '\0', receiptHandle.size());
+        mRequestBody.append("\t<ReceiptHandle>");
+        AppendEscapedPcdata(mRequestBody, receiptHandle.data(),
+            nul != NULL ? nul - receiptHandle.data() : receiptHandle.size());
+        mRequestBody.append("</ReceiptHandle>\n");
+    }
+    mRequestBody.append("</ReceiptHandles>\n");
     return mRequestBody;
 }
 
@@ -343,30 +1427,58 @@ string PublishMessageRequest::getQueryString()
     return "";
 }
 
-const string& PublishMessageRequest::generateRequestBody()
+void PublishMessageRequest::generateBodySegments()
 {
-    pugi::xml_document doc;
-    doc.load("<?xml version=\"1.0\" encoding=\"UTF-8\"?>", pugi::parse_declaration);
-    pugi::xml_node node = doc.append_child("Message");
-    node.append_attribute("xmlns") = MQ_XML_NAMESPACE_V1;
-
-    node.append_child(MESSAGE_BODY).append_child(
-        pugi::node_pcdata).set_value(mMessageBody->c_str());
+    // the layout pugixml wrote with format_default, without building a document
+    mBodyHead = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Message xmlns=\"";
+    mBodyHead.append(MQ_XML_NAMESPACE_V1).append("\">\n\t<").append(MESSAGE_BODY).append(">");
 
+    mBodyTail = "</";
+    mBodyTail.append(MESSAGE_BODY).append(">\n");
     if (mMessageTag != NULL && *mMessageTag != "")
     {
-        node.append_child(MESSAGE_TAG).append_child(
-            pugi::node_pcdata).set_value(mMessageTag->c_str());
+        AppendPcdataElement(mBodyTail, MESSAGE_TAG, *mMessageTag);
     }
     if (mProperties != "")
     {
-        node.append_child(MESSAGE_PROPERTIES).append_child(
-            pugi::node_pcdata).set_value(mProperties.c_str());
+        AppendPcdataElement(mBodyTail, MESSAGE_PROPERTIES, mProperties);
     }
+    mBodyTail.append("</Message>\n");
 
-    ostringstream os;
-    doc.save(os);
-    mRequestBody = os.str();
+    clearBodySegments();
+    appendBodySegment(mBodyHead.data(), mBodyHead.size());
+    const char* body = mMessageBody->data();
+    size_t bodySize = PcdataLength(*mMessageBody);
+    size_t clean = 0;
+    while (clean < bodySize && !IsSpecialPcdata((unsigned char)body[clean]))
+    {
+        ++clean;
+    }
+    if (clean == bodySize)
+    {
+        mEscapedBody.clear();
+        appendBodySegment(body, bodySize);
+    }
+    else
+    {
+        mEscapedBody.clear();
+        mEscapedBody.reserve(bodySize + bodySize / 8);
+        AppendEscapedPcdata(mEscapedBody, body, bodySize);
+        appendBodySegment(mEscapedBody.data(), mEscapedBody.size());
+    }
+    appendBodySegment(mBodyTail.data(), mBodyTail.size());
+}
+
+const string& PublishMessageRequest::generateRequestBody()
+{
+    generateBodySegments();
+    mRequestBody.clear();
+    mRequestBody.reserve(mBodySize);
+    for (std::vector<RequestBodySegment>::const_iterator iter = mBodySegments.begin();
+        iter != mBodySegments.end(); ++iter)
+    {
+        mRequestBody.append(iter->data, iter->size);
+    }
     return mRequestBody;
 }
 
@@ -102,6 +102,7 @@ class TopicMessage
         }
 
         friend class MQProducer;
+        friend class MQAsyncProducer;
     protected:
         const std::string mMessageBody;
         const std::string mMessageTag;
@@ -232,6 +233,10 @@ public:
     }
 
     friend class ConsumeMessageResponse;
+    friend class ConsumeBatchResponse;
+    friend class MessageBatchResponse;
+    friend class MessagesStreamParser;
+    friend class MessageView;
 
 protected:
     void initFromXml(const pugi::xml_node& messageNode);
@@ -249,11 +254,465 @@ protected:
     int32_t mConsumedTimes;
 };
 
+/*
+ * a piece of a string owned elsewhere, e.g. of the buffer of a ConsumeBatch
+ */
+class MQStringView
+{
+public:
+    MQStringView()
+        : mData(""), mSize(0)
+    {
+    }
+
+    MQStringView(const char* data, const size_t size)
+        : mData(data), mSize(size)
+    {
+    }
+
+    MQStringView(const std::string& str)
+        : mData(str.data()), mSize(str.size())
+    {
+    }
+
+    const char* data() const
+    {
+        return mData;
+    }
+
+    size_t size() const
+    {
+        return mSize;
+    }
+
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+
+    const char* begin() const
+    {
+        return mData;
+    }
+
+    const char* end() const
+    {
+        return mData + mSize;
+    }
+
+    char operator[](const size_t index) const
+    {
+        return mData[index];
+    }
+
+    std::string str() const
+    {
+        return std::string(mData, mSize);
+    }
+
+    bool operator==(const MQStringView& other) const
+    {
+        return mSize == other.mSize && memcmp(mData, other.mData, mSize) == 0;
+    }
+
+    bool operator!=(const MQStringView& other) const
+    {
+        return !(*this == other);
+    }
+
+protected:
+    const char* mData;
+    size_t mSize;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const MQStringView& view)
+{
+    return os.write(view.data(), view.size());
+}
+
+/*
+ * a consumed message read in place from the body of the consume response,
+ * valid as long as the ConsumeBatch holding it
+ */
+class MessageView
+{
+public:
+    MessageView()
+        : mBase(""), mPresent(0), mCdata(0), mEscaped(0)
+        , mPublishTime(-1), mNextConsumeTime(-1), mFirstConsumeTime(-1), mConsumedTimes(-1)
+    {
+        for (int32_t i = 0; i < PART_COUNT; ++i)
+        {
+            mOffsets[i] = 0;
+            mSizes[i] = 0;
+        }
+    }
+
+    MQStringView getMessageId() const
+    {
+        return part(PART_MESSAGE_ID);
+    }
+
+    MQStringView getReceiptHandle() const
+    {
+        return part(PART_RECEIPT_HANDLE);
+    }
+
+    MQStringView getMessageBody() const
+    {
+        return part(PART_MESSAGE_BODY);
+    }
+
+    MQStringView getMessageBodyMD5() const
+    {
+        return part(PART_MESSAGE_BODY_MD5);
+    }
+
+    MQStringView getMessageTag() const
+    {
+        return part(PART_MESSAGE_TAG);
+    }
+
+    int64_t getPublishTime() const
+    {
+        return mPublishTime;
+    }
+
+    /**
+     * it's meaningless for orderly consume
+     */
+    int64_t getFirstConsumeTime() const
+    {
+        return mFirstConsumeTime;
+    }
+
+    int64_t getNextConsumeTime() const
+    {
+        return mNextConsumeTime;
+    }
+
+    int32_t getConsumedTimes() const
+    {
+        return mConsumedTimes;
+    }
+
+    /* the properties as sent, "key:value|key:value|" */
+    MQStringView getPropertiesAsString() const
+    {
+        return part(PART_PROPERTIES);
+    }
+
+    /* empty when the property is missing */
+    MQStringView getProperty(const MQStringView& key) const;
+
+    MQStringView getMessageKey() const
+    {
+        return getProperty(MQStringView(MESSAGE_PROP_KEY, strlen(MESSAGE_PROP_KEY)));
+    }
+
+    int32_t getTransCheckImmunityTime() const;
+
+    int64_t getStartDeliverTime() const;
+
+    MQStringView getShardingKey() const
+    {
+        return getProperty(MQStringView(MESSAGE_PROP_SHARDING, strlen(MESSAGE_PROP_SHARDING)));
+    }
+
+    /* copy out into a Message that outlives the batch */
+    void toMessage(Message& message) const;
+
+    friend class MessagesStreamParser;
+    friend class ConsumeBatch;
+    friend class MessageBatch;
+    friend class MessageBatchResponse;
+
+protected:
+    // the elements of a <Message> the view keeps
+    enum Part
+    {
+        PART_MESSAGE_ID,
+        PART_RECEIPT_HANDLE,
+        PART_MESSAGE_BODY,
+        PART_MESSAGE_BODY_MD5,
+        PART_MESSAGE_TAG,
+        PART_PUBLISH_TIME,
+        PART_FIRST_CONSUME_TIME,
+        PART_NEXT_CONSUME_TIME,
+        PART_CONSUMED_TIMES,
+        PART_PROPERTIES,
+        PART_COUNT
+    };
+
+    MQStringView part(const int32_t index) const
+    {
+        return MQStringView(mBase + mOffsets[index], mSizes[index]);
+    }
+
+    // decode the text of a body the parser went through in place, read the numbers
+    void finish(char* base);
+    // copy a message the DOM path read to the end of buffer
+    void assign(Message& message, std::string& buffer);
+
+    // the buffer of the batch, set once the body is complete
+    const char* mBase;
+    uint32_t mOffsets[PART_COUNT];
+    uint32_t mSizes[PART_COUNT];
+    // bits by Part: the element was there, its text is CDATA, its text has escapes to decode
+    uint32_t mPresent;
+    uint32_t mCdata;
+    uint32_t mEscaped;
+    int64_t mPublishTime;
+    int64_t mNextConsumeTime;
+    int64_t mFirstConsumeTime;
+    int32_t mConsumedTimes;
+};
+
+/*
+ * the messages of one consume, all read in place from the response body the
+ * batch keeps: reading them allocates nothing. Shared so that the body stays
+ * as long as any handler holds on to the batch.
+ */
+class ConsumeBatch
+{
+public:
+    typedef std::vector<MessageView>::const_iterator const_iterator;
+
+    ConsumeBatch() {}
+
+    size_t size() const
+    {
+        return mMessages.size();
+    }
+
+    bool empty() const
+    {
+        return mMessages.empty();
+    }
+
+    const MessageView& operator[](const size_t index) const
+    {
+        return mMessages[index];
+    }
+
+    const_iterator begin() const
+    {
+        return mMessages.begin();
+    }
+
+    const_iterator end() const
+    {
+        return mMessages.end();
+    }
+
+    /* appends the receipt handles of all messages, for MQConsumer::ackMessage */
+    void getReceiptHandles(std::vector<std::string>& receiptHandles) const;
+
+    friend class MessagesStreamParser;
+    friend class ConsumeBatchResponse;
+
+protected:
+    // take over a body the parser went through: decode its text in place
+    void finish(std::string& body);
+    // a message the DOM path read, copied into the buffer
+    void append(Message& message);
+    // point the views at the buffer, once it no longer grows
+    void bind();
+
+    std::string mBuffer;
+    std::vector<MessageView> mMessages;
+
+private:
+    ConsumeBatch(const ConsumeBatch&);
+    ConsumeBatch& operator=(const ConsumeBatch&);
+};
+#ifdef __APPLE__
+typedef std::shared_ptr<ConsumeBatch> ConsumeBatchPtr;
+#else
+typedef std::tr1::shared_ptr<ConsumeBatch> ConsumeBatchPtr;
+#endif
+
+/*
+ * the messages of one consume laid out by column: the numbers of all
+ * messages in one array each, the strings as offset tables into one arena,
+ * the response body with its text decoded in place. A loop over one field
+ * of every message reads that column and nothing else.
+ *
+ * A batch can be consumed into again and again, it keeps its capacity.
+ */
+class MessageBatch
+{
+public:
+    MessageBatch() {}
+
+    size_t size() const
+    {
+        return mPublishTimes.size();
+    }
+
+    bool empty() const
+    {
+        return mPublishTimes.empty();
+    }
+
+    MQStringView getMessageId(const size_t index) const
+    {
+        return column(COLUMN_MESSAGE_ID, index);
+    }
+
+    MQStringView getReceiptHandle(const size_t index) const
+    {
+        return column(COLUMN_RECEIPT_HANDLE, index);
+    }
+
+    MQStringView getMessageBody(const size_t index) const
+    {
+        return column(COLUMN_MESSAGE_BODY, index);
+    }
+
+    MQStringView getMessageBodyMD5(const size_t index) const
+    {
+        return column(COLUMN_MESSAGE_BODY_MD5, index);
+    }
+
+    MQStringView getMessageTag(const size_t index) const
+    {
+        return column(COLUMN_MESSAGE_TAG, index);
+    }
+
+    /* "key:value|key:value|" */
+    MQStringView getPropertiesAsString(const size_t index) const
+    {
+        return column(COLUMN_PROPERTIES, index);
+    }
+
+    /* empty when the property is missing */
+    MQStringView getProperty(const size_t index, const MQStringView& key) const;
+
+    int64_t getPublishTime(const size_t index) const
+    {
+        return mPublishTimes[index];
+    }
+
+    int64_t getFirstConsumeTime(const size_t index) const
+    {
+        return mFirstConsumeTimes[index];
+    }
+
+    int64_t getNextConsumeTime(const size_t index) const
+    {
+        return mNextConsumeTimes[index];
+    }
+
+    int32_t getConsumedTimes(const size_t index) const
+    {
+        return mConsumedTimes[index];
+    }
+
+    /* the columns of the numbers, size() values each */
+    const std::vector<int64_t>& getPublishTimes() const
+    {
+        return mPublishTimes;
+    }
+
+    const std::vector<int64_t>& getFirstConsumeTimes() const
+    {
+        return mFirstConsumeTimes;
+    }
+
+    const std::vector<int64_t>& getNextConsumeTimes() const
+    {
+        return mNextConsumeTimes;
+    }
+
+    const std::vector<int32_t>& getConsumedTimes() const
+    {
+        return mConsumedTimes;
+    }
+
+    /* appends the receipt handles of all messages */
+    void getReceiptHandles(std::vector<std::string>& receiptHandles) const;
+
+    void clear();
+
+    friend class MessageBatchResponse;
+
+protected:
+    enum Column
+    {
+        COLUMN_MESSAGE_ID,
+        COLUMN_RECEIPT_HANDLE,
+        COLUMN_MESSAGE_BODY,
+        COLUMN_MESSAGE_BODY_MD5,
+        COLUMN_MESSAGE_TAG,
+        COLUMN_PROPERTIES,
+        COLUMN_COUNT
+    };
+
+    // a string of a message in the arena
+    struct Slice
+    {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    MQStringView column(const Column column, const size_t index) const
+    {
+        const Slice& slice = mColumns[column][index];
+        return MQStringView(mArena.data() + slice.offset, slice.size);
+    }
+
+    // take over the arena and the views read from it, views finished
+    void assign(std::string& arena, const std::vector<MessageView>& views);
+
+    std::string mArena;
+    std::vector<Slice> mColumns[COLUMN_COUNT];
+    std::vector<int64_t> mPublishTimes;
+    std::vector<int64_t> mFirstConsumeTimes;
+    std::vector<int64_t> mNextConsumeTimes;
+    std::vector<int32_t> mConsumedTimes;
+
+private:
+    MessageBatch(const MessageBatch&);
+    MessageBatch& operator=(const MessageBatch&);
+};
+
+class MQRequestTemplate;
+#ifdef __APPLE__
+typedef std::shared_ptr<MQRequestTemplate> MQRequestTemplatePtr;
+#else
+typedef std::tr1::shared_ptr<MQRequestTemplate> MQRequestTemplatePtr;
+#endif
+
+/*
+ * what a request holds its connection for, pooled connections are
+ * shared out per class, see MQConnectionConfig
+ */
+enum RequestClass
+{
+    REQUEST_CLASS_DEFAULT = 0,
+    // consume with waitSeconds, parks the connection on the server
+    REQUEST_CLASS_LONG_POLL = 1,
+    REQUEST_CLASS_PUBLISH = 2,
+    // ack, commit and rollback of received messages
+    REQUEST_CLASS_ACK = 3,
+    REQUEST_CLASS_COUNT = 4
+};
+
+/*
+ * a piece of the request body, pointing into the request or caller owned memory
+ */
+struct RequestBodySegment
+{
+    const char* data;
+    size_t size;
+};
+
 class Request
 {
 public:
     Request(const std::string& method)
-        : mMethod(method), mCanonicalizedResource(""), mRequestBody("")
+        : mMethod(method), mCanonicalizedResource(""), mRequestBody(""), mBodySize(0)
     {}
     virtual ~Request() {};
 
@@ -296,6 +755,31 @@ public:
 
     virtual const std::string& generateRequestBody() = 0;
 
+    /* lay out the body as segments sent in order, without copying large parts
+     * into one buffer where the request can avoid it. The default is the
+     * single segment of generateRequestBody. */
+    virtual void generateBodySegments()
+    {
+        const std::string& body = generateRequestBody();
+        clearBodySegments();
+        appendBodySegment(body.data(), body.size());
+    }
+
+    const std::vector<RequestBodySegment>& getBodySegments() const
+    {
+        return mBodySegments;
+    }
+
+    size_t getBodySize() const
+    {
+        return mBodySize;
+    }
+
+    virtual RequestClass getRequestClass() const
+    {
+        return REQUEST_CLASS_DEFAULT;
+    }
+
     const std::map<std::string, std::string>& getHeaders()
     {
         return mHeaders;
@@ -316,18 +800,58 @@ public:
         mHeaders[key] = value;
     }
 
+    void setHeader(const std::string& key, const char* value, const size_t size)
+    {
+        mHeaders[key].assign(value, size);
+    }
+
+    /* the constant header lines of the producer/consumer sending it,
+     * sent as they are instead of being rebuilt from the headers */
+    void setTemplate(const MQRequestTemplatePtr& requestTemplate)
+    {
+        mTemplate = requestTemplate;
+    }
+
+    const MQRequestTemplatePtr& getTemplate() const
+    {
+        return mTemplate;
+    }
+
+protected:
+    void clearBodySegments()
+    {
+        mBodySegments.clear();
+        mBodySize = 0;
+    }
+
+    void appendBodySegment(const char* data, const size_t size)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+        RequestBodySegment segment;
+        segment.data = data;
+        segment.size = size;
+        mBodySegments.push_back(segment);
+        mBodySize += size;
+    }
+
 protected:
     std::string mMethod;
     std::string mCanonicalizedResource;
     std::string mRequestBody;
     std::map<std::string, std::string> mHeaders;
+    std::vector<RequestBodySegment> mBodySegments;
+    size_t mBodySize;
+    MQRequestTemplatePtr mTemplate;
 };
 
 class Response
 {
 public:
     Response();
-    virtual ~Response() {};
+    virtual ~Response();
 
     int getStatus()
     {
@@ -339,26 +863,43 @@ public:
         mStatus = status;
     }
 
-    const std::map<std::string, std::string>& getHeaders()
-    {
-        return mHeaders;
-    }
+    /* the headers as a map, built on first use from the received header lines */
+    const std::map<std::string, std::string>& getHeaders();
 
     void setHeader(std::string key, std::string value)
     {
+        getHeaders();
         mHeaders[key] = value;
     }
 
-    std::string getHeader(std::string key)
+    /* "" when the header is missing or headers were not retained */
+    std::string getHeader(std::string key);
+
+    /* keep the received headers for getHeader/getHeaders, on by default;
+     * responses whose headers nobody reads skip storing them */
+    void setRetainHeaders(const bool retain)
     {
-		std::map<std::string, std::string>::iterator iter = mHeaders.find(key);
-        if (iter != mHeaders.end())
-        {
-            return iter->second;
-        }
-        return NULL;
+        mRetainHeaders = retain;
+    }
+
+    bool isRetainHeaders() const
+    {
+        return mRetainHeaders;
+    }
+
+    /* called while receiving: a new status line drops the headers seen so far */
+    void resetHeaders()
+    {
+        mHeaderBuffer.clear();
+        mHeaderViews.clear();
+        mHeaders.clear();
+        mHeadersMaterialized = false;
     }
 
+    /* called while receiving, a no-op unless headers are retained */
+    void appendHeader(const char* name, const size_t nameSize,
+                      const char* value, const size_t valueSize);
+
     std::string* getRawDataPtr()
     {
         return &mRawData;
@@ -367,19 +908,47 @@ public:
     void clearRawData()
     {
         mRawData.clear();
+        onBodyCleared();
+    }
+
+    /* called while receiving: the first size bytes of the raw data are the
+     * body so far, a response may parse them before the rest arrives */
+    virtual void onBodyReceived(const size_t /*size*/)
+    {
     }
 
+    /* make room for a body of size bytes, e.g. from Content-Length */
+    void reserveRawData(const size_t size);
+
     virtual bool isSuccess() = 0;
     virtual void parseResponse() = 0;
 
 protected:
+    // the raw data was dropped for a new attempt
+    virtual void onBodyCleared()
+    {
+    }
+
     pugi::xml_node toXML();
     void parseCommonError(const pugi::xml_node& rootNode);
     bool isCommonError(const pugi::xml_node& rootNode);
 
 protected:
+    // a header line as offsets into mHeaderBuffer
+    struct HeaderView
+    {
+        uint32_t nameOffset;
+        uint32_t nameSize;
+        uint32_t valueOffset;
+        uint32_t valueSize;
+    };
+
     pugi::xml_document mDoc;
     std::map<std::string, std::string> mHeaders;
+    std::string mHeaderBuffer;
+    std::vector<HeaderView> mHeaderViews;
+    bool mRetainHeaders;
+    bool mHeadersMaterialized;
     std::string mRawData;
     int32_t mStatus;
 };
@@ -406,8 +975,19 @@ public:
         return "/topics/" + *mTopicName + "/messages";
     }
 
+    RequestClass getRequestClass() const
+    {
+        return mWaitSeconds > 0 ? REQUEST_CLASS_LONG_POLL : REQUEST_CLASS_DEFAULT;
+    }
+
+    int32_t getNumOfMessages() const
+    {
+        return mNumOfMessages;
+    }
+
     friend class MQTransProducer;
     friend class MQConsumer;
+    friend class MQAsyncConsumer;
 
 protected:
     void setTransConsume()
@@ -430,6 +1010,74 @@ protected:
     std::string mTrans;
 };
 
+/*
+ * fills Messages, or the views of a ConsumeBatch, from a <Messages> body
+ * while it is being received, no DOM is built and every byte is looked at
+ * once: each feed goes on from where the previous one stopped in the same
+ * buffer. Any other root, e.g. <Error>, and XML it does not take (DOCTYPE,
+ * mismatched tags) leave the body to pugixml.
+ */
+class MessagesStreamParser
+{
+public:
+    MessagesStreamParser(std::vector<Message>& messages);
+    /* views are kept as offsets into the body, see ConsumeBatch::finish */
+    MessagesStreamParser(std::vector<MessageView>& views);
+
+    /* data holds the body received so far, size bytes of it */
+    void feed(const char* data, const size_t size);
+
+    /* the <Messages> element was closed, the messages are all in */
+    bool isComplete() const
+    {
+        return mState == STATE_DONE;
+    }
+
+    /* drop the messages added so far and start over */
+    void reset();
+
+protected:
+    enum State
+    {
+        STATE_PARSING,
+        STATE_DONE,
+        STATE_FALLBACK
+    };
+
+    // false for markup the parser does not take
+    bool markup(const char* data, const size_t begin, const size_t end);
+    bool startTag(const char* data, const size_t nameOffset, const size_t nameSize, const bool selfClosing);
+    bool endTag(const char* data, const size_t nameOffset, const size_t nameSize);
+    void text(const char* data, const size_t begin, const size_t size, const bool cdata);
+    void finishField();
+
+    std::vector<Message>* mMessages;
+    std::vector<MessageView>* mViews;
+    // messages the vector held before this response
+    size_t mBase;
+    State mState;
+    // next byte to parse, where the search for the end of it goes on from
+    size_t mPos;
+    size_t mScan;
+    // the quote a start tag is inside of at mScan
+    char mQuote;
+    // an element being read, its name as an offset into the body
+    struct OpenTag
+    {
+        size_t nameOffset;
+        size_t nameSize;
+    };
+    std::vector<OpenTag> mOpenTags;
+    bool mInMessage;
+    // the MessageView::Part of the element being read, -1 for none
+    int32_t mPart;
+    // where its text goes for Messages
+    std::string* mTarget;
+    std::string mText;
+    // the element being read has had its text node
+    bool mTextTaken;
+};
+
 class ConsumeMessageResponse : public Response
 {
 public:
@@ -439,8 +1087,62 @@ public:
     void parseResponse();
     bool isSuccess();
 
+    void onBodyReceived(const size_t size);
+
 protected:
+    void onBodyCleared();
+    // hand the staged messages to the caller, once the response is parsed
+    void publish();
+
     std::vector<Message>* mMessages;
+    // the messages read so far, a failed transfer never reaches mMessages
+    std::vector<Message> mStaged;
+    MessagesStreamParser mParser;
+};
+
+/*
+ * reads a consume response into a ConsumeBatch, the body becomes the
+ * buffer of the batch
+ */
+class ConsumeBatchResponse : public Response
+{
+public:
+    ConsumeBatchResponse(ConsumeBatch& batch);
+    virtual ~ConsumeBatchResponse() {}
+
+    void parseResponse();
+    bool isSuccess();
+
+    void onBodyReceived(const size_t size);
+
+protected:
+    void onBodyCleared();
+
+    ConsumeBatch* mBatch;
+    MessagesStreamParser mParser;
+};
+
+/*
+ * reads a consume response into a MessageBatch, the body becomes its arena
+ */
+class MessageBatchResponse : public Response
+{
+public:
+    MessageBatchResponse(MessageBatch& batch);
+    virtual ~MessageBatchResponse() {}
+
+    void parseResponse();
+    bool isSuccess();
+
+    void onBodyReceived(const size_t size);
+
+protected:
+    void onBodyCleared();
+
+    MessageBatch* mBatch;
+    // the messages by row while the body comes in
+    std::vector<MessageView> mViews;
+    MessagesStreamParser mParser;
 };
 
 class AckMessageRequest : public Request
@@ -450,6 +1152,11 @@ public:
             const std::string& topicName, 
             const std::string& consumer,
             const std::vector<std::string>& receiptHandles);
+    /* acks every message of the batch */
+    AckMessageRequest(const std::string& instanceId,
+            const std::string& topicName,
+            const std::string& consumer,
+            const MessageBatch& batch);
     virtual ~AckMessageRequest() {}
 
     std::string getQueryString();
@@ -463,6 +1170,11 @@ public:
         return "/topics/" + *mTopicName + "/messages";
     }
 
+    RequestClass getRequestClass() const
+    {
+        return REQUEST_CLASS_ACK;
+    }
+
     friend class MQTransProducer;
 
 protected:
@@ -481,6 +1193,7 @@ protected:
     const std::string* mTopicName;
     const std::string* mConsumer;
     const std::vector<std::string>* mReceiptHandles;
+    const MessageBatch* mBatch;
     std::string mTrans;
 };
 
@@ -512,6 +1225,8 @@ public:
     std::string getQueryString();
     const std::string& generateRequestBody();
 
+    /* the message body is sent from the caller's string unless it needs XML escaping */
+    void generateBodySegments();
 
     std::string getResourcePath()
     {
@@ -520,7 +1235,13 @@ public:
         return "/topics/" + *mTopicName + "/messages";
     }
 
+    RequestClass getRequestClass() const
+    {
+        return REQUEST_CLASS_PUBLISH;
+    }
+
     friend class MQProducer;
+    friend class MQAsyncProducer;
 
 protected:
     const std::string* mInstanceId;
@@ -528,6 +1249,10 @@ protected:
     const std::string* mMessageBody;
     const std::string* mMessageTag;
     std::string mProperties;
+    // the XML around the message body, and the body itself when it had to be escaped
+    std::string mBodyHead;
+    std::string mEscapedBody;
+    std::string mBodyTail;
 };
 
 class PublishMessageResponse : public Response
@@ -0,0 +1,183 @@
+#include "mq_transport.h"
+#include "mq_common_tool.h"
+#include "constants.h"
+#include "pugixml.hpp"
+
+#include <sstream>
+
+using namespace std;
+using namespace mq::http::sdk;
+
+// what the server answers for at most one batch
+static const int32_t kMaxCannedBatch = 16;
+
+void MQTransport::SendAsync(const std::string& endpoint, const AsyncTransferPtr& transfer)
+{
+    try
+    {
+        Send(endpoint, transfer->getRequest(), transfer->getResponse());
+    }
+    catch (MQExceptionBase& e)
+    {
+        try
+        {
+            transfer->onFailed(e);
+        }
+        catch (...)
+        {
+        }
+        return;
+    }
+    try
+    {
+        transfer->onSuccess();
+    }
+    catch (...)
+    {
+        // callbacks must not throw, same as on the curl loops
+    }
+}
+
+void MQCurlTransport::Send(const std::string& endpoint, Request& req, Response& resp)
+{
+    MQNetworkTool::SendRequest(endpoint, req, resp, mConnTool);
+}
+
+void MQCurlTransport::SendAsync(const std::string& /*endpoint*/, const AsyncTransferPtr& transfer)
+{
+    mConnTool->GetAsyncHandler()->submit(transfer);
+}
+
+bool MQCurlTransport::WarmUp(const std::string& endpoint, const int32_t connections, const int32_t timeoutMs)
+{
+    // joins a warm up the client started in the background
+    mConnTool->StartWarmUp(endpoint, connections);
+    return mConnTool->WaitWarmUp(timeoutMs);
+}
+
+MQCannedLoopbackHandler::MQCannedLoopbackHandler(const std::string& messageBody,
+                                                 const std::string& messageTag)
+    : mMessageBody(messageBody)
+    , mMessageTag(messageTag)
+{
+    for (int32_t i = 0; i < REQUEST_CLASS_COUNT; ++i)
+    {
+        mHasReply[i] = false;
+        mReplyStatus[i] = 0;
+    }
+
+    pugi::xml_document doc;
+    doc.load("<?xml version=\"1.0\" encoding=\"UTF-8\"?>", pugi::parse_declaration);
+    pugi::xml_node node = doc.append_child(MESSAGE);
+    node.append_attribute("xmlns") = MQ_XML_NAMESPACE_V1;
+    node.append_child(MESSAGE_ID).append_child(pugi::node_pcdata).set_value("0B0000000000LOOPBACK");
+    node.append_child(MESSAGE_BODY_MD5).append_child(pugi::node_pcdata).set_value("00000000000000000000000000000000");
+    ostringstream os;
+    doc.save(os, "", pugi::format_raw);
+    mPublishReply = os.str();
+
+    mConsumeReplies.resize(kMaxCannedBatch + 1);
+    for (int32_t i = 1; i <= kMaxCannedBatch; ++i)
+    {
+        BuildConsumeReply(i, mConsumeReplies[i]);
+    }
+}
+
+void MQCannedLoopbackHandler::SetReply(const RequestClass requestClass,
+                                       const int32_t status,
+                                       const std::string& body)
+{
+    mHasReply[requestClass] = true;
+    mReplyStatus[requestClass] = status;
+    mReplyBody[requestClass] = body;
+}
+
+void MQCannedLoopbackHandler::BuildConsumeReply(const int32_t numOfMessages, std::string& body) const
+{
+    pugi::xml_document doc;
+    doc.load("<?xml version=\"1.0\" encoding=\"UTF-8\"?>", pugi::parse_declaration);
+    pugi::xml_node root = doc.append_child("Messages");
+    root.append_attribute("xmlns") = MQ_XML_NAMESPACE_V1;
+    for (int32_t i = 0; i < numOfMessages; ++i)
+    {
+        string index = StringTool::ToString(i);
+        pugi::xml_node node = root.append_child(MESSAGE);
+        node.append_child(MESSAGE_ID).append_child(pugi::node_pcdata).set_value(
+            ("0B0000000000LOOPBACK" + index).c_str());
+        node.append_child(RECEIPT_HANDLE).append_child(pugi::node_pcdata).set_value(
+            ("loopback-" + index).c_str());
+        node.append_child(MESSAGE_BODY_MD5).append_child(pugi::node_pcdata).set_value(
+            "00000000000000000000000000000000");
+        node.append_child(MESSAGE_BODY).append_child(pugi::node_pcdata).set_value(mMessageBody.c_str());
+        node.append_child(PUBLISH_TIME).append_child(pugi::node_pcdata).set_value("1546272000000");
+        node.append_child(FIRST_CONSUME_TIME).append_child(pugi::node_pcdata).set_value("1546272000000");
+        node.append_child(NEXT_CONSUME_TIME).append_child(pugi::node_pcdata).set_value("1546272300000");
+        node.append_child(CONSUMED_TIMES).append_child(pugi::node_pcdata).set_value("1");
+        if (mMessageTag != "")
+        {
+            node.append_child(MESSAGE_TAG).append_child(pugi::node_pcdata).set_value(mMessageTag.c_str());
+        }
+    }
+    ostringstream os;
+    doc.save(os, "", pugi::format_raw);
+    body = os.str();
+}
+
+int32_t MQCannedLoopbackHandler::Serve(const std::string& /*endpoint*/, Request& req, std::string& body)
+{
+    RequestClass requestClass = req.getRequestClass();
+    if (mHasReply[requestClass])
+    {
+        body.assign(mReplyBody[requestClass]);
+        return mReplyStatus[requestClass];
+    }
+
+    if (requestClass == REQUEST_CLASS_PUBLISH)
+    {
+        body.assign(mPublishReply);
+        return 201;
+    }
+    if (requestClass == REQUEST_CLASS_ACK)
+    {
+        return 204;
+    }
+    const ConsumeMessageRequest* consumeReq = dynamic_cast<const ConsumeMessageRequest*>(&req);
+    if (consumeReq != NULL)
+    {
+        int32_t numOfMessages = consumeReq->getNumOfMessages();
+        if (numOfMessages > 0 && numOfMessages <= kMaxCannedBatch)
+        {
+            body.assign(mConsumeReplies[numOfMessages]);
+        }
+        else
+        {
+            BuildConsumeReply(numOfMessages, body);
+        }
+        return 200;
+    }
+    MQ_THROW(MQExceptionBase, "MQCannedLoopbackHandler has no reply for " + req.getMethod()
+        + " " + req.getCanonicalizedResource());
+}
+
+MQLoopbackTransport::MQLoopbackTransport()
+    : mHandler(new MQCannedLoopbackHandler())
+    , mRequestCount(0)
+{
+}
+
+MQLoopbackTransport::MQLoopbackTransport(MQLoopbackHandlerPtr handler)
+    : mHandler(handler)
+    , mRequestCount(0)
+{
+}
+
+void MQLoopbackTransport::Send(const std::string& endpoint, Request& req, Response& resp)
+{
+    // the body is still laid out as it would be for the wire
+    req.getCanonicalizedResource();
+    resp.clearRawData();
+    resp.resetHeaders();
+    resp.setStatus(mHandler->Serve(endpoint, req, *resp.getRawDataPtr()));
+    mRequestCount.fetch_add(1);
+    resp.parseResponse();
+}
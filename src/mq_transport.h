@@ -0,0 +1,172 @@
+// Copyright (C) 2019, Alibaba Cloud Computing
+
+#ifndef MQ_SDK_TRANSPORT_H
+#define MQ_SDK_TRANSPORT_H
+
+#include "mq_protocol.h"
+#include "mq_network_tool.h"
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+
+namespace mq
+{
+namespace http
+{
+namespace sdk
+{
+
+/*
+ * sends signed requests for MQClient and its producers/consumers
+ */
+class MQTransport
+{
+public:
+    virtual ~MQTransport() {}
+
+    /* send the signed request and parse the answer into resp
+     *
+     * throws MQServerException when the request is failed.
+     * throws MQExceptionBase for client errors
+     */
+    virtual void Send(const std::string& endpoint,
+                      Request& req,
+                      Response& resp) = 0;
+
+    /* open keep-alive connections to endpoint ahead of the first requests
+     *
+     * @return: true if they are ready within timeoutMs, transports without
+     *          connections of their own have nothing to open
+     */
+    virtual bool WarmUp(const std::string& /*endpoint*/,
+                        const int32_t /*connections*/,
+                        const int32_t /*timeoutMs*/)
+    {
+        return true;
+    }
+
+    /* send the signed request of transfer without waiting for the answer,
+     * for MQAsyncClient. Its onSuccess or onFailed is called once, on a
+     * thread of the transport; transports without one send on the calling
+     * thread and call back before returning.
+     */
+    virtual void SendAsync(const std::string& endpoint,
+                           const AsyncTransferPtr& transfer);
+};
+#ifdef __APPLE__
+typedef std::shared_ptr<MQTransport> MQTransportPtr;
+#else
+typedef std::tr1::shared_ptr<MQTransport> MQTransportPtr;
+#endif
+
+/*
+ * the default transport, libcurl through the connection pool of the client
+ */
+class MQCurlTransport : public MQTransport
+{
+public:
+    MQCurlTransport(MQConnectionToolPtr connTool)
+        : mConnTool(connTool)
+    {
+    }
+
+    void Send(const std::string& endpoint, Request& req, Response& resp);
+    bool WarmUp(const std::string& endpoint, const int32_t connections, const int32_t timeoutMs);
+    // the curl multi loops of the connection tool
+    void SendAsync(const std::string& endpoint, const AsyncTransferPtr& transfer);
+
+protected:
+    MQConnectionToolPtr mConnTool;
+};
+
+/*
+ * answers the requests of MQLoopbackTransport
+ */
+class MQLoopbackHandler
+{
+public:
+    virtual ~MQLoopbackHandler() {}
+
+    /* called on the sending thread, may be called from several threads at once
+     *
+     * @param body: the response body to fill, empty on entry
+     * @return: the http status of the response
+     */
+    virtual int32_t Serve(const std::string& endpoint,
+                          Request& req,
+                          std::string& body) = 0;
+};
+#ifdef __APPLE__
+typedef std::shared_ptr<MQLoopbackHandler> MQLoopbackHandlerPtr;
+#else
+typedef std::tr1::shared_ptr<MQLoopbackHandler> MQLoopbackHandlerPtr;
+#endif
+
+/*
+ * answers from memory, all bodies are built before the first request:
+ *     publish: 201 with a fixed MessageId
+ *     consume: 200 with numOfMessages copies of messageBody
+ *     ack:     204
+ * SetReply replaces the answer for a whole request class.
+ */
+class MQCannedLoopbackHandler : public MQLoopbackHandler
+{
+public:
+    MQCannedLoopbackHandler(const std::string& messageBody = "loopback",
+                            const std::string& messageTag = "");
+
+    /* answer every request of requestClass with status and body,
+     * call it before the handler serves requests */
+    void SetReply(const RequestClass requestClass,
+                  const int32_t status,
+                  const std::string& body);
+
+    int32_t Serve(const std::string& endpoint, Request& req, std::string& body);
+
+protected:
+    void BuildConsumeReply(const int32_t numOfMessages, std::string& body) const;
+
+    std::string mMessageBody;
+    std::string mMessageTag;
+    std::string mPublishReply;
+    // indexed by numOfMessages
+    std::vector<std::string> mConsumeReplies;
+    bool mHasReply[REQUEST_CLASS_COUNT];
+    int32_t mReplyStatus[REQUEST_CLASS_COUNT];
+    std::string mReplyBody[REQUEST_CLASS_COUNT];
+};
+
+/*
+ * never leaves the process, the handler answers every request, so that the
+ * cost of signing, XML and allocation can be measured without the network.
+ * Async requests are answered on the calling thread.
+ *
+ * MQClient::setTransport(MQTransportPtr(new MQLoopbackTransport()))
+ */
+class MQLoopbackTransport : public MQTransport
+{
+public:
+    MQLoopbackTransport();
+
+    MQLoopbackTransport(MQLoopbackHandlerPtr handler);
+
+    void Send(const std::string& endpoint, Request& req, Response& resp);
+
+    /* requests served so far */
+    int64_t GetRequestCount() const
+    {
+        return mRequestCount.load();
+    }
+
+protected:
+    MQLoopbackHandlerPtr mHandler;
+    std::atomic<int64_t> mRequestCount;
+};
+
+}
+}
+}
+
+#endif
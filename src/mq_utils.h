@@ -8,6 +8,7 @@
 #ifdef _WIN32
 #include <memory>
 #include <windows.h>
+#include <process.h>
 #else
 #ifdef __APPLE__
 #include <memory>
@@ -16,6 +17,7 @@
 #endif
 #include <sys/time.h>
 #include <string.h>
+#include <pthread.h>
 #endif
 
 #include <stdio.h>
@@ -32,6 +34,12 @@ namespace http
 namespace sdk
 {
 
+#ifdef _WIN32
+#define MQ_THREAD_LOCAL __declspec(thread)
+#else
+#define MQ_THREAD_LOCAL __thread
+#endif
+
 #define MQ_LOCK_SAFE(x) \
     do                      \
     {                       \
@@ -75,6 +83,15 @@ namespace sdk
 #endif
 		}
 
+		bool trylock()
+		{
+#ifdef _WIN32
+			return TryEnterCriticalSection(&cs) != 0;
+#else
+			return pthread_mutex_trylock(&mutex) == 0;
+#endif
+		}
+
 		void unlock()
 		{
 #ifdef _WIN32
@@ -203,6 +220,15 @@ public:
 #endif
     }
 
+    void broadcast()
+    {
+#ifdef _WIN32
+		WakeAllConditionVariable(&cond);
+#else
+        MQ_LOCK_SAFE(pthread_cond_broadcast(&cond));
+#endif
+    }
+
 protected:
 #ifdef _WIN32
 	CONDITION_VARIABLE cond;
@@ -227,6 +253,10 @@ public:
     {
         cond.signal();
     }
+    void broadcast()
+    {
+        cond.broadcast();
+    }
 };
 #ifdef __APPLE__
 typedef std::shared_ptr<WaitObject> WaitObjectPtr;
@@ -259,6 +289,82 @@ public:
     }
 };
 
+/*
+ * minimal joinable thread, subclasses implement run()
+ */
+class PTThread
+{
+public:
+    PTThread() : mStarted(false) {}
+    virtual ~PTThread() {}
+
+    void start()
+    {
+        if (mStarted)
+        {
+            return;
+        }
+#ifdef _WIN32
+        mThread = (HANDLE)_beginthreadex(NULL, 0, &PTThread::entry, this, 0, NULL);
+        if (mThread == 0)
+        {
+            MQ_THROW(MQExceptionBase, "PTThread::start failed to create thread");
+        }
+#else
+        int r = pthread_create(&mThread, NULL, &PTThread::entry, this);
+        if (r != 0)
+        {
+            MQ_THROW(MQExceptionBase, "PTThread::start failed to create thread, ret:" + StringTool::ToString(r));
+        }
+#endif
+        mStarted = true;
+    }
+
+    void join()
+    {
+        if (!mStarted)
+        {
+            return;
+        }
+#ifdef _WIN32
+        WaitForSingleObject(mThread, INFINITE);
+        CloseHandle(mThread);
+#else
+        pthread_join(mThread, NULL);
+#endif
+        mStarted = false;
+    }
+
+    bool isStarted() const
+    {
+        return mStarted;
+    }
+
+protected:
+    virtual void run() = 0;
+
+private:
+#ifdef _WIN32
+    static unsigned __stdcall entry(void* arg)
+    {
+        static_cast<PTThread*>(arg)->run();
+        return 0;
+    }
+    HANDLE mThread;
+#else
+    static void* entry(void* arg)
+    {
+        static_cast<PTThread*>(arg)->run();
+        return NULL;
+    }
+    pthread_t mThread;
+#endif
+    bool mStarted;
+
+    PTThread(const PTThread&);
+    PTThread& operator=(const PTThread&);
+};
+
 class MQUtils
 {
 public:
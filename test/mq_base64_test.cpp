@@ -0,0 +1,140 @@
+/*
+ * every Base64 kernel the cpu runs against the scalar one: encoding and
+ * decoding of all lengths around the vector block sizes, all byte values,
+ * and the same verdict on bad input.
+ *
+ * usage: mq_base64_test
+ */
+#include "mq_common_tool.h"
+#include "mq_exception.h"
+#include "mq_test.h"
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace mq::http::sdk;
+
+static string Encode(const string& input)
+{
+    string output(Base64Tool::EncodedLength(input.size()) + 1, '\0');
+    output.resize(Base64Tool::Base64Encoding(input.data(), input.size(), &output[0]));
+    return output;
+}
+
+// false when the input was refused
+static bool Decode(const string& input, string& output)
+{
+    output.assign(Base64Tool::MaxDecodedLength(input.size()) + 1, '\0');
+    try
+    {
+        output.resize(Base64Tool::Base64Decoding(input.data(), input.size(), &output[0]));
+    }
+    catch (MQExceptionBase&)
+    {
+        return false;
+    }
+    return true;
+}
+
+static vector<string> Inputs()
+{
+    vector<string> inputs;
+    srand(42);
+    for (size_t length = 0; length <= 200; ++length)
+    {
+        string input(length, '\0');
+        for (size_t i = 0; i < length; ++i)
+        {
+            input[i] = (char)(rand() & 0xff);
+        }
+        inputs.push_back(input);
+    }
+    string bytes;
+    for (int32_t i = 0; i < 256 * 3; ++i)
+    {
+        bytes.push_back((char)(i % 256));
+    }
+    inputs.push_back(bytes);
+    inputs.push_back(string(4096, '\xff'));
+    return inputs;
+}
+
+// encoded texts with a bad character, padding where it can not be, or a bad length
+static vector<string> BadInputs(const string& valid)
+{
+    vector<string> inputs;
+    const char bad[] = { '*', '-', '_', ' ', '\n', '\0', '\x80', '=' };
+    for (size_t at = 0; at < valid.size(); at += 7)
+    {
+        for (size_t i = 0; i < sizeof(bad); ++i)
+        {
+            string input = valid;
+            input[at] = bad[i];
+            inputs.push_back(input);
+        }
+    }
+    inputs.push_back(valid.substr(0, valid.size() - 1));
+    inputs.push_back(valid + "=");
+    inputs.push_back(valid + "AB==");
+    inputs.push_back("A===");
+    return inputs;
+}
+
+int main()
+{
+    vector<string> kernels = Base64Tool::ListBase64Kernels();
+    MQ_CHECK(!kernels.empty() && kernels[0] == "scalar");
+    MQ_CHECK(!Base64Tool::SelectBase64Kernel("none"));
+
+    vector<string> inputs = Inputs();
+    vector<string> expected;
+    MQ_CHECK(Base64Tool::SelectBase64Kernel("scalar"));
+    MQ_CHECK(Encode("") == "" && Encode("f") == "Zg==" && Encode("fo") == "Zm8=" && Encode("foo") == "Zm9v");
+    string decoded;
+    MQ_CHECK(Decode("Zm8=", decoded) && decoded == "fo");
+    MQ_CHECK(!Decode("Zm9*", decoded) && !Decode("Zm9", decoded) && !Decode("Z=9v", decoded));
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        expected.push_back(Encode(inputs[i]));
+    }
+    vector<string> bad = BadInputs(expected[199]);
+    vector<bool> badVerdicts;
+    vector<string> badOutputs;
+    for (size_t i = 0; i < bad.size(); ++i)
+    {
+        string output;
+        badVerdicts.push_back(Decode(bad[i], output));
+        badOutputs.push_back(output);
+    }
+
+    for (size_t k = 0; k < kernels.size(); ++k)
+    {
+        printf("kernel %s\n", kernels[k].c_str());
+        MQ_CHECK(Base64Tool::SelectBase64Kernel(kernels[k]));
+        int32_t failed = 0;
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            string decoded;
+            if (Encode(inputs[i]) != expected[i] || !Decode(expected[i], decoded) || decoded != inputs[i])
+            {
+                fprintf(stderr, "%s: %u bytes differ from scalar\n", kernels[k].c_str(), (unsigned)inputs[i].size());
+                failed++;
+            }
+        }
+        for (size_t i = 0; i < bad.size(); ++i)
+        {
+            string output;
+            bool decoded = Decode(bad[i], output);
+            if (decoded != badVerdicts[i] || (decoded && output != badOutputs[i]))
+            {
+                fprintf(stderr, "%s: bad input %u judged differently\n", kernels[k].c_str(), (unsigned)i);
+                failed++;
+            }
+        }
+        MQ_CHECK(failed == 0);
+    }
+    return MQ_TEST_RESULT("mq_base64_test");
+}
@@ -0,0 +1,244 @@
+/*
+ * credentials: the JSON documents of STS AssumeRole and the ECS RAM role
+ * metadata, MQCredentialsHolder under threads that set and get at once,
+ * and requests signed on a loopback transport while the client rotates
+ * its credentials, each must carry one consistent AccessId, AccessKey and
+ * StsToken.
+ *
+ * usage: mq_credentials_test
+ */
+#include "mq_client.h"
+#include "mq_credentials.h"
+#include "mq_network_tool.h"
+#include "mq_transport.h"
+#include "mq_test.h"
+#include "constants.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+
+using namespace std;
+using namespace mq::http::sdk;
+
+static const int32_t kRotations = 2000;
+static const int32_t kThreads = 4;
+
+static void TestDocuments()
+{
+    int64_t expireTimeMs = -1;
+    MQCredentialsPtr credentials = MQFileCredentialsProvider::parse(
+        "{\n"
+        "  \"AccessKeyId\" : \"STS.id\",\n"
+        "  \"AccessKeySecret\":\"se\\\"cr\\\\et\",\n"
+        "  \"SecurityToken\": \"to\\/ken\",\n"
+        "  \"Expiration\": \"2019-01-01T00:00:00Z\"\n"
+        "}", expireTimeMs);
+    MQ_CHECK(credentials->getAccessId() == "STS.id");
+    MQ_CHECK(credentials->getAccessKey() == "se\"cr\\et");
+    MQ_CHECK(credentials->getStsToken() == "to/ken");
+    MQ_CHECK(expireTimeMs == 1546300800000LL);
+
+    // the ECS RAM role metadata, with fields the SDK does not read
+    credentials = MQFileCredentialsProvider::parse(
+        "{\"Code\":\"Success\",\"LastUpdated\":\"2019-01-01T00:00:00Z\",\"AccessKeyId\":\"ecs\","
+        "\"AccessKeySecret\":\"key\",\"Expiration\":\"2019-01-01T06:30:15Z\",\"SecurityToken\":\"tok\"}",
+        expireTimeMs);
+    MQ_CHECK(credentials->getAccessId() == "ecs" && credentials->getAccessKey() == "key");
+    MQ_CHECK(credentials->getStsToken() == "tok");
+    MQ_CHECK(expireTimeMs == 1546300800000LL + (6 * 3600 + 30 * 60 + 15) * 1000LL);
+
+    // long-lived keys have neither token nor expiry
+    credentials = MQFileCredentialsProvider::parse("{\"AccessKeyId\":\"id\",\"AccessKeySecret\":\"key\"}",
+        expireTimeMs);
+    MQ_CHECK(credentials->getAccessId() == "id" && credentials->getStsToken() == "" && expireTimeMs == 0);
+
+    MQ_CHECK_THROWS(MQFileCredentialsProvider::parse("", expireTimeMs));
+    MQ_CHECK_THROWS(MQFileCredentialsProvider::parse("{\"AccessKeyId\":\"id\"}", expireTimeMs));
+    MQ_CHECK_THROWS(MQFileCredentialsProvider::parse("{\"AccessKeyId\":\"\",\"AccessKeySecret\":\"key\"}",
+        expireTimeMs));
+    MQ_CHECK_THROWS(MQFileCredentialsProvider::parse("{\"AccessKeyId\":1,\"AccessKeySecret\":\"key\"}",
+        expireTimeMs));
+    MQ_CHECK_THROWS(MQFileCredentialsProvider::parse("{\"AccessKeyId\":\"id\",\"AccessKeySecret\":\"key",
+        expireTimeMs));
+    MQ_CHECK_THROWS(MQFileCredentialsProvider::parse(
+        "{\"AccessKeyId\":\"id\",\"AccessKeySecret\":\"key\",\"Expiration\":\"tomorrow\"}", expireTimeMs));
+}
+
+// the n-th credentials of the rotations, each part tells n
+static MQCredentialsPtr Rotation(const int32_t n)
+{
+    char id[32], key[32], token[32];
+    snprintf(id, sizeof(id), "id-%d", n);
+    snprintf(key, sizeof(key), "key-%d", n);
+    snprintf(token, sizeof(token), "token-%d", n);
+    return MQCredentialsPtr(new MQCredentials(id, key, token));
+}
+
+static bool Consistent(const MQCredentials& credentials)
+{
+    const string& id = credentials.getAccessId();
+    return id.compare(0, 3, "id-") == 0
+        && credentials.getAccessKey() == "key-" + id.substr(3)
+        && credentials.getStsToken() == "token-" + id.substr(3);
+}
+
+struct HolderWork
+{
+    MQCredentialsHolderPtr holder;
+    std::atomic<bool> stop;
+    std::atomic<int32_t> bad;
+};
+
+static void* ReadHolder(void* arg)
+{
+    HolderWork* work = static_cast<HolderWork*>(arg);
+    while (!work->stop.load())
+    {
+        MQCredentialsPtr credentials = work->holder->get();
+        if (!Consistent(*credentials))
+        {
+            work->bad++;
+        }
+    }
+    return NULL;
+}
+
+static void* SetHolder(void* arg)
+{
+    HolderWork* work = static_cast<HolderWork*>(arg);
+    for (int32_t i = 1; i <= kRotations; ++i)
+    {
+        work->holder->set(Rotation(i));
+    }
+    return NULL;
+}
+
+static void TestHolderThreads()
+{
+    HolderWork work;
+    work.holder.reset(new MQCredentialsHolder(Rotation(0)));
+    work.stop.store(false);
+    work.bad.store(0);
+    pthread_t readers[kThreads];
+    pthread_t setters[2];
+    for (int32_t i = 0; i < kThreads; ++i)
+    {
+        pthread_create(&readers[i], NULL, &ReadHolder, &work);
+    }
+    for (int32_t i = 0; i < 2; ++i)
+    {
+        pthread_create(&setters[i], NULL, &SetHolder, &work);
+    }
+    for (int32_t i = 0; i < 2; ++i)
+    {
+        pthread_join(setters[i], NULL);
+    }
+    work.stop.store(true);
+    for (int32_t i = 0; i < kThreads; ++i)
+    {
+        pthread_join(readers[i], NULL);
+    }
+    MQ_CHECK(work.bad.load() == 0);
+    MQ_CHECK(work.holder->get()->getAccessId() == "id-" + StringTool::ToString(kRotations));
+}
+
+// checks every request was signed by one snapshot of the rotations
+class SignatureCheckHandler : public MQCannedLoopbackHandler
+{
+public:
+    SignatureCheckHandler()
+        : mBad(0)
+    {
+    }
+
+    int32_t Serve(const std::string& endpoint, Request& req, std::string& body)
+    {
+        const map<string, string>& headers = req.getHeaders();
+        map<string, string>::const_iterator authorization = headers.find(AUTHORIZATION);
+        map<string, string>::const_iterator token = headers.find(SECURITY_TOKEN);
+        size_t colon = authorization == headers.end() ? string::npos : authorization->second.find(':');
+        if (colon == string::npos || token == headers.end() || token->second.compare(0, 6, "token-") != 0)
+        {
+            mBad++;
+            return MQCannedLoopbackHandler::Serve(endpoint, req, body);
+        }
+        const string n = token->second.substr(6);
+        const string expected = MQNetworkTool::Signature(req.getMethod(), req.getCanonicalizedResource(),
+            "id-" + n, "key-" + n, headers);
+        if (authorization->second != expected)
+        {
+            mBad++;
+        }
+        return MQCannedLoopbackHandler::Serve(endpoint, req, body);
+    }
+
+    std::atomic<int32_t> mBad;
+};
+
+struct ClientWork
+{
+    MQClient* client;
+    std::atomic<bool> stop;
+    std::atomic<int64_t> requests;
+};
+
+static void* Publish(void* arg)
+{
+    ClientWork* work = static_cast<ClientWork*>(arg);
+    MQProducerPtr producer = work->client->getProducerRef("topic");
+    while (!work->stop.load())
+    {
+        PublishMessageResponse resp;
+        producer->publishMessage("body", resp);
+        work->requests++;
+    }
+    return NULL;
+}
+
+static void TestRotationWhileSending()
+{
+    SignatureCheckHandler* handler = new SignatureCheckHandler();
+    MQClient client("http://127.0.0.1:1", "id-0", "key-0", "token-0");
+    client.setTransport(MQTransportPtr(new MQLoopbackTransport(MQLoopbackHandlerPtr(handler))));
+
+    ClientWork work;
+    work.client = &client;
+    work.stop.store(false);
+    work.requests.store(0);
+    pthread_t senders[kThreads];
+    for (int32_t i = 0; i < kThreads; ++i)
+    {
+        pthread_create(&senders[i], NULL, &Publish, &work);
+    }
+    // until the senders got through as many requests, on one core they start late
+    for (int32_t i = 1; i <= kRotations || work.requests.load() < kRotations; ++i)
+    {
+        MQCredentialsPtr credentials = Rotation(i);
+        client.updateAccessId(credentials->getAccessId(), credentials->getAccessKey(), credentials->getStsToken());
+    }
+    work.stop.store(true);
+    for (int32_t i = 0; i < kThreads; ++i)
+    {
+        pthread_join(senders[i], NULL);
+    }
+    MQ_CHECK(work.requests.load() > 0);
+    MQ_CHECK(handler->mBad.load() == 0);
+
+    // a producer given its own credentials keeps them through client updates
+    MQProducerPtr producer = client.getProducerRef("topic");
+    producer->updateAccessId("id-own", "key-own", "token-own");
+    client.updateAccessId("id-1", "key-1", "token-1");
+    MQ_CHECK(producer->getCredentials()->getAccessId() == "id-own");
+    MQ_CHECK(client.getConsumerRef("topic", "group")->getCredentials()->getAccessId() == "id-1");
+}
+
+int main()
+{
+    TestDocuments();
+    TestHolderThreads();
+    TestRotationWhileSending();
+    return MQ_TEST_RESULT("mq_credentials_test");
+}
@@ -0,0 +1,276 @@
+/*
+ * the HTTP/1.1 reading of the native engine, on epoll and on io_uring: a
+ * server thread on a loopback port answers with identity bodies (by
+ * Content-Length and until close), chunked bodies with extensions and a
+ * trailer, and a 100 Continue ahead of the answer. Each answer is written
+ * in two pieces split at every byte, with a pause between them so that the
+ * client reads them apart.
+ *
+ * usage: mq_native_transport_test
+ */
+#include "mq_client.h"
+#include "mq_native_transport.h"
+#include "mq_test.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace mq::http::sdk;
+
+static const char* const kPublishBody = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<Message xmlns=\"http://mq.aliyuncs.com/doc/v1/\"><MessageId>MID&amp;1</MessageId>"
+    "<MessageBodyMD5>A1B2</MessageBodyMD5></Message>";
+
+static const char* const kConsumeBody = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<Messages xmlns=\"http://mq.aliyuncs.com/doc/v1/\">"
+    "<Message><MessageId>m1</MessageId><ReceiptHandle>rh1</ReceiptHandle><MessageBodyMD5>0</MessageBodyMD5>"
+    "<MessageBody>a &lt;b&gt; &amp; c</MessageBody><PublishTime>1</PublishTime>"
+    "<FirstConsumeTime>2</FirstConsumeTime><NextConsumeTime>3</NextConsumeTime>"
+    "<ConsumedTimes>1</ConsumedTimes></Message>"
+    "<Message><MessageId>m2</MessageId><ReceiptHandle>rh2</ReceiptHandle><MessageBodyMD5>0</MessageBodyMD5>"
+    "<MessageBody><![CDATA[<cdata> & more]]></MessageBody><PublishTime>4</PublishTime>"
+    "<FirstConsumeTime>5</FirstConsumeTime><NextConsumeTime>6</NextConsumeTime>"
+    "<ConsumedTimes>2</ConsumedTimes></Message>"
+    "</Messages>";
+
+// the consume body in chunks of a few sizes, hex in both cases, with an extension and a trailer
+static string Chunked(const string& body)
+{
+    string chunked;
+    const size_t sizes[] = { 1, 26, 255, 7 };
+    size_t pos = 0;
+    for (size_t i = 0; pos < body.size(); ++i)
+    {
+        size_t size = sizes[i % 4];
+        if (size > body.size() - pos)
+            size = body.size() - pos;
+        char line[32];
+        snprintf(line, sizeof(line), i % 2 ? "%zX;name=value\r\n" : "%zx\r\n", size);
+        chunked.append(line).append(body, pos, size).append("\r\n");
+        pos += size;
+    }
+    return chunked.append("0\r\nx-trailer: t\r\n\r\n");
+}
+
+struct Answer
+{
+    string bytes;
+    // the server closes the connection after it
+    bool close;
+};
+
+static vector<Answer> Answers()
+{
+    vector<Answer> answers;
+    Answer answer;
+    answer.close = false;
+    char head[128];
+    snprintf(head, sizeof(head), "HTTP/1.1 201 Created\r\nContent-Length: %u\r\nx-mq-request-id: r1\r\n\r\n",
+        (unsigned)strlen(kPublishBody));
+    answer.bytes = string(head) + kPublishBody;
+    answers.push_back(answer);
+
+    answer.bytes = "HTTP/1.1 100 Continue\r\n\r\n" + answer.bytes;
+    answers.push_back(answer);
+
+    answer.bytes = string("HTTP/1.1 201 Created\r\nConnection: close\r\nx-mq-request-id: r1\r\n\r\n") + kPublishBody;
+    answer.close = true;
+    answers.push_back(answer);
+
+    answer.bytes = "HTTP/1.1 200 OK\r\ntransfer-encoding: chunked\r\n\r\n" + Chunked(kConsumeBody);
+    answer.close = false;
+    answers.push_back(answer);
+    return answers;
+}
+
+// what the server writes next, set between requests
+struct Server
+{
+    int listenFd;
+    pthread_mutex_t mutex;
+    Answer answer;
+    size_t split;
+};
+
+static Server sServer;
+
+// the whole request, false when the client closed
+static bool ReadRequest(int fd, string& buffer)
+{
+    while (true)
+    {
+        size_t headEnd = buffer.find("\r\n\r\n");
+        if (headEnd != string::npos)
+        {
+            size_t length = 0;
+            for (size_t pos = buffer.find("\r\n"); pos < headEnd; pos = buffer.find("\r\n", pos + 2))
+            {
+                if (strncasecmp(buffer.c_str() + pos + 2, "Content-Length:", 15) == 0)
+                {
+                    length = (size_t)atol(buffer.c_str() + pos + 17);
+                }
+            }
+            if (buffer.size() >= headEnd + 4 + length)
+            {
+                buffer.erase(0, headEnd + 4 + length);
+                return true;
+            }
+        }
+        char data[4096];
+        ssize_t n = recv(fd, data, sizeof(data), 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        buffer.append(data, n);
+    }
+}
+
+static void* ServeConnection(void* arg)
+{
+    int fd = (int)(intptr_t)arg;
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    string buffer;
+    while (ReadRequest(fd, buffer))
+    {
+        pthread_mutex_lock(&sServer.mutex);
+        Answer answer = sServer.answer;
+        size_t split = sServer.split;
+        pthread_mutex_unlock(&sServer.mutex);
+        send(fd, answer.bytes.data(), split, MSG_NOSIGNAL);
+        usleep(1000);
+        send(fd, answer.bytes.data() + split, answer.bytes.size() - split, MSG_NOSIGNAL);
+        if (answer.close)
+        {
+            break;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static void* Accept(void* /*arg*/)
+{
+    while (true)
+    {
+        int fd = accept(sServer.listenFd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return NULL;
+        }
+        pthread_t thread;
+        pthread_create(&thread, NULL, &ServeConnection, (void*)(intptr_t)fd);
+        pthread_detach(thread);
+    }
+}
+
+// the endpoint of the started server
+static string StartServer()
+{
+    pthread_mutex_init(&sServer.mutex, NULL);
+    sServer.listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(addr);
+    if (bind(sServer.listenFd, (struct sockaddr*)&addr, size) != 0 || listen(sServer.listenFd, 16) != 0
+        || getsockname(sServer.listenFd, (struct sockaddr*)&addr, &size) != 0)
+    {
+        return "";
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, &Accept, NULL);
+    pthread_detach(thread);
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", ntohs(addr.sin_port));
+    return endpoint;
+}
+
+// one request answered by answer split at split, false if it read differently
+static bool Exchange(MQClient& client, const Answer& answer, const size_t split, const bool consume)
+{
+    pthread_mutex_lock(&sServer.mutex);
+    sServer.answer = answer;
+    sServer.split = split;
+    pthread_mutex_unlock(&sServer.mutex);
+    try
+    {
+        if (consume)
+        {
+            vector<Message> messages;
+            client.getConsumerRef("topic", "group")->consumeMessage(2, 1, messages);
+            return messages.size() == 2
+                && messages[0].getMessageBody() == "a <b> & c" && messages[0].getReceiptHandle() == "rh1"
+                && messages[1].getMessageBody() == "<cdata> & more" && messages[1].getConsumedTimes() == 2;
+        }
+        PublishMessageResponse resp;
+        client.getProducerRef("topic")->publishMessage("body", resp);
+        return resp.getStatus() == 201 && resp.getMessageId() == "MID&1"
+            && resp.getMessageBodyMD5() == "A1B2" && resp.getHeader("x-mq-request-id") == "r1";
+    }
+    catch (MQExceptionBase& e)
+    {
+        fprintf(stderr, "%s\n", e.ToString().c_str());
+        return false;
+    }
+}
+
+static void TestEngine(const string& endpoint, const bool useIoUring)
+{
+    MQConnectionConfig config;
+    config.httpEngine = HTTP_ENGINE_NATIVE;
+    config.useIoUring = useIoUring;
+    config.connPoolSize = 2;
+    config.timeout = 5;
+    config.connectTimeout = 5;
+    if (useIoUring && !MQNativeTransport(config).UsesIoUring())
+    {
+        printf("io_uring not available here, skipped\n");
+        return;
+    }
+    MQClient client(endpoint, "id", "key", config);
+    vector<Answer> answers = Answers();
+    for (size_t a = 0; a < answers.size(); ++a)
+    {
+        int32_t failed = 0;
+        for (size_t split = 1; split < answers[a].bytes.size(); ++split)
+        {
+            if (!Exchange(client, answers[a], split, a == answers.size() - 1))
+            {
+                fprintf(stderr, "%s: answer %u split at %u read differently\n",
+                    useIoUring ? "io_uring" : "epoll", (unsigned)a, (unsigned)split);
+                failed++;
+            }
+        }
+        MQ_CHECK(failed == 0);
+    }
+}
+
+int main()
+{
+    string endpoint = StartServer();
+    MQ_CHECK(!endpoint.empty());
+    if (endpoint.empty())
+    {
+        return MQ_TEST_RESULT("mq_native_transport_test");
+    }
+    TestEngine(endpoint, false);
+    TestEngine(endpoint, true);
+    return MQ_TEST_RESULT("mq_native_transport_test");
+}
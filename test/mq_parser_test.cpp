@@ -0,0 +1,239 @@
+/*
+ * the streaming consume parser against pugixml: a <Messages> body with
+ * entities, character references, CDATA, comments and quoted '>' is fed
+ * split at every byte, and byte by byte, into the three consume responses;
+ * each must read what the DOM path reads from the same body with a DOCTYPE,
+ * which the stream parser leaves to pugixml.
+ *
+ * usage: mq_parser_test
+ */
+#include "mq_client.h"
+#include "mq_protocol.h"
+#include "mq_transport.h"
+#include "mq_test.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace mq::http::sdk;
+
+static const char* const kDeclaration = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+
+static string MessagesBody()
+{
+    return string("<Messages xmlns=\"http://mq.aliyuncs.com/doc/v1/\">\n"
+        "  <!-- consumed at <once> -->\n"
+        "  <Message>\n"
+        "    <MessageId>id-1</MessageId>\n"
+        "    <ReceiptHandle>rh&amp;1</ReceiptHandle>\n"
+        "    <MessageBodyMD5>D41D8CD98F00B204E9800998ECF8427E</MessageBodyMD5>\n"
+        "    <MessageBody>a &lt;b&gt; &amp; &quot;c&quot; &apos;d&apos; &#65;&#x42;&#x4e2d;</MessageBody>\n"
+        "    <PublishTime>1570000000001</PublishTime>\n"
+        "    <FirstConsumeTime>1570000000002</FirstConsumeTime>\n"
+        "    <NextConsumeTime>1570000000003</NextConsumeTime>\n"
+        "    <ConsumedTimes>7</ConsumedTimes>\n"
+        "    <MessageTag>tag</MessageTag>\n"
+        "    <Properties>KEYS:k1|__SHARDINGKEY:s&amp;1|</Properties>\n"
+        "  </Message>\n"
+        "  <Message attr=\"a>b\" other='c>d'>\n"
+        "    <MessageId>id-2</MessageId>\n"
+        "    <ReceiptHandle><![CDATA[rh<2>]]></ReceiptHandle>\n"
+        "    <MessageBodyMD5>0</MessageBodyMD5>\n"
+        "    <MessageBody><![CDATA[<xml> &amp; ]] ]> stays as is]]></MessageBody>\n"
+        "    <PublishTime>2</PublishTime>\n"
+        "    <FirstConsumeTime>3</FirstConsumeTime>\n"
+        "    <NextConsumeTime>4</NextConsumeTime>\n"
+        "    <ConsumedTimes>1</ConsumedTimes>\n"
+        "    <MessageTag/>\n"
+        "  </Message>\n"
+        "  <Message><MessageId>id-3</MessageId><ReceiptHandle>rh3</ReceiptHandle>"
+        "<MessageBody></MessageBody><PublishTime>5</PublishTime><ConsumedTimes>2</ConsumedTimes></Message>\n"
+        "</Messages>\n");
+}
+
+// what the DOM path reads, pugixml takes a body with a DOCTYPE
+static vector<Message> ReadWithPugixml(const string& body)
+{
+    vector<Message> messages;
+    ConsumeMessageResponse resp(messages);
+    resp.getRawDataPtr()->assign(kDeclaration).append("<!DOCTYPE Messages>\n").append(body);
+    resp.setStatus(200);
+    resp.parseResponse();
+    return messages;
+}
+
+// the body arrives in the pieces that end at the given offsets
+static void Receive(Response& resp, const string& body, const vector<size_t>& ends)
+{
+    resp.setStatus(200);
+    for (size_t i = 0; i < ends.size(); ++i)
+    {
+        std::string& raw = *resp.getRawDataPtr();
+        raw.append(body, raw.size(), ends[i] - raw.size());
+        resp.onBodyReceived(raw.size());
+    }
+    resp.parseResponse();
+}
+
+static bool Same(Message& read, Message& expected)
+{
+    return read.getMessageId() == expected.getMessageId()
+        && read.getReceiptHandle() == expected.getReceiptHandle()
+        && read.getMessageBodyMD5() == expected.getMessageBodyMD5()
+        && read.getMessageBody() == expected.getMessageBody()
+        && read.getMessageTag() == expected.getMessageTag()
+        && read.getProperties() == expected.getProperties()
+        && read.getPublishTime() == expected.getPublishTime()
+        && read.getFirstConsumeTime() == expected.getFirstConsumeTime()
+        && read.getNextConsumeTime() == expected.getNextConsumeTime()
+        && read.getConsumedTimes() == expected.getConsumedTimes();
+}
+
+static bool Same(const MessageView& read, Message& expected)
+{
+    return read.getMessageId() == MQStringView(expected.getMessageId())
+        && read.getReceiptHandle() == MQStringView(expected.getReceiptHandle())
+        && read.getMessageBodyMD5() == MQStringView(expected.getMessageBodyMD5())
+        && read.getMessageBody() == MQStringView(expected.getMessageBody())
+        && read.getMessageTag() == MQStringView(expected.getMessageTag())
+        && read.getMessageKey() == MQStringView(expected.getMessageKey())
+        && read.getShardingKey() == MQStringView(expected.getShardingKey())
+        && read.getPublishTime() == expected.getPublishTime()
+        && read.getFirstConsumeTime() == expected.getFirstConsumeTime()
+        && read.getNextConsumeTime() == expected.getNextConsumeTime()
+        && read.getConsumedTimes() == expected.getConsumedTimes();
+}
+
+static bool Same(const MessageBatch& read, const size_t index, Message& expected)
+{
+    return read.getMessageId(index) == MQStringView(expected.getMessageId())
+        && read.getReceiptHandle(index) == MQStringView(expected.getReceiptHandle())
+        && read.getMessageBodyMD5(index) == MQStringView(expected.getMessageBodyMD5())
+        && read.getMessageBody(index) == MQStringView(expected.getMessageBody())
+        && read.getMessageTag(index) == MQStringView(expected.getMessageTag())
+        && read.getProperty(index, MQStringView(MESSAGE_PROP_KEY)) == MQStringView(expected.getMessageKey())
+        && read.getProperty(index, MQStringView(MESSAGE_PROP_SHARDING)) == MQStringView(expected.getShardingKey())
+        && read.getPublishTime(index) == expected.getPublishTime()
+        && read.getFirstConsumeTime(index) == expected.getFirstConsumeTime()
+        && read.getNextConsumeTime(index) == expected.getNextConsumeTime()
+        && read.getConsumedTimes(index) == expected.getConsumedTimes();
+}
+
+static bool ReadsLike(const string& body, const vector<size_t>& ends, vector<Message>& expected)
+{
+    bool same = true;
+
+    vector<Message> messages;
+    ConsumeMessageResponse consumeResp(messages);
+    Receive(consumeResp, body, ends);
+    same = same && messages.size() == expected.size();
+    for (size_t i = 0; same && i < expected.size(); ++i)
+    {
+        same = Same(messages[i], expected[i]);
+    }
+
+    ConsumeBatch batch;
+    ConsumeBatchResponse batchResp(batch);
+    Receive(batchResp, body, ends);
+    same = same && batch.size() == expected.size();
+    for (size_t i = 0; same && i < expected.size(); ++i)
+    {
+        same = Same(batch[i], expected[i]);
+    }
+
+    MessageBatch columns;
+    MessageBatchResponse columnsResp(columns);
+    Receive(columnsResp, body, ends);
+    same = same && columns.size() == expected.size();
+    for (size_t i = 0; same && i < expected.size(); ++i)
+    {
+        same = Same(columns, i, expected[i]);
+    }
+    return same;
+}
+
+static void TestReference(vector<Message>& expected)
+{
+    MQ_CHECK(expected.size() == 3);
+    if (expected.size() != 3)
+    {
+        return;
+    }
+    MQ_CHECK(expected[0].getReceiptHandle() == "rh&1");
+    MQ_CHECK(expected[0].getMessageBody() == "a <b> & \"c\" 'd' AB\xe4\xb8\xad");
+    MQ_CHECK(expected[0].getShardingKey() == "s&1");
+    MQ_CHECK(expected[0].getPublishTime() == 1570000000001LL);
+    MQ_CHECK(expected[0].getConsumedTimes() == 7);
+    MQ_CHECK(expected[1].getReceiptHandle() == "rh<2>");
+    MQ_CHECK(expected[1].getMessageBody() == "<xml> &amp; ]] ]> stays as is");
+    MQ_CHECK(expected[1].getMessageTag() == "");
+    MQ_CHECK(expected[2].getMessageBody() == "");
+}
+
+static void TestEverySplit(const string& body, vector<Message>& expected)
+{
+    int32_t failed = 0;
+    for (size_t split = 0; split <= body.size(); ++split)
+    {
+        vector<size_t> ends;
+        ends.push_back(split);
+        ends.push_back(body.size());
+        if (!ReadsLike(body, ends, expected))
+        {
+            fprintf(stderr, "split at %u read differently\n", (unsigned)split);
+            failed++;
+        }
+    }
+    MQ_CHECK(failed == 0);
+
+    vector<size_t> bytes;
+    for (size_t end = 1; end <= body.size(); ++end)
+    {
+        bytes.push_back(end);
+    }
+    MQ_CHECK(ReadsLike(body, bytes, expected));
+}
+
+// the whole answer in one piece through a client, as the non-streaming transports hand it over
+class FixedBodyHandler : public MQLoopbackHandler
+{
+public:
+    FixedBodyHandler(const string& body)
+        : mBody(body)
+    {
+    }
+
+    int32_t Serve(const std::string& /*endpoint*/, Request& /*req*/, std::string& body)
+    {
+        body = mBody;
+        return 200;
+    }
+
+private:
+    string mBody;
+};
+
+static void TestThroughClient(const string& body, vector<Message>& expected)
+{
+    MQClient client("http://127.0.0.1:1", "id", "key");
+    client.setTransport(MQTransportPtr(new MQLoopbackTransport(MQLoopbackHandlerPtr(new FixedBodyHandler(body)))));
+    MQConsumerPtr consumer = client.getConsumerRef("topic", "group");
+    vector<Message> messages;
+    consumer->consumeMessage(16, 1, messages);
+    MQ_CHECK(messages.size() == expected.size());
+    for (size_t i = 0; i < messages.size() && i < expected.size(); ++i)
+    {
+        MQ_CHECK(Same(messages[i], expected[i]));
+    }
+}
+
+int main()
+{
+    const string body = string(kDeclaration) + MessagesBody();
+    vector<Message> expected = ReadWithPugixml(MessagesBody());
+    TestReference(expected);
+    TestEverySplit(body, expected);
+    TestThroughClient(body, expected);
+    return MQ_TEST_RESULT("mq_parser_test");
+}
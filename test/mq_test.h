@@ -0,0 +1,43 @@
+/*
+ * the few checks the tests need, no framework: a failed MQ_CHECK prints
+ * where and goes on, MQ_TEST_RESULT is the exit code of main.
+ */
+#ifndef MQ_SDK_TEST_H
+#define MQ_SDK_TEST_H
+
+#include <stdio.h>
+
+static int sMQTestFailures = 0;
+
+#define MQ_CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            sMQTestFailures++; \
+        } \
+    } while (0)
+
+#define MQ_CHECK_THROWS(statement) \
+    do { \
+        bool thrown = false; \
+        try \
+        { \
+            statement; \
+        } \
+        catch (mq::http::sdk::MQExceptionBase&) \
+        { \
+            thrown = true; \
+        } \
+        if (!thrown) \
+        { \
+            fprintf(stderr, "%s:%d: did not throw: %s\n", __FILE__, __LINE__, #statement); \
+            sMQTestFailures++; \
+        } \
+    } while (0)
+
+#define MQ_TEST_RESULT(name) \
+    (sMQTestFailures == 0 ? (printf("%s: ok\n", name), 0) \
+        : (printf("%s: %d checks failed\n", name, sMQTestFailures), 1))
+
+#endif